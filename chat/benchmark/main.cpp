@@ -0,0 +1,320 @@
+// 聊天服务器压测客户端：
+// 在线程池中建立大量模拟chat_client连接，按指定速率和消息体大小发送，
+// 消息体中带有发送时间戳，统计广播端到端延迟分布和每秒送达的消息数。
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "chat/public/chat_message.h"
+#include "chat/public/chat_frame_reader.h"
+#include "public/bench_runner.h"
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+
+using boost::asio::ip::tcp;
+
+typedef std::deque<chat_message> chat_message_queue;
+
+struct bench_options {
+    std::string host;
+    std::string port;
+    std::size_t connections = 100;
+    std::size_t threads = std::thread::hardware_concurrency();
+    double rate = 10.0;         // 每个连接每秒发送的消息数
+    std::size_t size = 64;      // 消息体字节数
+    int warmup = 2;             // 预热秒数，不计入统计
+    int duration = 10;          // 统计秒数
+    std::string output;         // JSON结果文件，为空时输出到stdout
+};
+
+// 每个线程一份，只在所属线程中修改
+struct bench_worker {
+    boost::asio::io_context io_context;
+    latency_histogram latency;
+    std::uint64_t sent = 0;
+    std::uint64_t delivered = 0;
+    std::uint64_t markers = 0;      // 服务器丢弃消息后发来的合并提示
+    std::uint64_t send_skipped = 0; // 写队列积压时放弃的发送
+};
+
+std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            bench_clock::now().time_since_epoch()).count();
+}
+
+class bench_client {
+public:
+    bench_client(bench_worker &worker, const bench_options &options, std::size_t id,
+                 std::atomic<std::size_t> &connected, const std::atomic<bench_phase> &phase)
+            : worker_(worker), options_(options), id_(id),
+              connected_(connected), phase_(phase),
+              socket_(worker.io_context), timer_(worker.io_context),
+              interval_(std::chrono::duration_cast<bench_clock::duration>(
+                      std::chrono::duration<double>(1.0 / options.rate))) {
+    }
+
+    void connect(const tcp::resolver::results_type &endpoints) {
+        boost::asio::async_connect(socket_, endpoints,
+                                   [this](boost::system::error_code ec, const tcp::endpoint &) {
+                                       if (!ec) {
+                                           socket_.set_option(tcp::no_delay(true));
+                                           ++connected_;
+                                           do_read();
+                                       } else {
+                                           std::cerr << "connect failed: " << ec.message() << "\n";
+                                       }
+                                   });
+    }
+
+    void start_sending() {
+        boost::asio::post(worker_.io_context, [this]() {
+            // 随机错开各连接的首次发送，避免所有连接同时突发
+            std::mt19937_64 rng(id_);
+            std::uniform_int_distribution<bench_clock::rep> offset(0, interval_.count());
+            next_send_ = bench_clock::now() + bench_clock::duration(offset(rng));
+            do_wait();
+        });
+    }
+
+private:
+    enum {
+        max_pending_msgs = 64
+    };
+
+    bool measuring() const {
+        return phase_.load(std::memory_order_relaxed) == bench_phase::measuring;
+    }
+
+    void do_wait() {
+        timer_.expires_at(next_send_);
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec || phase_.load(std::memory_order_relaxed) == bench_phase::done) {
+                return;
+            }
+
+            send_one();
+            next_send_ += interval_;
+            do_wait();
+        });
+    }
+
+    void send_one() {
+        if (write_msgs_.size() >= max_pending_msgs) {
+            if (measuring()) {
+                ++worker_.send_skipped;
+            }
+            return;
+        }
+
+        chat_message msg;
+        int prefix = std::snprintf(msg.body(), chat_message::max_body_length, "%llu %zu ",
+                                   static_cast<unsigned long long>(now_ns()), id_);
+        std::size_t length = std::max<std::size_t>(options_.size, prefix);
+        std::memset(msg.body() + prefix, 'x', length - prefix);
+        msg.body_length(length);
+        msg.encode_header();
+
+        if (measuring()) {
+            ++worker_.sent;
+        }
+
+        bool write_in_progress = !write_msgs_.empty();
+        write_msgs_.push_back(msg);
+        if (!write_in_progress) {
+            do_write();
+        }
+    }
+
+    void do_write() {
+        boost::asio::async_write(socket_,
+                                 boost::asio::buffer(write_msgs_.front().data(),
+                                                     write_msgs_.front().length()),
+                                 [this](boost::system::error_code ec, std::size_t /*length*/) {
+                                     if (!ec) {
+                                         write_msgs_.pop_front();
+                                         if (!write_msgs_.empty()) {
+                                             do_write();
+                                         }
+                                     }
+                                 });
+    }
+
+    void do_read() {
+        socket_.async_read_some(reader_.prepare(),
+                                [this](boost::system::error_code ec, std::size_t length) {
+                                    if (ec) {
+                                        return;
+                                    }
+
+                                    reader_.commit(length);
+                                    if (!reader_.parse(read_batch_)) {
+                                        return;
+                                    }
+
+                                    if (measuring()) {
+                                        std::uint64_t now = now_ns();
+                                        for (const auto &msg: read_batch_) {
+                                            on_message(msg, now);
+                                        }
+                                    }
+                                    read_batch_.clear();
+                                    do_read();
+                                });
+    }
+
+    void on_message(const chat_message &msg, std::uint64_t now) {
+        const char *body = msg.body();
+        if (msg.body_length() == 0 || body[0] < '0' || body[0] > '9') {
+            ++worker_.markers;
+            return;
+        }
+
+        std::uint64_t sent_at = std::strtoull(body, nullptr, 10);
+        ++worker_.delivered;
+        worker_.latency.record(now > sent_at ? now - sent_at : 0);
+    }
+
+    bench_worker &worker_;
+    const bench_options &options_;
+    std::size_t id_;
+    std::atomic<std::size_t> &connected_;
+    const std::atomic<bench_phase> &phase_;
+
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    bench_clock::duration interval_;
+    bench_clock::time_point next_send_;
+
+    chat_frame_reader reader_;
+    chat_message_batch read_batch_;
+    chat_message_queue write_msgs_;
+};
+
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--connections"))) {
+            options.connections = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--threads"))) {
+            options.threads = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--rate"))) {
+            options.rate = std::strtod(value, nullptr);
+        } else if ((value = parse_option(arg, "--size"))) {
+            options.size = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--warmup"))) {
+            options.warmup = std::atoi(value);
+        } else if ((value = parse_option(arg, "--duration"))) {
+            options.duration = std::atoi(value);
+        } else if ((value = parse_option(arg, "--output"))) {
+            options.output = value;
+        } else if (std::strncmp(arg, "--", 2) == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        } else if (positional == 0) {
+            options.host = arg;
+            ++positional;
+        } else if (positional == 1) {
+            options.port = arg;
+            ++positional;
+        } else {
+            return false;
+        }
+    }
+
+    if (options.threads == 0) {
+        options.threads = 1;
+    }
+    if (options.size > chat_message::max_body_length) {
+        options.size = chat_message::max_body_length;
+    }
+    return positional == 2 && options.connections > 0 && options.rate > 0;
+}
+
+void write_json(std::ostream &os, const bench_options &options, const bench_worker &total,
+                double elapsed) {
+    os << "{\n"
+       << "  \"connections\": " << options.connections << ",\n"
+       << "  \"threads\": " << options.threads << ",\n"
+       << "  \"rate_per_connection\": " << options.rate << ",\n"
+       << "  \"body_size\": " << options.size << ",\n"
+       << "  \"duration_s\": " << elapsed << ",\n"
+       << "  \"sent\": " << total.sent << ",\n"
+       << "  \"send_skipped\": " << total.send_skipped << ",\n"
+       << "  \"delivered\": " << total.delivered << ",\n"
+       << "  \"delivered_per_sec\": " << static_cast<double>(total.delivered) / elapsed << ",\n"
+       << "  \"markers\": " << total.markers << ",\n";
+    write_latency_json(os, "latency_us", total.latency, true);
+    os << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        bench_options options;
+        if (!parse_options(argc, argv, options)) {
+            std::cerr << "Usage: chat_benchmark <host> <port> [--connections=<n>] [--threads=<n>]"
+                         " [--rate=<msgs/s per connection>] [--size=<body bytes>]"
+                         " [--warmup=<seconds>] [--duration=<seconds>] [--output=<json file>]\n";
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<bench_worker>> workers;
+        for (std::size_t i = 0; i < options.threads; ++i) {
+            workers.push_back(std::make_unique<bench_worker>());
+        }
+
+        std::atomic<std::size_t> connected{0};
+        std::atomic<bench_phase> phase{bench_phase::connecting};
+
+        tcp::resolver resolver(workers.front()->io_context);
+        auto endpoints = resolver.resolve(options.host, options.port);
+
+        std::vector<std::unique_ptr<bench_client>> clients;
+        for (std::size_t i = 0; i < options.connections; ++i) {
+            auto &worker = *workers[i % workers.size()];
+            clients.push_back(std::make_unique<bench_client>(worker, options, i, connected, phase));
+            clients.back()->connect(endpoints);
+        }
+
+        std::vector<std::thread> threads = start_bench_threads(workers);
+        wait_bench_connected(connected, options.connections);
+
+        for (auto &client: clients) {
+            client->start_sending();
+        }
+        double elapsed = run_bench_phases(phase, options.warmup, options.duration);
+        stop_bench_threads(workers, threads);
+
+        bench_worker total;
+        for (auto &worker: workers) {
+            total.latency.merge(worker->latency);
+            total.sent += worker->sent;
+            total.delivered += worker->delivered;
+            total.markers += worker->markers;
+            total.send_skipped += worker->send_skipped;
+        }
+
+        write_bench_output(options.output, [&](std::ostream &os) { write_json(os, options, total, elapsed); });
+    }
+    catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
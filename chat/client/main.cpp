@@ -8,6 +8,7 @@
 #include <boost/asio.hpp>
 
 #include "chat/public/chat_message.h"
+#include "chat/public/chat_frame_reader.h"
 
 using boost::asio::ip::tcp;
 
@@ -40,31 +41,27 @@ private:
         boost::asio::async_connect(socket_, endpoints,
                                    [this](boost::system::error_code ec, const tcp::endpoint &) {
                                        if (!ec) {
-                                           do_read_header();
+                                           do_read();
                                        }
                                    });
     }
 
-    void do_read_header() {
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-                                [this](boost::system::error_code ec, std::size_t /*length*/) {
-                                    if (!ec && read_msg_.decode_header()) {
-                                        do_read_body();
-                                    } else {
-                                        socket_.close();
-                                    }
-                                });
-    }
-
-    void do_read_body() {
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-                                [this](boost::system::error_code ec, std::size_t /*length*/) {
+    void do_read() {
+        socket_.async_read_some(reader_.prepare(),
+                                [this](boost::system::error_code ec, std::size_t length) {
                                     if (!ec) {
-                                        std::cout.write(read_msg_.body(), read_msg_.body_length());
-                                        std::cout << "\n";
-                                        do_read_header();
+                                        reader_.commit(length);
+                                        if (!reader_.parse(read_batch_)) {
+                                            socket_.close();
+                                            return;
+                                        }
+
+                                        for (const auto &msg: read_batch_) {
+                                            std::cout.write(msg.body(), msg.body_length());
+                                            std::cout << "\n";
+                                        }
+                                        read_batch_.clear();
+                                        do_read();
                                     } else {
                                         socket_.close();
                                     }
@@ -90,7 +87,8 @@ private:
 private:
     boost::asio::io_context &io_context_;
     tcp::socket socket_;
-    chat_message read_msg_;
+    chat_frame_reader reader_;
+    chat_message_batch read_batch_;
     chat_message_queue write_msgs_;
 };
 
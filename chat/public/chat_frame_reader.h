@@ -0,0 +1,77 @@
+//
+// 从一块可复用的接收缓冲区中批量解析chat_message帧，
+// 一次async_read_some可以取出多条完整的消息。
+//
+
+#ifndef TEST_ASIO_CHAT_FRAME_READER_H
+#define TEST_ASIO_CHAT_FRAME_READER_H
+
+#include <cstring>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+#include "chat_message.h"
+
+typedef std::vector<chat_message> chat_message_batch;
+
+class chat_frame_reader {
+public:
+    enum {
+        default_capacity = 16 * 1024
+    };
+
+    explicit chat_frame_reader(std::size_t capacity = default_capacity)
+            : buffer_(capacity < max_frame_length ? max_frame_length : capacity) {
+    }
+
+    // 返回可供async_read_some写入的区域，剩余空间不足一帧时先把未解析的数据移到开头
+    boost::asio::mutable_buffer prepare() {
+        if (buffer_.size() - end_ < max_frame_length && begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        return boost::asio::buffer(buffer_.data() + end_, buffer_.size() - end_);
+    }
+
+    void commit(std::size_t length) {
+        end_ += length;
+    }
+
+    // 将所有完整的帧追加到batch，不完整的帧留在缓冲区等待下一次读取。
+    // 返回false表示遇到非法的帧头。
+    bool parse(chat_message_batch &batch) {
+        while (end_ - begin_ >= chat_message::header_length) {
+            chat_message msg;
+            std::memcpy(msg.data(), buffer_.data() + begin_, chat_message::header_length);
+            if (!msg.decode_header()) {
+                return false;
+            }
+
+            std::size_t length = msg.length();
+            if (end_ - begin_ < length) {
+                break;
+            }
+
+            std::memcpy(msg.body(), buffer_.data() + begin_ + chat_message::header_length, msg.body_length());
+            batch.push_back(msg);
+            begin_ += length;
+        }
+
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+        return true;
+    }
+
+private:
+    static constexpr std::size_t max_frame_length =
+            std::size_t(chat_message::header_length) + chat_message::max_body_length;
+
+    std::vector<char> buffer_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+};
+
+#endif //TEST_ASIO_CHAT_FRAME_READER_H
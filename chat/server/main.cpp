@@ -1,16 +1,25 @@
 // https://www.boost.org/doc/libs/1_71_0/doc/html/boost_asio/example/cpp11/chat/chat_server.cpp
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <set>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <boost/asio.hpp>
 
 #include "chat/public/chat_message.h"
+#include "chat/public/chat_frame_reader.h"
+#include "public/command_line.h"
+#include "public/handler_allocator.h"
 
 using boost::asio::ip::tcp;
 
@@ -20,12 +29,39 @@ typedef std::deque<chat_message> chat_message_queue;
 
 //----------------------------------------------------------------------
 
+// 当某个会话的待发送队列超出限制时的处理策略
+enum class overflow_policy
+{
+	disconnect,  // 断开慢速客户端
+	drop_oldest, // 丢弃最旧的未发送消息
+	coalesce     // 丢弃所有未发送消息，合并为一条"you missed N messages"提示
+};
+
+struct chat_session_limits
+{
+	std::size_t max_queued_msgs = 1024;
+	std::size_t max_queued_bytes = 256 * 1024;
+	overflow_policy policy = overflow_policy::drop_oldest;
+};
+
+struct chat_room_stats
+{
+	std::size_t queued_bytes = 0;
+	std::size_t peak_queued_bytes = 0;
+	std::size_t evicted_msgs = 0;
+	std::size_t disconnected_sessions = 0;
+};
+
+//----------------------------------------------------------------------
+
 class chat_participant
 {
 public:
 	virtual ~chat_participant() = default;
 
 	virtual void deliver(const chat_message& msg) = 0;
+
+	virtual void deliver(const chat_message_batch& batch) = 0;
 };
 
 typedef std::shared_ptr<chat_participant> chat_participant_ptr;
@@ -35,12 +71,17 @@ typedef std::shared_ptr<chat_participant> chat_participant_ptr;
 class chat_room
 {
 public:
+	explicit chat_room(const chat_session_limits& limits)
+		: limits_(limits)
+	{
+	}
+
 	void join(const chat_participant_ptr& participant)
 	{
 		participants_.insert(participant);
-		for (auto msg : recent_msgs_)
+		if (!recent_msgs_.empty())
 		{
-			participant->deliver(msg);
+			participant->deliver(chat_message_batch(recent_msgs_.begin(), recent_msgs_.end()));
 		}
 	}
 
@@ -63,6 +104,65 @@ public:
 		}
 	}
 
+	// 一次读取中解析出的多条消息作为一批广播，每个接收者只需一次聚集写
+	void deliver(const chat_message_batch& batch)
+	{
+		for (const auto& msg : batch)
+		{
+			recent_msgs_.push_back(msg);
+		}
+		while (recent_msgs_.size() > max_recent_msgs)
+		{
+			recent_msgs_.pop_front();
+		}
+
+		for (const auto& participant : participants_)
+		{
+			participant->deliver(batch);
+		}
+	}
+
+	const chat_session_limits& limits() const
+	{
+		return limits_;
+	}
+
+	const chat_room_stats& stats() const
+	{
+		return stats_;
+	}
+
+	std::size_t participant_count() const
+	{
+		return participants_.size();
+	}
+
+	// 以下由会话调用，用于汇总房间内所有会话的队列状态
+
+	void on_queued(std::size_t bytes)
+	{
+		stats_.queued_bytes += bytes;
+		if (stats_.queued_bytes > stats_.peak_queued_bytes)
+		{
+			stats_.peak_queued_bytes = stats_.queued_bytes;
+		}
+	}
+
+	void on_dequeued(std::size_t bytes)
+	{
+		stats_.queued_bytes -= bytes;
+	}
+
+	void on_evicted(std::size_t msgs)
+	{
+		stats_.evicted_msgs += msgs;
+	}
+
+	void on_disconnected()
+	{
+		++stats_.disconnected_sessions;
+	}
+
 private:
 	enum
 	{
@@ -71,10 +171,40 @@ private:
 
 	std::set<chat_participant_ptr> participants_;
 	chat_message_queue recent_msgs_;
+	chat_session_limits limits_;
+	chat_room_stats stats_;
 };
 
 //----------------------------------------------------------------------
 
+// 引用一组const_buffer而不复制它们。async_write按值保存缓冲区序列，
+// 直接传std::vector每次写都会复制一份，在稳态写循环中产生一次分配
+class const_buffer_view
+{
+public:
+	typedef boost::asio::const_buffer value_type;
+	typedef const boost::asio::const_buffer* const_iterator;
+
+	explicit const_buffer_view(const std::vector<boost::asio::const_buffer>& buffers)
+		: begin_(buffers.data()), end_(buffers.data() + buffers.size())
+	{
+	}
+
+	const_iterator begin() const
+	{
+		return begin_;
+	}
+
+	const_iterator end() const
+	{
+		return end_;
+	}
+
+private:
+	const_iterator begin_;
+	const_iterator end_;
+};
+
 class chat_session
 	: public chat_participant,
 	  public std::enable_shared_from_this<chat_session>
@@ -88,84 +218,319 @@ public:
 	void start()
 	{
 		room_.join(shared_from_this());
-		do_read_header();
+		do_read();
 	}
 
 	void deliver(const chat_message& msg) override
 	{
+		if (stopped_)
+		{
+			return;
+		}
+
 		bool write_in_progress = !write_msgs_.empty();
-		write_msgs_.push_back(msg);
+		if (!enqueue(msg))
+		{
+			return;
+		}
+
 		if (!write_in_progress)
 		{
 			do_write();
 		}
 	}
 
+	void deliver(const chat_message_batch& batch) override
+	{
+		if (stopped_)
+		{
+			return;
+		}
+
+		bool write_in_progress = !write_msgs_.empty();
+		for (const auto& msg : batch)
+		{
+			if (!enqueue(msg) && stopped_)
+			{
+				return;
+			}
+		}
+
+		if (!write_in_progress && !write_msgs_.empty())
+		{
+			do_write();
+		}
+	}
+
 private:
-	void do_read_header()
+	// 队列中的消息；missed不为0时表示这是一条合并提示
+	struct queued_message
+	{
+		chat_message msg;
+		std::size_t missed = 0;
+	};
+
+	bool enqueue(const chat_message& msg)
+	{
+		if (would_overflow(msg.length()) && !make_room(msg.length()))
+		{
+			return false;
+		}
+
+		push_message(msg, 0);
+		return true;
+	}
+
+	// 只统计未写入的消息：正在写入的消息不能丢弃，计入后make_room可能无消息可丢
+	bool would_overflow(std::size_t length, std::size_t msgs = 1) const
+	{
+		const chat_session_limits& limits = room_.limits();
+		return write_msgs_.size() - writing_msgs_ + msgs > limits.max_queued_msgs
+			|| queued_bytes_ - writing_bytes_ + length > limits.max_queued_bytes;
+	}
+
+	// 正在写入的消息之后的第一条，即最旧的可丢弃消息
+	std::list<queued_message>::iterator pending_begin()
+	{
+		return std::next(write_msgs_.begin(), writing_msgs_);
+	}
+
+	bool has_pending() const
+	{
+		return write_msgs_.size() > writing_msgs_;
+	}
+
+	// 按策略腾出空间，返回false表示新消息不应再入队
+	bool make_room(std::size_t length)
+	{
+		switch (room_.limits().policy)
+		{
+		case overflow_policy::disconnect:
+			evict();
+			return false;
+
+		case overflow_policy::drop_oldest:
+			// 正在写入的消息不能丢弃；除新消息外还要为合并提示留出位置，
+			// 队首旧的提示也会被丢弃，它的数量并入新的提示
+			while (has_pending() && would_overflow(length + max_marker_length, 2))
+			{
+				drop_message(pending_begin());
+			}
+			push_marker();
+			if (would_overflow(length))
+			{
+				++missed_;
+				room_.on_evicted(1);
+				return false;
+			}
+			return true;
+
+		case overflow_policy::coalesce:
+			while (has_pending())
+			{
+				drop_message(pending_begin());
+			}
+			push_marker();
+			if (would_overflow(length))
+			{
+				++missed_;
+				room_.on_evicted(1);
+				return false;
+			}
+			return true;
+		}
+
+		return true;
+	}
+
+	void push_message(const chat_message& msg, std::size_t missed)
+	{
+		queued_bytes_ += msg.length();
+		room_.on_queued(msg.length());
+		write_msgs_.emplace_back();
+		write_msgs_.back().msg = msg;
+		write_msgs_.back().missed = missed;
+	}
+
+	// 提示放在未写入部分的最前面，即被丢弃消息原来的位置
+	void push_marker()
+	{
+		if (missed_ == 0)
+		{
+			return;
+		}
+
+		std::string text = "[you missed " + std::to_string(missed_) + " messages]";
+		auto it = write_msgs_.emplace(pending_begin());
+		it->msg.body_length(text.size());
+		std::memcpy(it->msg.body(), text.data(), it->msg.body_length());
+		it->msg.encode_header();
+		it->missed = missed_;
+
+		queued_bytes_ += it->msg.length();
+		room_.on_queued(it->msg.length());
+		missed_ = 0;
+	}
+
+	// 只能丢弃未写入的消息：正在写入的消息被write_buffers_引用，
+	// 用std::list保证删除其他元素时它们的地址不变
+	void drop_message(std::list<queued_message>::iterator it)
+	{
+		queued_bytes_ -= it->msg.length();
+		room_.on_dequeued(it->msg.length());
+		if (it->missed != 0)
+		{
+			// 旧的提示被丢弃时，把它记录的数量并入新的提示
+			missed_ += it->missed;
+		}
+		else
+		{
+			++missed_;
+			room_.on_evicted(1);
+		}
+		write_msgs_.erase(it);
+	}
+
+	void pop_written_messages()
+	{
+		for (std::size_t i = 0; i < writing_msgs_; ++i)
+		{
+			if (!stopped_)
+			{
+				queued_bytes_ -= write_msgs_.front().msg.length();
+				room_.on_dequeued(write_msgs_.front().msg.length());
+			}
+			write_msgs_.pop_front();
+		}
+		writing_msgs_ = 0;
+		writing_bytes_ = 0;
+	}
+
+	// 在房间广播的遍历过程中被调用，不能直接修改房间的参与者集合
+	void evict()
 	{
 		auto self(shared_from_this());
-		boost::asio::async_read(socket_,
-			boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-			[this, self](boost::system::error_code ec, std::size_t /*length*/)
+		room_.on_disconnected();
+		stop();
+		boost::asio::post(socket_.get_executor(),
+			[this, self]()
 			{
-				if (!ec && read_msg_.decode_header())
-				{
-					do_read_body();
-				}
-				else
-				{
-					room_.leave(shared_from_this());
-				}
+				room_.leave(self);
 			});
 	}
 
-	void do_read_body()
+	void stop()
+	{
+		if (stopped_)
+		{
+			return;
+		}
+
+		stopped_ = true;
+		room_.on_dequeued(queued_bytes_);
+		queued_bytes_ = 0;
+
+		boost::system::error_code ignored_ec;
+		socket_.close(ignored_ec);
+	}
+
+	void leave()
+	{
+		stop();
+		room_.leave(shared_from_this());
+	}
+
+	void do_read()
 	{
 		auto self(shared_from_this());
-		boost::asio::async_read(socket_,
-			boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-			[this, self](boost::system::error_code ec, std::size_t /*length*/)
-			{
-				if (!ec)
-				{
-					room_.deliver(read_msg_);
-					do_read_header();
-				}
-				else
+		socket_.async_read_some(reader_.prepare(),
+			make_custom_alloc_handler(read_memory_,
+				[this, self](boost::system::error_code ec, std::size_t length)
 				{
-					room_.leave(shared_from_this());
-				}
-			});
+					if (!ec)
+					{
+						reader_.commit(length);
+						if (!reader_.parse(read_batch_))
+						{
+							leave();
+							return;
+						}
+
+						if (!read_batch_.empty())
+						{
+							room_.deliver(read_batch_);
+							read_batch_.clear();
+						}
+						do_read();
+					}
+					else
+					{
+						leave();
+					}
+				}));
 	}
 
 	void do_write()
 	{
+		// 把队列中的多条消息合并为一次聚集写。正在写入的消息不计入队列限制，
+		// 一次最多取max_queued_msgs - 2条，使会话的总消息数不超过限制的两倍
+		const std::size_t max_msgs = std::min<std::size_t>(max_gathered_msgs, room_.limits().max_queued_msgs - 2);
+		write_buffers_.clear();
+		writing_bytes_ = 0;
+		for (auto it = write_msgs_.begin();
+			 it != write_msgs_.end() && write_buffers_.size() < max_msgs; ++it)
+		{
+			write_buffers_.push_back(boost::asio::buffer(it->msg.data(), it->msg.length()));
+			writing_bytes_ += it->msg.length();
+		}
+		writing_msgs_ = write_buffers_.size();
+
 		auto self(shared_from_this());
-		boost::asio::async_write(socket_,
-			boost::asio::buffer(write_msgs_.front().data(),
-				write_msgs_.front().length()),
-			[this, self](boost::system::error_code ec, std::size_t /*length*/)
-			{
-				if (!ec)
+		boost::asio::async_write(socket_, const_buffer_view(write_buffers_),
+			make_custom_alloc_handler(write_memory_,
+				[this, self](boost::system::error_code ec, std::size_t /*length*/)
 				{
-					write_msgs_.pop_front();
-					if (!write_msgs_.empty())
+					if (!ec)
 					{
-						do_write();
+						pop_written_messages();
+						if (!write_msgs_.empty())
+						{
+							do_write();
+						}
 					}
-				}
-				else
-				{
-					room_.leave(shared_from_this());
-				}
-			});
+					else
+					{
+						leave();
+					}
+				}));
 	}
 
+	enum
+	{
+		max_gathered_msgs = 64
+	};
+
+	// "[you missed N messages]"提示的最大长度
+	enum
+	{
+		max_marker_length = chat_message::header_length + 48
+	};
+
 	tcp::socket socket_;
 	chat_room& room_;
-	chat_message read_msg_;
-	chat_message_queue write_msgs_;
+	chat_frame_reader reader_;
+	chat_message_batch read_batch_;
+	std::list<queued_message> write_msgs_;
+	std::vector<boost::asio::const_buffer> write_buffers_;
+	std::size_t writing_msgs_ = 0;
+	std::size_t writing_bytes_ = 0;
+	std::size_t queued_bytes_ = 0;
+	std::size_t missed_ = 0;
+	bool stopped_ = false;
+
+	// 读和写会同时挂起，各用一块
+	handler_memory read_memory_;
+	handler_memory write_memory_;
 };
 
 //----------------------------------------------------------------------
@@ -173,10 +538,16 @@ private:
 class chat_server
 {
 public:
-	chat_server(boost::asio::io_context& io_context, const tcp::endpoint& endpoint)
-		: acceptor_(io_context, endpoint)
+	chat_server(boost::asio::io_context& io_context, const tcp::endpoint& endpoint,
+		const chat_session_limits& limits, std::chrono::seconds stats_interval)
+		: acceptor_(io_context, endpoint), room_(limits),
+		  stats_timer_(io_context), stats_interval_(stats_interval)
 	{
 		do_accept();
+		if (stats_interval_.count() > 0)
+		{
+			do_report();
+		}
 	}
 
 private:
@@ -194,8 +565,34 @@ private:
 			});
 	}
 
+	void do_report()
+	{
+		stats_timer_.expires_after(stats_interval_);
+		stats_timer_.async_wait(
+			[this](boost::system::error_code ec)
+			{
+				if (ec)
+				{
+					return;
+				}
+
+				const chat_room_stats& stats = room_.stats();
+				std::cout << "room[" << acceptor_.local_endpoint().port() << "]"
+					<< " participants=" << room_.participant_count()
+					<< " queued_bytes=" << stats.queued_bytes
+					<< " peak_queued_bytes=" << stats.peak_queued_bytes
+					<< " evicted_msgs=" << stats.evicted_msgs
+					<< " disconnected_sessions=" << stats.disconnected_sessions
+					<< std::endl;
+
+				do_report();
+			});
+	}
+
 	tcp::acceptor acceptor_;
 	chat_room room_;
+	boost::asio::steady_timer stats_timer_;
+	std::chrono::seconds stats_interval_;
 };
 
 //----------------------------------------------------------------------
@@ -204,19 +601,79 @@ int main(int argc, char* argv[])
 {
 	try
 	{
-		if (argc < 2)
+		chat_session_limits limits;
+		std::chrono::seconds stats_interval(0);
+
+		int first_port = 1;
+		for (; first_port < argc && std::strncmp(argv[first_port], "--", 2) == 0; ++first_port)
 		{
-			std::cerr << "Usage: chat_server <port> [<port> ...]\n";
+			const char* arg = argv[first_port];
+			const char* value = nullptr;
+			if ((value = parse_option(arg, "--max-queue-msgs")))
+			{
+				limits.max_queued_msgs = std::strtoul(value, nullptr, 10);
+			}
+			else if ((value = parse_option(arg, "--max-queue-bytes")))
+			{
+				limits.max_queued_bytes = std::strtoul(value, nullptr, 10);
+			}
+			else if ((value = parse_option(arg, "--overflow")))
+			{
+				if (std::strcmp(value, "disconnect") == 0)
+				{
+					limits.policy = overflow_policy::disconnect;
+				}
+				else if (std::strcmp(value, "drop-oldest") == 0)
+				{
+					limits.policy = overflow_policy::drop_oldest;
+				}
+				else if (std::strcmp(value, "coalesce") == 0)
+				{
+					limits.policy = overflow_policy::coalesce;
+				}
+				else
+				{
+					std::cerr << "Unknown overflow policy: " << value << "\n";
+					return 1;
+				}
+			}
+			else if ((value = parse_option(arg, "--stats-interval")))
+			{
+				stats_interval = std::chrono::seconds(std::atoi(value));
+			}
+			else
+			{
+				std::cerr << "Unknown option: " << arg << "\n";
+				return 1;
+			}
+		}
+
+		if (first_port >= argc)
+		{
+			std::cerr << "Usage: chat_server [--max-queue-msgs=<n>] [--max-queue-bytes=<n>]"
+				" [--overflow=disconnect|drop-oldest|coalesce] [--stats-interval=<seconds>]"
+				" <port> [<port> ...]\n";
 			return 1;
 		}
 
+		// 未写入部分至少要容纳合并提示和一条新消息，聚集写至少能取一条消息
+		if (limits.max_queued_msgs < 3)
+		{
+			limits.max_queued_msgs = 3;
+		}
+		const std::size_t max_message_length = std::size_t(chat_message::header_length) + chat_message::max_body_length;
+		if (limits.max_queued_bytes < 3 * max_message_length)
+		{
+			limits.max_queued_bytes = 3 * max_message_length;
+		}
+
 		boost::asio::io_context io_context;
 
 		std::list<chat_server> servers;
-		for (int i = 1; i < argc; ++i)
+		for (int i = first_port; i < argc; ++i)
 		{
 			tcp::endpoint endpoint(tcp::v4(), std::atoi(argv[i]));
-			servers.emplace_back(io_context, endpoint);
+			servers.emplace_back(io_context, endpoint, limits, stats_interval);
 		}
 
 		io_context.run();
@@ -0,0 +1,235 @@
+// daytime服务器建连压测：
+// 多个线程各自运行io_context，每个线程同时进行若干个 connect -> 读到EOF -> close 循环，
+// 统计每秒完成的连接数、connect耗时（内核完成握手）和首字节耗时（服务器accept并写出应答）的分布。
+// 服务器开启TCP_DEFER_ACCEPT时需要加--hello，连接后先发一个字节，否则要等到超时才会被accept。
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "public/bench_runner.h"
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+
+using boost::asio::ip::tcp;
+
+struct bench_options {
+    std::string host = "127.0.0.1";
+    std::string port = "1300";
+    std::size_t threads = std::thread::hardware_concurrency();
+    std::size_t concurrency = 32;   // 每个线程同时进行的连接循环数
+    bool hello = false;
+    int warmup = 1;
+    int duration = 10;
+    std::string output;
+};
+
+// 每个线程一份，只在所属线程中修改
+struct bench_worker {
+    boost::asio::io_context io_context{1};
+    latency_histogram connect_latency;
+    latency_histogram first_byte_latency;
+    std::uint64_t connections = 0;
+    std::uint64_t errors = 0;
+};
+
+std::uint64_t elapsed_ns(bench_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - since).count();
+}
+
+class bench_loop {
+public:
+    bench_loop(bench_worker &worker, const bench_options &options,
+               const tcp::resolver::results_type &endpoints, const std::atomic<bench_phase> &phase)
+            : worker_(worker), options_(options), endpoints_(endpoints), phase_(phase),
+              socket_(worker.io_context) {
+    }
+
+    void start() {
+        if (phase_.load(std::memory_order_relaxed) == bench_phase::done) {
+            return;
+        }
+
+        start_ = bench_clock::now();
+        first_byte_ = true;
+        boost::asio::async_connect(socket_, endpoints_,
+                                   [this](boost::system::error_code ec, const tcp::endpoint &) {
+                                       if (ec) {
+                                           return fail();
+                                       }
+
+                                       connect_ns_ = elapsed_ns(start_);
+                                       if (options_.hello) {
+                                           boost::asio::async_write(socket_, boost::asio::buffer("\n", 1),
+                                                                    [](boost::system::error_code, std::size_t) {
+                                                                    });
+                                       }
+                                       do_read();
+                                   });
+    }
+
+private:
+    bool measuring() const {
+        return phase_.load(std::memory_order_relaxed) == bench_phase::measuring;
+    }
+
+    void do_read() {
+        socket_.async_read_some(boost::asio::buffer(buffer_),
+                                [this](boost::system::error_code ec, std::size_t length) {
+                                    if (!ec && length > 0) {
+                                        if (first_byte_) {
+                                            first_byte_ns_ = elapsed_ns(start_);
+                                            first_byte_ = false;
+                                        }
+                                        do_read();
+                                        return;
+                                    }
+
+                                    if (ec != boost::asio::error::eof || first_byte_) {
+                                        return fail();
+                                    }
+
+                                    if (measuring()) {
+                                        ++worker_.connections;
+                                        worker_.connect_latency.record(connect_ns_);
+                                        worker_.first_byte_latency.record(first_byte_ns_);
+                                    }
+                                    restart();
+                                });
+    }
+
+    void fail() {
+        if (measuring()) {
+            ++worker_.errors;
+        }
+        restart();
+    }
+
+    void restart() {
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        start();
+    }
+
+    bench_worker &worker_;
+    const bench_options &options_;
+    const tcp::resolver::results_type &endpoints_;
+    const std::atomic<bench_phase> &phase_;
+
+    tcp::socket socket_;
+    char buffer_[128];
+    bench_clock::time_point start_;
+    std::uint64_t connect_ns_ = 0;
+    std::uint64_t first_byte_ns_ = 0;
+    bool first_byte_ = true;
+};
+
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--host"))) {
+            options.host = value;
+        } else if ((value = parse_option(arg, "--port"))) {
+            options.port = value;
+        } else if ((value = parse_option(arg, "--threads"))) {
+            options.threads = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--concurrency"))) {
+            options.concurrency = std::strtoul(value, nullptr, 10);
+        } else if (std::strcmp(arg, "--hello") == 0) {
+            options.hello = true;
+        } else if ((value = parse_option(arg, "--warmup"))) {
+            options.warmup = std::atoi(value);
+        } else if ((value = parse_option(arg, "--duration"))) {
+            options.duration = std::atoi(value);
+        } else if ((value = parse_option(arg, "--output"))) {
+            options.output = value;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.threads == 0) {
+        options.threads = 1;
+    }
+    return options.concurrency > 0;
+}
+
+void write_json(std::ostream &os, const bench_options &options, const bench_worker &total, double elapsed) {
+    os << "{\n"
+       << "  \"threads\": " << options.threads << ",\n"
+       << "  \"concurrency\": " << options.threads * options.concurrency << ",\n"
+       << "  \"duration_s\": " << elapsed << ",\n"
+       << "  \"connections\": " << total.connections << ",\n"
+       << "  \"errors\": " << total.errors << ",\n"
+       << "  \"connections_per_sec\": " << static_cast<double>(total.connections) / elapsed << ",\n";
+    write_latency_json(os, "connect_us", total.connect_latency, false);
+    write_latency_json(os, "first_byte_us", total.first_byte_latency, true);
+    os << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        bench_options options;
+        if (!parse_options(argc, argv, options)) {
+            std::cerr << "Usage: daytime_benchmark [--host=<host>] [--port=<port>] [--threads=<n>]"
+                         " [--concurrency=<connections per thread>] [--hello] [--warmup=<seconds>]"
+                         " [--duration=<seconds>] [--output=<json file>]\n";
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<bench_worker>> workers;
+        for (std::size_t i = 0; i < options.threads; ++i) {
+            workers.push_back(std::make_unique<bench_worker>());
+        }
+
+        tcp::resolver resolver(workers.front()->io_context);
+        auto endpoints = resolver.resolve(options.host, options.port);
+
+        std::atomic<bench_phase> phase{bench_phase::connecting};
+        std::vector<std::unique_ptr<bench_loop>> loops;
+        for (auto &worker: workers) {
+            for (std::size_t i = 0; i < options.concurrency; ++i) {
+                loops.push_back(std::make_unique<bench_loop>(*worker, options, endpoints, phase));
+                loops.back()->start();
+            }
+        }
+
+        std::vector<std::thread> threads = start_bench_threads(workers);
+        double elapsed = run_bench_phases(phase, options.warmup, options.duration);
+        stop_bench_threads(workers, threads);
+
+        bench_worker total;
+        for (auto &worker: workers) {
+            total.connect_latency.merge(worker->connect_latency);
+            total.first_byte_latency.merge(worker->first_byte_latency);
+            total.connections += worker->connections;
+            total.errors += worker->errors;
+        }
+
+        std::cerr << "connections/s=" << static_cast<double>(total.connections) / elapsed
+                  << " errors=" << total.errors
+                  << " first_byte p50=" << total.first_byte_latency.percentile(50.0) / 1000.0 << "us"
+                  << " p99=" << total.first_byte_latency.percentile(99.0) / 1000.0 << "us\n";
+
+        write_bench_output(options.output, [&](std::ostream &os) { write_json(os, options, total, elapsed); });
+    }
+    catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,17 +1,38 @@
 // https://www.boost.org/doc/libs/1_71_0/doc/html/boost_asio/tutorial/tutdaytime3/src.html
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <list>
 #include <string>
+#include <thread>
+#include <vector>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/system_timer.hpp>
+
+#include "public/command_line.h"
 
 using boost::asio::ip::tcp;
 
 const unsigned int PORT = 1300;
 
+// 同时挂起的async_accept数量，连接突发时不必等上一个accept的回调重新投递
+const unsigned int PENDING_ACCEPTS = 16;
+
+struct server_options
+{
+	unsigned short port = PORT;
+	unsigned int accepts = PENDING_ACCEPTS;
+	unsigned int acceptors = 1;     // 大于1时每个线程一个acceptor，用SO_REUSEPORT绑定同一端口，由内核分发连接
+	int defer_accept = 0;           // TCP_DEFER_ACCEPT秒数，客户端发来数据后才完成accept
+};
+
 std::string make_daytime_string()
 {
 	using namespace std; // For time_t, time and ctime;
@@ -19,6 +40,48 @@ std::string make_daytime_string()
 	return ctime(&now);
 }
 
+typedef boost::shared_ptr<const std::string> daytime_message;
+
+// 预先格式化好的应答，每到整秒由定时器替换一次。
+// 连接只持有当前应答的引用计数，直接把它作为发送缓冲区，不再逐连接格式化和分配。
+class daytime_cache
+{
+public:
+	explicit daytime_cache(boost::asio::io_context& io_context)
+		: timer_(io_context)
+	{
+		refresh();
+	}
+
+	const daytime_message& current() const
+	{
+		return current_;
+	}
+
+private:
+	void refresh()
+	{
+		current_ = boost::make_shared<const std::string>(make_daytime_string());
+
+		// 对齐到下一个整秒，ctime的结果只在整秒时变化
+		auto now = std::chrono::system_clock::now();
+		timer_.expires_at(std::chrono::time_point_cast<std::chrono::seconds>(now) + std::chrono::seconds(1));
+		timer_.async_wait(boost::bind(&daytime_cache::handle_timer, this,
+			boost::asio::placeholders::error));
+	}
+
+	void handle_timer(const boost::system::error_code& error)
+	{
+		if (!error)
+		{
+			refresh();
+		}
+	}
+
+	boost::asio::system_timer timer_;
+	daytime_message current_;
+};
+
 class tcp_connection
 	: public boost::enable_shared_from_this<tcp_connection>
 {
@@ -35,11 +98,17 @@ public:
 		return socket_;
 	}
 
-	void start()
+	void start(const daytime_message& message, bool drain)
 	{
-		message_ = make_daytime_string();
+		if (drain)
+		{
+			drain_input();
+		}
+
+		// 持有引用直到写完成，期间定时器替换缓存也不影响这次发送
+		message_ = message;
 
-		boost::asio::async_write(socket_, boost::asio::buffer(message_),
+		boost::asio::async_write(socket_, boost::asio::buffer(*message_),
 			boost::bind(&tcp_connection::handle_write, shared_from_this(),
 				boost::asio::placeholders::error,
 				boost::asio::placeholders::bytes_transferred));
@@ -55,17 +124,50 @@ private:
 	{
 	}
 
+	// TCP_DEFER_ACCEPT下accept时客户端的数据已经到达，先读掉，否则带着未读数据关闭时内核会发送RST
+	void drain_input()
+	{
+		boost::system::error_code ec;
+		char discard[256];
+		for (std::size_t available = socket_.available(ec); !ec && available > 0; available = socket_.available(ec))
+		{
+			socket_.read_some(boost::asio::buffer(discard, available < sizeof(discard) ? available : sizeof(discard)), ec);
+		}
+	}
+
 	tcp::socket socket_;
-	std::string message_;
+	daytime_message message_;
 };
 
 class tcp_server
 {
 public:
-	explicit tcp_server(boost::asio::io_context& io_context)
-		: io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), PORT))
+	tcp_server(boost::asio::io_context& io_context, const server_options& options)
+		: io_context_(io_context), acceptor_(io_context), cache_(io_context), drain_(options.defer_accept > 0)
 	{
-		start_accept();
+		tcp::endpoint endpoint(tcp::v4(), options.port);
+		acceptor_.open(endpoint.protocol());
+		acceptor_.set_option(tcp::acceptor::reuse_address(true));
+#if defined(SO_REUSEPORT)
+		if (options.acceptors > 1)
+		{
+			acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+		}
+#endif
+#if defined(TCP_DEFER_ACCEPT)
+		if (options.defer_accept > 0)
+		{
+			acceptor_.set_option(
+				boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_DEFER_ACCEPT>(options.defer_accept));
+		}
+#endif
+		acceptor_.bind(endpoint);
+		acceptor_.listen();
+
+		for (unsigned int i = 0; i < options.accepts; ++i)
+		{
+			start_accept();
+		}
 	}
 
 private:
@@ -82,7 +184,7 @@ private:
 	{
 		if (!error)
 		{
-			new_connection->start();
+			new_connection->start(cache_.current(), drain_);
 		}
 
 		start_accept();
@@ -90,15 +192,79 @@ private:
 
 	boost::asio::io_context& io_context_;
 	tcp::acceptor acceptor_;
+	daytime_cache cache_;
+	bool drain_;
 };
 
-int main()
+int main(int argc, char* argv[])
 {
 	try
 	{
-		boost::asio::io_context io_context;
-		tcp_server server(io_context);
-		io_context.run();
+		server_options options;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+			const char* value = nullptr;
+			if ((value = parse_option(arg, "--port")))
+			{
+				options.port = static_cast<unsigned short>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--accepts")))
+			{
+				options.accepts = static_cast<unsigned int>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--reuseport")))
+			{
+				options.acceptors = static_cast<unsigned int>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--defer-accept")))
+			{
+				options.defer_accept = std::atoi(value);
+			}
+			else
+			{
+				std::cerr << "Usage: daytime_server [--port=<port>] [--accepts=<pending accepts>]"
+					" [--reuseport=<acceptor threads>] [--defer-accept=<seconds>]" << std::endl;
+				return 1;
+			}
+		}
+
+		if (options.accepts == 0)
+		{
+			options.accepts = 1;
+		}
+		if (options.acceptors == 0)
+		{
+			options.acceptors = 1;
+		}
+#if !defined(SO_REUSEPORT)
+		if (options.acceptors > 1)
+		{
+			std::cerr << "SO_REUSEPORT is not supported on this platform" << std::endl;
+			return 1;
+		}
+#endif
+
+		// 每个acceptor一个io_context和线程，各自维护缓存的应答
+		std::list<boost::asio::io_context> io_contexts;
+		std::list<tcp_server> servers;
+		for (unsigned int i = 0; i < options.acceptors; ++i)
+		{
+			io_contexts.emplace_back(1);
+			servers.emplace_back(io_contexts.back(), options);
+		}
+
+		std::vector<std::thread> threads;
+		for (auto it = std::next(io_contexts.begin()); it != io_contexts.end(); ++it)
+		{
+			threads.emplace_back([it]() { it->run(); });
+		}
+		io_contexts.front().run();
+
+		for (auto& t : threads)
+		{
+			t.join();
+		}
 	}
 	catch (std::exception& e)
 	{
@@ -0,0 +1,375 @@
+// echo会话对比压测：
+// 在同一进程内启动echo服务器（单独的io_context线程），客户端每轮发送一个负载并等待完整回显，
+// 对fixed/adaptive/splice三种会话分别在1KiB、64KiB、1MiB负载下统计吞吐和每轮往返延迟。
+// --connections指定并发连接数，用于对比不同reactor（epoll/io_uring，见CMake选项TEST_ASIO_IO_URING）在不同连接数下的表现。
+// --count-allocations=N 改为统计：单连接64字节消息预热后回显N条，期间整个进程（客户端和服务器）调用operator new的次数，
+// 用来确认会话的读写循环在稳态下不分配内存。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "echo/public/echo_session.h"
+#include "public/command_line.h"
+#include "public/handler_allocator.h"
+#include "public/latency_histogram.h"
+
+using boost::asio::ip::tcp;
+
+// 进程内所有operator new调用的次数
+std::atomic<std::uint64_t> g_allocations{0};
+
+void *operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+struct bench_options {
+    std::vector<echo_mode> modes{echo_mode::fixed, echo_mode::adaptive
+#if defined(__linux__)
+            , echo_mode::splice
+#endif
+    };
+    std::vector<std::size_t> sizes{1024, 64 * 1024, 1024 * 1024};
+    std::size_t bytes = 64 * 1024 * 1024;   // 每个用例回显的总字节数
+    std::size_t min_rounds = 20;
+    std::size_t connections = 1;
+    std::size_t count_allocations = 0;  // 大于0时只统计这么多条消息期间的内存分配
+    echo_options session;
+};
+
+struct bench_result {
+    std::size_t rounds = 0;
+    double seconds = 0;
+    latency_histogram latency;
+};
+
+const char *mode_name(echo_mode mode) {
+    switch (mode) {
+        case echo_mode::fixed:
+            return "fixed";
+        case echo_mode::adaptive:
+            return "adaptive";
+        case echo_mode::splice:
+            return "splice";
+    }
+    return "?";
+}
+
+// 服务器接受connections个连接后停止accept，所有会话结束后线程退出。会话类型由mode决定
+class bench_server {
+public:
+    bench_server(echo_mode mode, const echo_options &options, std::size_t connections)
+            : acceptor_(io_context_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+              mode_(mode), options_(options), remaining_(connections) {
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+        if (mode_ == echo_mode::fixed) {
+            options_.buffer_pool = std::make_shared<echo_buffer_pool>(io_context_, connections,
+                                                                      echo_session::max_length);
+        }
+#endif
+        do_accept();
+        thread_ = std::thread([this]() { io_context_.run(); });
+    }
+
+    ~bench_server() {
+        thread_.join();
+    }
+
+    unsigned short port() const {
+        return acceptor_.local_endpoint().port();
+    }
+
+private:
+    void do_accept() {
+        acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+            if (!ec) {
+                socket.set_option(tcp::no_delay(true));
+                start_echo_session(mode_, std::move(socket), options_);
+            }
+            if (--remaining_ > 0) {
+                do_accept();
+            }
+        });
+    }
+
+    boost::asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    echo_mode mode_;
+    echo_options options_;
+    std::size_t remaining_;
+    std::thread thread_;
+};
+
+// 一个客户端连接，每轮发送整个负载并读回同样长度的数据。
+// 发送和接收同时进行，否则大负载下双方的发送缓冲区都满了会互相等待
+class bench_connection {
+public:
+    bench_connection(boost::asio::io_context &io_context, const std::vector<char> &payload,
+                     std::size_t rounds, latency_histogram &latency)
+            : socket_(io_context), payload_(payload), received_(payload.size()),
+              remaining_(rounds), latency_(latency) {
+    }
+
+    void start(const tcp::endpoint &endpoint) {
+        socket_.async_connect(endpoint, [this](boost::system::error_code ec) {
+            if (ec) {
+                failed_ = true;
+                return;
+            }
+            socket_.set_option(tcp::no_delay(true));
+            do_round();
+        });
+    }
+
+    // 最后一轮的回显和负载完全一致并且中途没有出错
+    bool ok() const {
+        return !failed_ && remaining_ == 0 && received_ == payload_;
+    }
+
+    // 只统计最后rounds轮期间的operator new次数
+    void count_allocations(std::size_t rounds) {
+        count_from_ = rounds;
+    }
+
+    std::uint64_t allocations() const {
+        return allocations_end_ - allocations_start_;
+    }
+
+private:
+    void do_round() {
+        if (remaining_ == 0) {
+            socket_.close();
+            return;
+        }
+
+        pending_ = 2;
+        round_start_ = std::chrono::steady_clock::now();
+        boost::asio::async_write(socket_, boost::asio::buffer(payload_),
+                                 make_custom_alloc_handler(write_memory_,
+                                                           [this](boost::system::error_code ec, std::size_t) {
+                                                               on_complete(ec);
+                                                           }));
+        boost::asio::async_read(socket_, boost::asio::buffer(received_),
+                                make_custom_alloc_handler(read_memory_,
+                                                          [this](boost::system::error_code ec, std::size_t) {
+                                                              on_complete(ec);
+                                                          }));
+    }
+
+    void on_complete(boost::system::error_code ec) {
+        failed_ = failed_ || ec;
+        if (--pending_ > 0) {
+            return;
+        }
+        if (failed_) {
+            socket_.close();
+            return;
+        }
+
+        latency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - round_start_).count());
+        if (remaining_ == count_from_) {
+            allocations_start_ = g_allocations.load(std::memory_order_relaxed);
+        }
+        if (--remaining_ == 0) {
+            allocations_end_ = g_allocations.load(std::memory_order_relaxed);
+        }
+        do_round();
+    }
+
+    tcp::socket socket_;
+    const std::vector<char> &payload_;
+    std::vector<char> received_;
+    std::size_t remaining_;
+    latency_histogram &latency_;
+    int pending_ = 0;
+    bool failed_ = false;
+    std::chrono::steady_clock::time_point round_start_;
+    handler_memory read_memory_;
+    handler_memory write_memory_;
+    std::size_t count_from_ = 0;
+    std::uint64_t allocations_start_ = 0;
+    std::uint64_t allocations_end_ = 0;
+};
+
+bench_result run_case(echo_mode mode, std::size_t size, const bench_options &options) {
+    bench_result result;
+    bench_server server(mode, options.session, options.connections);
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), server.port());
+
+    std::vector<char> payload(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        payload[i] = static_cast<char>(i * 31);
+    }
+
+    // 总轮数平均分给各连接
+    std::size_t rounds = std::max(options.min_rounds, options.bytes / size);
+    std::size_t per_connection = std::max<std::size_t>(1, rounds / options.connections);
+
+    boost::asio::io_context io_context;
+    std::vector<std::unique_ptr<bench_connection>> connections;
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        connections.push_back(std::make_unique<bench_connection>(io_context, payload, per_connection,
+                                                                 result.latency));
+        connections.back()->start(endpoint);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    io_context.run();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.rounds = result.latency.count();
+
+    for (const auto &connection: connections) {
+        if (!connection->ok()) {
+            std::cerr << mode_name(mode) << " " << size << ": echo mismatch or connection error\n";
+            result.rounds = 0;
+            break;
+        }
+    }
+    return result;
+}
+
+// 单连接回显messages条64字节消息，返回预热之后的operator new次数；出错返回-1
+long long run_allocation_case(echo_mode mode, const bench_options &options) {
+    const std::size_t warmup = 1000;
+    bench_server server(mode, options.session, 1);
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), server.port());
+
+    std::vector<char> payload(64, 'a');
+    latency_histogram latency;
+    boost::asio::io_context io_context;
+    bench_connection connection(io_context, payload, warmup + options.count_allocations, latency);
+    connection.count_allocations(options.count_allocations);
+    connection.start(endpoint);
+    io_context.run();
+
+    if (!connection.ok()) {
+        return -1;
+    }
+    return static_cast<long long>(connection.allocations());
+}
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--modes"))) {
+            options.modes.clear();
+            std::stringstream ss(value);
+            std::string name;
+            while (std::getline(ss, name, ',')) {
+                echo_mode mode;
+                if (!parse_echo_mode(name.c_str(), mode)) {
+                    std::cerr << "Unknown mode: " << name << "\n";
+                    return false;
+                }
+                options.modes.push_back(mode);
+            }
+        } else if ((value = parse_option(arg, "--sizes"))) {
+            options.sizes.clear();
+            std::stringstream ss(value);
+            std::string size;
+            while (std::getline(ss, size, ',')) {
+                options.sizes.push_back(std::strtoul(size.c_str(), nullptr, 10));
+            }
+        } else if ((value = parse_option(arg, "--connections"))) {
+            options.connections = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--count-allocations"))) {
+            options.count_allocations = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--bytes"))) {
+            options.bytes = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--max-buffer"))) {
+            options.session.max_buffer = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--pipe-size"))) {
+            options.session.pipe_size = std::strtoul(value, nullptr, 10);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+
+    for (std::size_t size: options.sizes) {
+        if (size == 0) {
+            return false;
+        }
+    }
+    return !options.modes.empty() && !options.sizes.empty() && options.connections > 0;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        bench_options options;
+        if (!parse_options(argc, argv, options)) {
+            std::cerr << "Usage: echo_benchmark [--modes=fixed,adaptive,splice] [--sizes=1024,65536,1048576]"
+                         " [--connections=<n>] [--bytes=<bytes per case>] [--max-buffer=<bytes>]"
+                         " [--pipe-size=<bytes>] [--count-allocations=<messages>]\n";
+            return 1;
+        }
+
+        if (options.count_allocations > 0) {
+            std::cout << "mode      messages  allocations  per_message\n";
+            for (echo_mode mode: options.modes) {
+                long long allocations = run_allocation_case(mode, options);
+                if (allocations < 0) {
+                    std::cerr << mode_name(mode) << ": echo mismatch or connection error\n";
+                    continue;
+                }
+                char line[128];
+                std::snprintf(line, sizeof(line), "%-9s %8zu %12lld %12.4f\n", mode_name(mode),
+                              options.count_allocations, allocations,
+                              static_cast<double>(allocations) / options.count_allocations);
+                std::cout << line;
+            }
+            return 0;
+        }
+
+        std::cout << "connections=" << options.connections << "\n"
+                  << "mode      payload    rounds     MiB/s      p50_us      p99_us\n";
+        for (std::size_t size: options.sizes) {
+            for (echo_mode mode: options.modes) {
+                bench_result r = run_case(mode, size, options);
+                if (r.rounds == 0) {
+                    continue;
+                }
+
+                double mib = static_cast<double>(r.rounds) * size / (1024.0 * 1024.0);
+                char line[128];
+                std::snprintf(line, sizeof(line), "%-9s %8zu %9zu %9.1f %11.1f %11.1f\n",
+                              mode_name(mode), size, r.rounds, mib / r.seconds,
+                              r.latency.percentile(50.0) / 1000.0, r.latency.percentile(99.0) / 1000.0);
+                std::cout << line;
+            }
+        }
+    }
+    catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
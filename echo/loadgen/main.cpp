@@ -0,0 +1,351 @@
+// echo服务器负载生成器：
+// 在线程池中建立N个连接，每个请求是固定长度的负载，echo服务器按序原样返回，按字节数切分响应。
+//   closed: 每个连接同时只有一个请求在途，收到回显后立即发送下一个，并发度固定；
+//   open:   按固定的到达速率发送，不等待回显。延迟从计划发送时刻算起，
+//           服务器变慢时排队的时间也计入延迟，避免协调遗漏（coordinated omission）。
+// 往返时间记录到latency_histogram，输出p50/p99/p99.9/max和吞吐。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "public/bench_runner.h"
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+
+using boost::asio::ip::tcp;
+
+enum class load_mode {
+    closed,
+    open
+};
+
+struct load_options {
+    std::string host;
+    std::string port;
+    load_mode mode = load_mode::closed;
+    std::size_t connections = 16;
+    std::size_t threads = std::thread::hardware_concurrency();
+    double rate = 10000.0;      // open模式下所有连接合计每秒发送的请求数
+    std::size_t size = 64;      // 每个请求的字节数
+    int warmup = 2;             // 预热秒数，不计入统计
+    int duration = 10;          // 统计秒数
+    std::string output;         // JSON结果文件，为空时输出到stdout
+};
+
+// 每个线程一份，只在所属线程中修改
+struct load_worker {
+    boost::asio::io_context io_context;
+    latency_histogram latency;
+    std::uint64_t sent = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t errors = 0;
+};
+
+class load_client {
+public:
+    load_client(load_worker &worker, const load_options &options, std::size_t id,
+                std::atomic<std::size_t> &connected, const std::atomic<bench_phase> &phase)
+            : worker_(worker), options_(options), id_(id), connected_(connected), phase_(phase),
+              socket_(worker.io_context), timer_(worker.io_context),
+              payload_(options.size * max_batch, 'x'), read_buffer_(64 * 1024) {
+        if (options.mode == load_mode::open) {
+            double per_connection = options.rate / static_cast<double>(options.connections);
+            interval_ = std::chrono::duration_cast<bench_clock::duration>(
+                    std::chrono::duration<double>(1.0 / per_connection));
+        }
+    }
+
+    void connect(const tcp::resolver::results_type &endpoints) {
+        boost::asio::async_connect(socket_, endpoints,
+                                   [this](boost::system::error_code ec, const tcp::endpoint &) {
+                                       if (!ec) {
+                                           socket_.set_option(tcp::no_delay(true));
+                                           ++connected_;
+                                           do_read();
+                                       } else {
+                                           std::cerr << "connect failed: " << ec.message() << "\n";
+                                       }
+                                   });
+    }
+
+    void start() {
+        boost::asio::post(worker_.io_context, [this]() {
+            if (options_.mode == load_mode::closed) {
+                send(1, bench_clock::now());
+                return;
+            }
+
+            // 随机错开各连接的首次发送，避免所有连接同时突发
+            std::mt19937_64 rng(id_);
+            std::uniform_int_distribution<bench_clock::rep> offset(0, interval_.count());
+            next_send_ = bench_clock::now() + bench_clock::duration(offset(rng));
+            do_wait();
+        });
+    }
+
+private:
+    enum {
+        max_batch = 64  // 一次写出的最大请求数
+    };
+
+    bool measuring() const {
+        return phase_.load(std::memory_order_relaxed) == bench_phase::measuring;
+    }
+
+    bool done() const {
+        return phase_.load(std::memory_order_relaxed) == bench_phase::done;
+    }
+
+    // open模式：把已经到期的请求一起发出，每个请求以计划时刻作为发送时间
+    void do_wait() {
+        timer_.expires_at(next_send_);
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec || done() || closed_) {
+                return;
+            }
+
+            auto now = bench_clock::now();
+            while (next_send_ <= now) {
+                intended_.push_back(next_send_);
+                next_send_ += interval_;
+                ++unsent_;
+            }
+            flush();
+            do_wait();
+        });
+    }
+
+    void send(std::size_t count, bench_clock::time_point at) {
+        for (std::size_t i = 0; i < count; ++i) {
+            intended_.push_back(at);
+        }
+        unsent_ += count;
+        flush();
+    }
+
+    void flush() {
+        if (writing_ || unsent_ == 0) {
+            return;
+        }
+
+        std::size_t batch = std::min<std::size_t>(unsent_, max_batch);
+        if (measuring()) {
+            worker_.sent += batch;
+        }
+        unsent_ -= batch;
+        writing_ = true;
+        boost::asio::async_write(socket_, boost::asio::buffer(payload_.data(), batch * options_.size),
+                                 [this](boost::system::error_code ec, std::size_t /*length*/) {
+                                     writing_ = false;
+                                     if (ec) {
+                                         fail();
+                                         return;
+                                     }
+                                     flush();
+                                 });
+    }
+
+    void do_read() {
+        socket_.async_read_some(boost::asio::buffer(read_buffer_),
+                                [this](boost::system::error_code ec, std::size_t length) {
+                                    if (ec) {
+                                        fail();
+                                        return;
+                                    }
+
+                                    on_bytes(length);
+                                    do_read();
+                                });
+    }
+
+    // echo按序返回，每收满size字节就完成最早的一个请求
+    void on_bytes(std::size_t length) {
+        partial_ += length;
+        auto now = bench_clock::now();
+        std::size_t completed = 0;
+        while (partial_ >= options_.size && !intended_.empty()) {
+            partial_ -= options_.size;
+            if (measuring()) {
+                ++worker_.completed;
+                worker_.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - intended_.front()).count());
+            }
+            intended_.pop_front();
+            ++completed;
+        }
+
+        if (options_.mode == load_mode::closed && completed > 0 && !done()) {
+            send(completed, now);
+        }
+    }
+
+    void fail() {
+        if (!closed_ && !done()) {
+            ++worker_.errors;
+        }
+        closed_ = true;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        timer_.cancel();
+    }
+
+    load_worker &worker_;
+    const load_options &options_;
+    std::size_t id_;
+    std::atomic<std::size_t> &connected_;
+    const std::atomic<bench_phase> &phase_;
+
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    bench_clock::duration interval_{};
+    bench_clock::time_point next_send_;
+
+    std::vector<char> payload_;
+    std::vector<char> read_buffer_;
+    std::deque<bench_clock::time_point> intended_;  // 在途请求的计划发送时刻，按发送顺序
+    std::size_t unsent_ = 0;
+    std::size_t partial_ = 0;
+    bool writing_ = false;
+    bool closed_ = false;
+};
+
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], load_options &options) {
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--mode"))) {
+            if (std::strcmp(value, "closed") == 0) {
+                options.mode = load_mode::closed;
+            } else if (std::strcmp(value, "open") == 0) {
+                options.mode = load_mode::open;
+            } else {
+                std::cerr << "Unknown mode: " << value << "\n";
+                return false;
+            }
+        } else if ((value = parse_option(arg, "--connections"))) {
+            options.connections = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--threads"))) {
+            options.threads = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--rate"))) {
+            options.rate = std::strtod(value, nullptr);
+        } else if ((value = parse_option(arg, "--size"))) {
+            options.size = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--warmup"))) {
+            options.warmup = std::atoi(value);
+        } else if ((value = parse_option(arg, "--duration"))) {
+            options.duration = std::atoi(value);
+        } else if ((value = parse_option(arg, "--output"))) {
+            options.output = value;
+        } else if (std::strncmp(arg, "--", 2) == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        } else if (positional == 0) {
+            options.host = arg;
+            ++positional;
+        } else if (positional == 1) {
+            options.port = arg;
+            ++positional;
+        } else {
+            return false;
+        }
+    }
+
+    if (options.threads == 0) {
+        options.threads = 1;
+    }
+    return positional == 2 && options.connections > 0 && options.size > 0 && options.rate > 0;
+}
+
+void write_json(std::ostream &os, const load_options &options, const load_worker &total, double elapsed) {
+    os << "{\n"
+       << "  \"mode\": \"" << (options.mode == load_mode::closed ? "closed" : "open") << "\",\n"
+       << "  \"connections\": " << options.connections << ",\n"
+       << "  \"threads\": " << options.threads << ",\n"
+       << "  \"target_rate\": " << (options.mode == load_mode::open ? options.rate : 0.0) << ",\n"
+       << "  \"size\": " << options.size << ",\n"
+       << "  \"duration_s\": " << elapsed << ",\n"
+       << "  \"sent\": " << total.sent << ",\n"
+       << "  \"completed\": " << total.completed << ",\n"
+       << "  \"errors\": " << total.errors << ",\n"
+       << "  \"requests_per_sec\": " << static_cast<double>(total.completed) / elapsed << ",\n";
+    write_latency_json(os, "latency_us", total.latency, true);
+    os << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        load_options options;
+        if (!parse_options(argc, argv, options)) {
+            std::cerr << "Usage: echo_loadgen <host> <port> [--mode=closed|open] [--connections=<n>]"
+                         " [--threads=<n>] [--rate=<requests/s, open mode>] [--size=<bytes>]"
+                         " [--warmup=<seconds>] [--duration=<seconds>] [--output=<json file>]\n";
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<load_worker>> workers;
+        for (std::size_t i = 0; i < options.threads; ++i) {
+            workers.push_back(std::make_unique<load_worker>());
+        }
+
+        std::atomic<std::size_t> connected{0};
+        std::atomic<bench_phase> phase{bench_phase::connecting};
+
+        tcp::resolver resolver(workers.front()->io_context);
+        auto endpoints = resolver.resolve(options.host, options.port);
+
+        std::vector<std::unique_ptr<load_client>> clients;
+        for (std::size_t i = 0; i < options.connections; ++i) {
+            auto &worker = *workers[i % workers.size()];
+            clients.push_back(std::make_unique<load_client>(worker, options, i, connected, phase));
+            clients.back()->connect(endpoints);
+        }
+
+        std::vector<std::thread> threads = start_bench_threads(workers);
+        wait_bench_connected(connected, options.connections);
+
+        for (auto &client: clients) {
+            client->start();
+        }
+        double elapsed = run_bench_phases(phase, options.warmup, options.duration);
+        stop_bench_threads(workers, threads);
+
+        load_worker total;
+        for (auto &worker: workers) {
+            total.latency.merge(worker->latency);
+            total.sent += worker->sent;
+            total.completed += worker->completed;
+            total.errors += worker->errors;
+        }
+
+        const latency_histogram &h = total.latency;
+        std::cerr << "requests/s=" << static_cast<double>(total.completed) / elapsed
+                  << " p50=" << h.percentile(50.0) / 1000.0 << "us"
+                  << " p99=" << h.percentile(99.0) / 1000.0 << "us"
+                  << " p99.9=" << h.percentile(99.9) / 1000.0 << "us"
+                  << " max=" << h.max() / 1000.0 << "us\n";
+
+        write_bench_output(options.output, [&](std::ostream &os) { write_json(os, options, total, elapsed); });
+    }
+    catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,595 @@
+//
+// echo服务器的会话实现，服务器和压测程序共用。
+// echo_session是官方示例中的固定1KiB缓冲区、读写严格交替的版本；
+// adaptive_echo_session根据每次读到的字节数调整接收缓冲区大小，并用双缓冲让下一次读和正在进行的写重叠；
+// splice_echo_session（仅Linux）用splice()经过管道把数据从接收队列直接搬到发送队列，不经过用户态缓冲区。
+// 各会话的异步操作都使用会话自带的handler_memory，稳态读写循环中不分配内存。
+//
+
+#ifndef TEST_ASIO_ECHO_SESSION_H
+#define TEST_ASIO_ECHO_SESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/version.hpp>
+
+#include "public/handler_allocator.h"
+
+// io_uring后端（CMake选项TEST_ASIO_IO_URING）下，固定缓冲区会话从注册缓冲区读取
+#if defined(BOOST_ASIO_HAS_IO_URING) && BOOST_VERSION >= 107800
+#define TEST_ASIO_ECHO_REGISTERED_BUFFERS 1
+#endif
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+enum class echo_mode
+{
+	fixed,
+	adaptive,
+	splice
+};
+
+struct echo_options
+{
+	std::size_t min_buffer = 1024;
+	std::size_t max_buffer = 256 * 1024;
+	std::size_t pipe_size = 1024 * 1024;    // splice模式的管道容量，内核可能调整
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+	// 会话共同持有，保证注册缓冲区在最后一个会话销毁之后才注销
+	std::shared_ptr<class echo_buffer_pool> buffer_pool;
+#endif
+	bool report = false;        // 会话结束时输出字节数和吞吐
+};
+
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+
+// 一次性向io_uring注册的固定大小缓冲区，读操作走IORING_OP_READ_FIXED，内核不必每次重新映射用户页。
+// 非线程安全，和会话在同一个io_context线程中使用；用完时会话退回到自己的缓冲区
+class echo_buffer_pool
+{
+public:
+	echo_buffer_pool(boost::asio::io_context& io_context, std::size_t count, std::size_t size)
+		: storage_(count * size), buffers_(make_buffers(storage_, count, size)),
+		registration_(boost::asio::register_buffers(io_context, buffers_))
+	{
+		free_.reserve(count);
+		for (std::size_t i = count; i > 0; --i)
+		{
+			free_.push_back(static_cast<int>(i - 1));
+		}
+	}
+
+	// 没有空闲缓冲区时返回-1
+	int acquire()
+	{
+		if (free_.empty())
+		{
+			return -1;
+		}
+		int index = free_.back();
+		free_.pop_back();
+		return index;
+	}
+
+	void release(int index)
+	{
+		free_.push_back(index);
+	}
+
+	boost::asio::mutable_registered_buffer buffer(int index) const
+	{
+		return registration_[static_cast<std::size_t>(index)];
+	}
+
+private:
+	static std::vector<boost::asio::mutable_buffer> make_buffers(std::vector<char>& storage,
+		std::size_t count, std::size_t size)
+	{
+		std::vector<boost::asio::mutable_buffer> buffers;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			buffers.push_back(boost::asio::buffer(storage.data() + i * size, size));
+		}
+		return buffers;
+	}
+
+	std::vector<char> storage_;
+	std::vector<boost::asio::mutable_buffer> buffers_;
+	boost::asio::buffer_registration<std::vector<boost::asio::mutable_buffer>> registration_;
+	std::vector<int> free_;
+};
+
+#endif
+
+// 每个会话的吞吐统计，会话析构时按需输出
+class echo_session_stats
+{
+public:
+	echo_session_stats(const char* mode, const boost::asio::ip::tcp::socket& socket, bool report)
+		: mode_(mode), report_(report), start_(std::chrono::steady_clock::now())
+	{
+		boost::system::error_code ec;
+		auto endpoint = socket.remote_endpoint(ec);
+		if (!ec)
+		{
+			peer_ = endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+		}
+	}
+
+	~echo_session_stats()
+	{
+		if (!report_)
+		{
+			return;
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+		std::cout << "session " << peer_ << " mode=" << mode_
+			<< " bytes=" << bytes_
+			<< " reads=" << reads_
+			<< " seconds=" << seconds
+			<< " MiB/s=" << (seconds > 0 ? static_cast<double>(bytes_) / seconds / (1024 * 1024) : 0.0)
+			<< " buffer=" << min_buffer_ << ".." << max_buffer_
+			<< std::endl;
+	}
+
+	void on_read(std::size_t length, std::size_t buffer_size)
+	{
+		bytes_ += length;
+		++reads_;
+		if (min_buffer_ == 0 || buffer_size < min_buffer_)
+		{
+			min_buffer_ = buffer_size;
+		}
+		if (buffer_size > max_buffer_)
+		{
+			max_buffer_ = buffer_size;
+		}
+	}
+
+	std::uint64_t bytes() const
+	{
+		return bytes_;
+	}
+
+private:
+	const char* mode_;
+	bool report_;
+	std::string peer_;
+	std::chrono::steady_clock::time_point start_;
+	std::uint64_t bytes_ = 0;
+	std::uint64_t reads_ = 0;
+	std::size_t min_buffer_ = 0;
+	std::size_t max_buffer_ = 0;
+};
+
+class echo_session
+	: public std::enable_shared_from_this<echo_session>
+{
+public:
+	enum
+	{
+		max_length = 1024
+	};
+
+	echo_session(boost::asio::ip::tcp::socket socket, const echo_options& options)
+		: socket_(std::move(socket)), stats_("fixed", socket_, options.report)
+	{
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+		pool_ = options.buffer_pool;
+		slot_ = pool_ != nullptr ? pool_->acquire() : -1;
+#endif
+	}
+
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+	~echo_session()
+	{
+		if (slot_ >= 0)
+		{
+			pool_->release(slot_);
+		}
+	}
+#endif
+
+	void start()
+	{
+		do_read();
+	}
+
+private:
+	void do_read()
+	{
+		auto self(shared_from_this());
+		auto handler = make_custom_alloc_handler(handler_memory_,
+			[this, self](boost::system::error_code ec, std::size_t length)
+			{
+				if (!ec)
+				{
+					stats_.on_read(length, max_length);
+					do_write(length);
+				}
+			});
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+		if (slot_ >= 0)
+		{
+			socket_.async_read_some(pool_->buffer(slot_), std::move(handler));
+			return;
+		}
+#endif
+		socket_.async_read_some(boost::asio::buffer(data_, max_length), std::move(handler));
+	}
+
+	char* data()
+	{
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+		if (slot_ >= 0)
+		{
+			return static_cast<char*>(pool_->buffer(slot_).data());
+		}
+#endif
+		return data_;
+	}
+
+	void do_write(std::size_t length)
+	{
+		auto self(shared_from_this());
+		boost::asio::async_write(socket_, boost::asio::buffer(data(), length),
+			make_custom_alloc_handler(handler_memory_,
+				[this, self](boost::system::error_code ec, std::size_t /*length*/)
+				{
+					if (!ec)
+					{
+						do_read();
+					}
+				}));
+	}
+
+	boost::asio::ip::tcp::socket socket_;
+	echo_session_stats stats_;
+	// 读和写严格交替，共用一块
+	handler_memory handler_memory_;
+	char data_[max_length] = { 0 };
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+	std::shared_ptr<echo_buffer_pool> pool_;
+	int slot_ = -1;
+#endif
+};
+
+// 两块缓冲区轮流使用：一块正在写回对端时，另一块已经在接收下一段数据。
+// 两块都被占用（一块在写，一块已读满等待写）时暂停读，形成背压。
+// 缓冲区大小按读到的字节数调整：读满则翻倍，连续两次不足四分之一则减半，范围[min_buffer, max_buffer]。
+class adaptive_echo_session
+	: public std::enable_shared_from_this<adaptive_echo_session>
+{
+public:
+	adaptive_echo_session(boost::asio::ip::tcp::socket socket, const echo_options& options)
+		: socket_(std::move(socket)),
+		min_buffer_(options.min_buffer),
+		max_buffer_(options.max_buffer < options.min_buffer ? options.min_buffer : options.max_buffer),
+		target_size_(min_buffer_),
+		stats_("adaptive", socket_, options.report)
+	{
+	}
+
+	void start()
+	{
+		do_read(0);
+	}
+
+private:
+	void do_read(int index)
+	{
+		std::vector<char>& buffer = buffers_[index];
+		if (buffer.size() != target_size_)
+		{
+			// 缩小时释放多余的内存，空闲连接不会一直占着大缓冲区
+			std::vector<char>(target_size_).swap(buffer);
+		}
+
+		auto self(shared_from_this());
+		socket_.async_read_some(boost::asio::buffer(buffer),
+			make_custom_alloc_handler(read_memory_,
+				[this, self, index](boost::system::error_code ec, std::size_t length)
+				{
+					if (ec)
+					{
+						closed_ = true;
+						return;
+					}
+
+					stats_.on_read(length, buffers_[index].size());
+					adapt(length, buffers_[index].size());
+
+					if (!writing_)
+					{
+						do_write(index, length);
+						do_read(1 - index);
+					}
+					else
+					{
+						pending_index_ = index;
+						pending_length_ = length;
+					}
+				}));
+	}
+
+	void do_write(int index, std::size_t length)
+	{
+		writing_ = true;
+		auto self(shared_from_this());
+		boost::asio::async_write(socket_, boost::asio::buffer(buffers_[index].data(), length),
+			make_custom_alloc_handler(write_memory_,
+				[this, self, index](boost::system::error_code ec, std::size_t /*length*/)
+				{
+					writing_ = false;
+					if (ec)
+					{
+						closed_ = true;
+						boost::system::error_code ignored;
+						socket_.close(ignored);
+						return;
+					}
+
+					if (pending_index_ >= 0)
+					{
+						int pending = pending_index_;
+						pending_index_ = -1;
+						do_write(pending, pending_length_);
+						if (!closed_)
+						{
+							do_read(index);
+						}
+					}
+				}));
+	}
+
+	void adapt(std::size_t length, std::size_t capacity)
+	{
+		if (length == capacity)
+		{
+			small_reads_ = 0;
+			if (target_size_ < max_buffer_)
+			{
+				target_size_ = target_size_ * 2 < max_buffer_ ? target_size_ * 2 : max_buffer_;
+			}
+		}
+		else if (length < capacity / 4)
+		{
+			if (++small_reads_ >= 2 && target_size_ > min_buffer_)
+			{
+				target_size_ = target_size_ / 2 > min_buffer_ ? target_size_ / 2 : min_buffer_;
+				small_reads_ = 0;
+			}
+		}
+		else
+		{
+			small_reads_ = 0;
+		}
+	}
+
+	boost::asio::ip::tcp::socket socket_;
+	std::size_t min_buffer_;
+	std::size_t max_buffer_;
+	std::size_t target_size_;
+	std::size_t small_reads_ = 0;
+
+	std::vector<char> buffers_[2];
+	bool writing_ = false;
+	bool closed_ = false;
+	int pending_index_ = -1;
+	std::size_t pending_length_ = 0;
+
+	// 读和写会同时挂起，各用一块
+	handler_memory read_memory_;
+	handler_memory write_memory_;
+
+	echo_session_stats stats_;
+};
+
+#if defined(__linux__)
+
+// socket -> pipe -> socket，数据只在内核中移动。
+// splice需要非阻塞的socket，读写就绪由async_wait驱动；管道满时暂停读，管道空时暂停写。
+class splice_echo_session
+	: public std::enable_shared_from_this<splice_echo_session>
+{
+public:
+	splice_echo_session(boost::asio::ip::tcp::socket socket, const echo_options& options)
+		: socket_(std::move(socket)), stats_("splice", socket_, options.report)
+	{
+		int fds[2];
+		if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), "pipe2");
+		}
+		pipe_read_ = fds[0];
+		pipe_write_ = fds[1];
+
+		// 调大失败时沿用默认容量
+		fcntl(pipe_write_, F_SETPIPE_SZ, static_cast<int>(options.pipe_size));
+		int capacity = fcntl(pipe_write_, F_GETPIPE_SZ);
+		pipe_capacity_ = capacity > 0 ? static_cast<std::size_t>(capacity) : 64 * 1024;
+
+		socket_.native_non_blocking(true);
+	}
+
+	~splice_echo_session()
+	{
+		close(pipe_read_);
+		close(pipe_write_);
+	}
+
+	void start()
+	{
+		pump();
+	}
+
+private:
+	void pump()
+	{
+		if (closed_)
+		{
+			return;
+		}
+
+		int fd = socket_.native_handle();
+		for (;;)
+		{
+			bool progress = false;
+
+			if (in_pipe_ > 0 && !waiting_write_)
+			{
+				ssize_t n = splice(pipe_read_, nullptr, fd, nullptr, in_pipe_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (n > 0)
+				{
+					in_pipe_ -= static_cast<std::size_t>(n);
+					progress = true;
+				}
+				else if (n < 0 && errno == EAGAIN)
+				{
+					wait(boost::asio::ip::tcp::socket::wait_write, waiting_write_);
+				}
+				else if (n < 0 && errno != EINTR)
+				{
+					return stop();
+				}
+			}
+
+			if (eof_ && in_pipe_ == 0)
+			{
+				return stop();
+			}
+
+			if (!eof_ && in_pipe_ < pipe_capacity_ && !waiting_read_)
+			{
+				ssize_t n = splice(fd, nullptr, pipe_write_, nullptr, pipe_capacity_ - in_pipe_,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (n > 0)
+				{
+					in_pipe_ += static_cast<std::size_t>(n);
+					stats_.on_read(static_cast<std::size_t>(n), pipe_capacity_);
+					progress = true;
+				}
+				else if (n == 0)
+				{
+					eof_ = true;
+					progress = true;
+				}
+				else if (errno == EAGAIN)
+				{
+					// 管道按段占用缓冲槽，in_pipe_未到容量时也可能已满；此时套接字仍然可读，
+					// 等待可读会立即完成而空转。写方向被阻塞时只等可写，写出后pump会再次读取
+					if (!waiting_write_)
+					{
+						wait(boost::asio::ip::tcp::socket::wait_read, waiting_read_);
+					}
+				}
+				else if (errno != EINTR)
+				{
+					return stop();
+				}
+			}
+
+			if (!progress)
+			{
+				return;
+			}
+		}
+	}
+
+	void wait(boost::asio::ip::tcp::socket::wait_type type, bool& waiting)
+	{
+		waiting = true;
+		auto self(shared_from_this());
+		handler_memory& memory = type == boost::asio::ip::tcp::socket::wait_read ? read_memory_ : write_memory_;
+		socket_.async_wait(type,
+			make_custom_alloc_handler(memory,
+				[this, self, &waiting](boost::system::error_code ec)
+				{
+					waiting = false;
+					if (ec)
+					{
+						return stop();
+					}
+					pump();
+				}));
+	}
+
+	void stop()
+	{
+		if (!closed_)
+		{
+			closed_ = true;
+			boost::system::error_code ignored;
+			socket_.close(ignored);
+		}
+	}
+
+	boost::asio::ip::tcp::socket socket_;
+	int pipe_read_ = -1;
+	int pipe_write_ = -1;
+	std::size_t pipe_capacity_ = 0;
+	std::size_t in_pipe_ = 0;
+	bool waiting_read_ = false;
+	bool waiting_write_ = false;
+	bool eof_ = false;
+	bool closed_ = false;
+
+	handler_memory read_memory_;
+	handler_memory write_memory_;
+
+	echo_session_stats stats_;
+};
+
+#endif
+
+// 按模式创建并启动会话，当前平台不支持splice时返回false
+inline bool start_echo_session(echo_mode mode, boost::asio::ip::tcp::socket socket, const echo_options& options)
+{
+	switch (mode)
+	{
+	case echo_mode::fixed:
+		std::make_shared<echo_session>(std::move(socket), options)->start();
+		return true;
+	case echo_mode::adaptive:
+		std::make_shared<adaptive_echo_session>(std::move(socket), options)->start();
+		return true;
+	case echo_mode::splice:
+#if defined(__linux__)
+		std::make_shared<splice_echo_session>(std::move(socket), options)->start();
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+// 解析"fixed"/"adaptive"/"splice"
+inline bool parse_echo_mode(const char* name, echo_mode& mode)
+{
+	static const char* const names[] = { "fixed", "adaptive", "splice" };
+	for (int i = 0; i < 3; ++i)
+	{
+		if (std::strcmp(name, names[i]) == 0)
+		{
+			mode = static_cast<echo_mode>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif //TEST_ASIO_ECHO_SESSION_H
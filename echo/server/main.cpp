@@ -1,68 +1,25 @@
 // https://www.boost.org/doc/libs/1_71_0/doc/html/boost_asio/example/cpp11/echo/async_tcp_echo_server.cpp
 
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <utility>
 #include <boost/asio.hpp>
 
-using boost::asio::ip::tcp;
-
-class session
-	: public std::enable_shared_from_this<session>
-{
-public:
-	explicit session(tcp::socket socket)
-		: socket_(std::move(socket))
-	{
-	}
-
-	void start()
-	{
-		do_read();
-	}
-
-private:
-	void do_read()
-	{
-		auto self(shared_from_this());
-		socket_.async_read_some(boost::asio::buffer(data_, max_length),
-			[this, self](boost::system::error_code ec, std::size_t length)
-			{
-				if (!ec)
-				{
-					do_write(length);
-				}
-			});
-	}
+#include "echo/public/echo_session.h"
+#include "public/command_line.h"
+#include "public/event_tracer.h"
+#include "public/metrics_exporter.h"
 
-	void do_write(std::size_t length)
-	{
-		auto self(shared_from_this());
-		boost::asio::async_write(socket_, boost::asio::buffer(data_, length),
-			[this, self](boost::system::error_code ec, std::size_t /*length*/)
-			{
-				if (!ec)
-				{
-					do_read();
-				}
-			});
-	}
-
-	enum
-	{
-		max_length = 1024
-	};
-
-	tcp::socket socket_;
-	char data_[max_length] = { 0 };
-};
+using boost::asio::ip::tcp;
 
 class server
 {
 public:
-	server(boost::asio::io_context& io_context, short port)
-		: acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
+	server(boost::asio::io_context& io_context, short port, echo_mode mode, const echo_options& options)
+		: acceptor_(io_context, tcp::endpoint(tcp::v4(), port)), mode_(mode), options_(options)
 	{
 		do_accept();
 	}
@@ -75,7 +32,7 @@ private:
 			{
 				if (!ec)
 				{
-					std::make_shared<session>(std::move(socket))->start();
+					start_echo_session(mode_, std::move(socket), options_);
 				}
 
 				do_accept();
@@ -83,21 +40,149 @@ private:
 	}
 
 	tcp::acceptor acceptor_;
+	echo_mode mode_;
+	echo_options options_;
 };
 
 int main(int argc, char* argv[])
 {
 	try
 	{
-		if (argc != 2)
+		echo_mode mode = echo_mode::fixed;
+		echo_options options;
+		metrics_exporter::options metrics;
+		std::string trace_file;
+		std::size_t trace_events = 65536;
+		int first = 1;
+		for (; first < argc && std::strncmp(argv[first], "--", 2) == 0; ++first)
 		{
-			std::cerr << "Usage: async_tcp_echo_server <port>\n";
+			const char* arg = argv[first];
+			const char* value = nullptr;
+			if (std::strcmp(arg, "--adaptive") == 0)
+			{
+				mode = echo_mode::adaptive;
+			}
+			else if ((value = parse_option(arg, "--mode")))
+			{
+				if (!parse_echo_mode(value, mode))
+				{
+					std::cerr << "Unknown mode: " << value << "\n";
+					return 1;
+				}
+			}
+			else if ((value = parse_option(arg, "--pipe-size")))
+			{
+				options.pipe_size = std::strtoul(value, nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--report") == 0)
+			{
+				options.report = true;
+			}
+			else if ((value = parse_option(arg, "--min-buffer")))
+			{
+				options.min_buffer = std::strtoul(value, nullptr, 10);
+			}
+			else if ((value = parse_option(arg, "--max-buffer")))
+			{
+				options.max_buffer = std::strtoul(value, nullptr, 10);
+			}
+			else if ((value = parse_option(arg, "--metrics-file")))
+			{
+				metrics.file = value;
+			}
+			else if ((value = parse_option(arg, "--metrics-port")))
+			{
+				metrics.port = static_cast<unsigned short>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--metrics-interval")))
+			{
+				metrics.interval = std::chrono::seconds(std::atoi(value));
+			}
+			else if (std::strcmp(arg, "--metrics-scheduling-delay") == 0)
+			{
+				handler_metrics::set_scheduling_delay_enabled(true);
+			}
+			else if ((value = parse_option(arg, "--trace-file")))
+			{
+				trace_file = value;
+			}
+			else if ((value = parse_option(arg, "--trace-events")))
+			{
+				trace_events = std::strtoul(value, nullptr, 10);
+			}
+			else
+			{
+				std::cerr << "Unknown option: " << arg << "\n";
+				return 1;
+			}
+		}
+
+		if (argc - first != 1 || options.min_buffer == 0 || metrics.interval.count() <= 0)
+		{
+			std::cerr << "Usage: async_tcp_echo_server [--mode=fixed|adaptive|splice] [--adaptive]"
+				" [--min-buffer=<bytes>] [--max-buffer=<bytes>] [--pipe-size=<bytes>] [--report]"
+				" [--metrics-file=<path>] [--metrics-port=<port>] [--metrics-interval=<seconds>]"
+				" [--metrics-scheduling-delay]"
+				" [--trace-file=<path>] [--trace-events=<per thread>] <port>\n";
 			return 1;
 		}
 
 		boost::asio::io_context io_context;
 
-		server s(io_context, std::atoi(argv[1]));
+#if !defined(__linux__)
+		if (mode == echo_mode::splice)
+		{
+			std::cerr << "splice mode is only available on Linux\n";
+			return 1;
+		}
+#endif
+
+#if defined(TEST_ASIO_ECHO_REGISTERED_BUFFERS)
+		if (mode == echo_mode::fixed)
+		{
+			options.buffer_pool = std::make_shared<echo_buffer_pool>(io_context, 4096, echo_session::max_length);
+		}
+#endif
+
+		server s(io_context, std::atoi(argv[first]), mode, options);
+
+		// handler_metrics需要用TEST_ASIO_HANDLER_METRICS编译，否则导出的计数为0
+		std::unique_ptr<metrics_exporter> exporter;
+		if (!metrics.file.empty() || metrics.port != 0)
+		{
+			handler_metrics::set_thread_name("echo_server");
+			exporter = std::make_unique<metrics_exporter>(io_context, metrics);
+		}
+
+		// handler的生命周期事件需要用TEST_ASIO_HANDLER_TRACE编译。收到SIGINT/SIGTERM时写出跟踪文件并退出
+		boost::asio::signal_set signals(io_context);
+		if (!trace_file.empty() || !metrics.file.empty())
+		{
+			if (!trace_file.empty())
+			{
+				event_tracer::set_thread_name("echo_server");
+				event_tracer::enable(trace_events);
+			}
+
+			signals.add(SIGINT);
+			signals.add(SIGTERM);
+			signals.async_wait([&](boost::system::error_code ec, int)
+			{
+				if (ec)
+				{
+					return;
+				}
+				if (!trace_file.empty() && !event_tracer::write_chrome_trace(trace_file))
+				{
+					std::cerr << "Failed to write " << trace_file << "\n";
+				}
+				if (exporter && !metrics.file.empty())
+				{
+					exporter->write_file();
+				}
+				io_context.stop();
+			});
+		}
 
 		io_context.run();
 	}
@@ -7,6 +7,9 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include "public/event_tracer.h"
+#include "public/handler_metrics.h"
+
 namespace asio = boost::asio;
 
 template<typename T>
@@ -53,10 +56,15 @@ public:
 
 	void run()
 	{
-		for(auto& ctx : _contexts)
+		for (std::size_t i = 0; i < _contexts.size(); ++i)
 		{
-			ctx->thread = std::make_shared<thread_t>([&]
+			auto& ctx = _contexts[i];
+			ctx->thread = std::make_shared<thread_t>([&ctx, i]
 			{
+				// 每个线程运行一个io_context，线程名即handler_metrics中该io_context的标签
+				std::string name = "io_context_pool-" + std::to_string(i);
+				handler_metrics::set_thread_name(name);
+				event_tracer::set_thread_name(name);
 				ctx->context->run();
 			});
 		}
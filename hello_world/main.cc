@@ -2,12 +2,19 @@
 #include <boost/thread.hpp>
 #include <boost/date_time.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <cstdlib>
+#include <functional>
 #include <ctime>
+#include <vector>
 
 #include "context_pool.h"
+#include "session.h"
+#include "public/periodic_timer.h"
+#include "public/priority_scheduler.h"
 
 namespace asio = boost::asio;
 using error_code = boost::system::error_code;
@@ -228,7 +235,8 @@ void test_single_context_multi_thread_with_strand()
 	{
 		if (rand() % 2 == 0)
 		{
-			ctx.post(strand.wrap(workFuncStrand));
+			// strand.wrap已弃用，改为绑定执行器，由asio::post按关联执行器投递到strand
+			asio::post(ctx, asio::bind_executor(strand, workFuncStrand));
 		}
 		else
 		{
@@ -250,32 +258,42 @@ void test_single_context_multi_thread_with_strand()
 	workers.join_all();
 }
 
-void async_wait(asio::high_resolution_timer& timer, std::chrono::high_resolution_clock::time_point& lastTime)
+// 周期回调注册到io_context共享的periodic_timer_service，相同周期的回调共用一个定时器，
+// 不再为每个回调单独持有定时器并在handler里递归重新等待
+void test_high_resolution_timer()
 {
-	timer.expires_after(std::chrono::seconds(1));
+	asio::io_context ctx;
+	auto& timers = asio::use_service<periodic_timer_service>(ctx);
 
-	timer.async_wait([&](error_code ec)
+	struct ticker_state
 	{
-		if (ec == asio::error::operation_aborted)
+		const char* name;
+		std::chrono::high_resolution_clock::time_point lastTime;
+		int remaining;
+		periodic_timer_service* timers;
+		periodic_timer_service::ticker ticker;
+
+		void tick()
 		{
-			return;
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now() - lastTime).count();
+			lastTime = now();
+			std::cout << name << " " << elapsed << "ms\n";
+			if (--remaining == 0)
+			{
+				timers->cancel(ticker);
+			}
 		}
-		auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now() - lastTime).count();
-		lastTime = now();
-		std::cout << elapsed << "\n";
-		async_wait(timer, lastTime);
-	});
-}
-
-void test_high_resolution_timer()
-{
-	asio::io_context ctx;
-
-	asio::high_resolution_timer timer(ctx);
-	auto lastTime = now();
+	};
 
-	async_wait(timer, lastTime);
+	ticker_state a{ "a", now(), 5, &timers, {} };
+	ticker_state b{ "b", now(), 5, &timers, {} };
+	ticker_state c{ "c", now(), 3, &timers, {} };
+	a.ticker = timers.add<ticker_state, &ticker_state::tick>(std::chrono::seconds(1), &a);
+	b.ticker = timers.add<ticker_state, &ticker_state::tick>(std::chrono::seconds(1), &b);
+	c.ticker = timers.add<ticker_state, &ticker_state::tick>(std::chrono::milliseconds(1500), &c);
+	std::cout << "buckets: " << timers.bucket_count() << " tickers: " << timers.size() << "\n";
 
+	// 全部取消后桶的定时器不再等待，run()返回
 	ctx.run();
 }
 
@@ -291,18 +309,187 @@ void test_simple_udp_server()
 {
 	std::uint16_t port = 15001;
 	asio::io_context ctx;
-	asio::ip::udp::socket socket(ctx);
 	asio::ip::udp::endpoint endpoint(asio::ip::udp::v4(), port);
+	// 用endpoint构造时会open并bind，否则receive_from在未打开的socket上直接失败
+	asio::ip::udp::socket socket(ctx, endpoint);
 
+	// 接收缓冲区放在堆上并在循环外分配一次，64KiB的栈数组在小栈线程上容易溢出
+	std::vector<char> buffer(65536);
+	boost::asio::ip::udp::endpoint sender;
 	for(;;)
 	{
-		char buffer[65536];
-		boost::asio::ip::udp::endpoint sender;
 		std::size_t bytes_transferred = socket.receive_from(boost::asio::buffer(buffer), sender);
-		socket.send_to(boost::asio::buffer(buffer, bytes_transferred), sender);
+		socket.send_to(boost::asio::buffer(buffer.data(), bytes_transferred), sender);
 	}
 };
 
+// 全双工会话压测：客户端同时持续发送和接收，统计双向吞吐。
+// chunks=1时会话读完一块必须等它写回才能读下一块，读写不重叠；chunks=8时读写在两个strand上同时进行，双向吞吐应接近前者的2倍
+void test_full_duplex_session()
+{
+	const std::size_t chunk_size = 64 * 1024;
+	const auto duration = std::chrono::seconds(2);
+
+	for (std::size_t chunks : { 1, 8 })
+	{
+		asio::io_context server_ctx;
+		auto guard = asio::make_work_guard(server_ctx);
+		tcp::acceptor acceptor(server_ctx, tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+		acceptor.async_accept([chunks, chunk_size](error_code ec, tcp::socket socket)
+		{
+			if (!ec)
+			{
+				session_options options;
+				options.chunk_size = chunk_size;
+				options.chunks = chunks;
+				session::create(std::move(socket), options)->start();
+			}
+		});
+
+		std::vector<std::thread> server_threads;
+		for (int i = 0; i < 2; ++i)
+		{
+			server_threads.emplace_back([&server_ctx] { server_ctx.run(); });
+		}
+
+		asio::io_context client_ctx;
+		tcp::socket client(client_ctx);
+		client.connect(acceptor.local_endpoint());
+
+		std::vector<char> out(chunk_size, 'x');
+		std::vector<char> in(chunk_size);
+		std::uint64_t sent = 0;
+		std::uint64_t received = 0;
+		auto deadline = now() + duration;
+
+		std::function<void()> do_write = [&]
+		{
+			asio::async_write(client, asio::buffer(out), [&](error_code ec, std::size_t n)
+			{
+				sent += n;
+				if (!ec && now() < deadline)
+				{
+					do_write();
+				}
+			});
+		};
+		std::function<void()> do_read = [&]
+		{
+			client.async_read_some(asio::buffer(in), [&](error_code ec, std::size_t n)
+			{
+				received += n;
+				if (ec)
+				{
+					return;
+				}
+				if (now() < deadline)
+				{
+					do_read();
+				}
+				else
+				{
+					client.close();
+				}
+			});
+		};
+
+		auto start = now();
+		do_write();
+		do_read();
+		client_ctx.run();
+		double seconds = std::chrono::duration<double>(now() - start).count();
+
+		guard.reset();
+		server_ctx.stop();
+		for (auto& t : server_threads)
+		{
+			t.join();
+		}
+
+		double up = sent / seconds / (1024 * 1024);
+		double down = received / seconds / (1024 * 1024);
+		std::cout << "chunks=" << chunks << (chunks == 1 ? " (half duplex)" : " (full duplex)")
+			<< " up=" << up << " MiB/s down=" << down << " MiB/s total=" << up + down << " MiB/s" << std::endl;
+	}
+}
+
+// 优先级调度：单线程io_context上持续运行64条批量处理链（每个handler忙等20us后重新投递自己），
+// 另一个线程每毫秒投递一条控制消息，统计控制消息从投递到开始执行的延迟。
+// 直接asio::post时控制消息排在所有批量handler之后；经priority_scheduler以urgent投递（批量以bulk投递）时在下一个令牌就被执行。
+void test_priority_scheduler()
+{
+	const int chains = 64;
+	const int messages = 500;
+
+	for (bool prioritized : { false, true })
+	{
+		asio::io_context ctx;
+		auto& scheduler = asio::use_service<priority_scheduler>(ctx);
+		auto bulk_executor = scheduler.get_executor(handler_priority::bulk);
+		auto urgent_executor = scheduler.get_executor(handler_priority::urgent);
+		std::atomic<bool> stop{ false };
+		std::vector<std::int64_t> latencies;
+
+		std::function<void()> bulk = [&]
+		{
+			auto start = now();
+			while (now() - start < std::chrono::microseconds(20))
+			{
+			}
+
+			if (stop)
+			{
+				return;
+			}
+			if (prioritized)
+			{
+				asio::post(bulk_executor, bulk);
+			}
+			else
+			{
+				asio::post(ctx, bulk);
+			}
+		};
+		for (int i = 0; i < chains; ++i)
+		{
+			asio::post(ctx, bulk);
+		}
+
+		std::thread control([&]
+		{
+			for (int i = 0; i < messages; ++i)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				auto posted = now();
+				auto handler = [&latencies, posted]
+				{
+					latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now() - posted).count());
+				};
+				if (prioritized)
+				{
+					asio::post(urgent_executor, handler);
+				}
+				else
+				{
+					asio::post(ctx, handler);
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			stop = true;
+		});
+
+		ctx.run();
+		control.join();
+
+		std::sort(latencies.begin(), latencies.end());
+		std::cout << (prioritized ? "priority_scheduler: " : "asio::post:         ")
+			<< "control messages=" << latencies.size()
+			<< " p50=" << latencies[latencies.size() / 2] << "us"
+			<< " p99=" << latencies[latencies.size() * 99 / 100] << "us"
+			<< " max=" << latencies.back() << "us" << std::endl;
+	}
+}
+
 int main()
 {
 	std::srand(std::time(nullptr));
@@ -315,5 +502,7 @@ int main()
 //	test_single_context_multi_thread_with_guard();
 //	test_single_context_multi_thread_with_strand();
 //	test_high_resolution_timer();
+//	test_full_duplex_session();
+//	test_priority_scheduler();
 	test_context_pool();
 }
\ No newline at end of file
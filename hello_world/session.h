@@ -1,10 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <boost/asio.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 #include <boost/thread.hpp>
 
 namespace asio = boost::asio;
@@ -13,49 +16,165 @@ using asio::io_context;
 using work_guard_t = asio::executor_work_guard<asio::io_context::executor_type>;
 using error_code = boost::system::error_code;
 
+struct session_options
+{
+	std::size_t chunk_size = 64 * 1024;     // 每个streambuf的上限，也是一次读取的最大字节数
+	std::size_t chunks = 8;                 // 读写之间流转的streambuf数量，为1时退化为半双工
+};
+
+// 全双工echo会话：
+// 读循环在read_strand上把数据读进空闲的streambuf，通过无锁队列交给write_strand上的写循环发回，
+// 写完的streambuf再通过另一个无锁队列还给读循环。两个循环只通过这两个单生产者单消费者队列交接，
+// 在多线程io_context上同一个连接的读和写可以同时进行（reactor对每个描述符的读写操作分别排队，一读一写并发发起是安全的）。
+// streambuf的数量和大小固定，对端不读时内存不会无限增长。
 class session : public std::enable_shared_from_this<session>
 {
-	using context_t = asio::io_context;
-	using context_ptr = std::shared_ptr<context_t>;
+public:
+	using pointer = std::shared_ptr<session>;
+
+	static pointer create(tcp::socket socket, const session_options& options = session_options())
+	{
+		return pointer(new session(std::move(socket), options));
+	}
+
+	void start()
+	{
+		reading = true;
+		asio::post(read_strand, [self = shared_from_this()]() { self->async_read(); });
+	}
 
-	session(context_t& io_context)
-		: socket(io_context), read_strand(io_context), write_strand(io_context)
+	std::uint64_t bytes_read() const
 	{
+		return read_total.load(std::memory_order_relaxed);
 	}
 
+	std::uint64_t bytes_written() const
+	{
+		return write_total.load(std::memory_order_relaxed);
+	}
+
+private:
+	using buffer_ptr = asio::streambuf*;
+
+	session(tcp::socket socket, const session_options& options)
+		: socket(std::move(socket)),
+		read_strand(this->socket.get_executor()), write_strand(this->socket.get_executor()),
+		options(options), ready_buffers(options.chunks), free_buffers(options.chunks)
+	{
+		for (std::size_t i = 0; i < options.chunks; ++i)
+		{
+			buffers.emplace_back(new asio::streambuf(options.chunk_size));
+			free_buffers.push(buffers.back().get());
+		}
+	}
+
+	// 在read_strand上运行
 	void async_read()
 	{
-		asio::async_read(socket,
-			read_buffer,
-			boost::asio::bind_executor(read_strand, [&](error_code ec, std::size_t bytes_transferred)
+		buffer_ptr buffer = nullptr;
+		while (!free_buffers.pop(buffer))
+		{
+			// 所有streambuf都在等待写出，暂停读取，写循环归还时再唤醒
+			reading.store(false);
+			if (free_buffers.read_available() == 0 || reading.exchange(true))
+			{
+				return;
+			}
+		}
+
+		socket.async_read_some(buffer->prepare(options.chunk_size),
+			asio::bind_executor(read_strand, [this, self = shared_from_this(), buffer](error_code ec, std::size_t bytes_transferred)
 			{
-				if (!ec)
+				if (ec)
 				{
-					async_read();
+					// 对端不再发送，写循环发完已读到的数据后关闭发送方向
+					read_closed.store(true);
+					kick_writer();
+					return;
 				}
+
+				buffer->commit(bytes_transferred);
+				read_total.fetch_add(bytes_transferred, std::memory_order_relaxed);
+				ready_buffers.push(buffer);
+				kick_writer();
+				async_read();
 			}));
 	}
 
+	// 在write_strand上运行
 	void async_write()
 	{
-		asio::async_read(socket,
-			write_buffer,
-			asio::bind_executor(write_strand, [&](error_code ec, std::size_t bytes_transferred)
+		buffer_ptr buffer = nullptr;
+		while (!ready_buffers.pop(buffer))
+		{
+			if (read_closed.load())
+			{
+				// 读循环先入队再设置read_closed，上面的pop失败后它可能刚入队最后一块，再取一次
+				if (ready_buffers.pop(buffer))
+				{
+					break;
+				}
+
+				error_code ignored;
+				socket.shutdown(tcp::socket::shutdown_send, ignored);
+				return;
+			}
+
+			writing.store(false);
+			if ((ready_buffers.read_available() == 0 && !read_closed.load()) || writing.exchange(true))
+			{
+				return;
+			}
+		}
+
+		asio::async_write(socket,
+			buffer->data(),
+			asio::bind_executor(write_strand, [this, self = shared_from_this(), buffer](error_code ec, std::size_t bytes_transferred)
 			{
-				if (!ec)
+				if (ec)
 				{
-					async_write();
+					error_code ignored;
+					socket.shutdown(tcp::socket::shutdown_both, ignored);
+					return;
 				}
+
+				buffer->consume(bytes_transferred);
+				write_total.fetch_add(bytes_transferred, std::memory_order_relaxed);
+				free_buffers.push(buffer);
+				if (!reading.exchange(true))
+				{
+					asio::post(read_strand, [self]() { self->async_read(); });
+				}
+				async_write();
 			}));
 	}
 
-private:
+	// 写循环暂停时把它唤醒，正在运行则由它自己在队列取空前看到新数据
+	void kick_writer()
+	{
+		if (!writing.exchange(true))
+		{
+			asio::post(write_strand, [self = shared_from_this()]() { self->async_write(); });
+		}
+	}
 
 	tcp::socket socket;
 
-	io_context::strand write_strand;
-	io_context::strand read_strand;
+	asio::strand<tcp::socket::executor_type> read_strand;
+	asio::strand<tcp::socket::executor_type> write_strand;
+
+	session_options options;
+	std::vector<std::unique_ptr<asio::streambuf>> buffers;
+
+	// 读循环是ready_buffers的唯一生产者、free_buffers的唯一消费者，写循环相反
+	boost::lockfree::spsc_queue<buffer_ptr> ready_buffers;
+	boost::lockfree::spsc_queue<buffer_ptr> free_buffers;
+
+	// 读/写循环是否在运行，暂停的一方由另一方在交接后唤醒
+	std::atomic<bool> reading{false};
+	std::atomic<bool> writing{false};
+	std::atomic<bool> read_closed{false};
 
-	boost::asio::streambuf write_buffer;
-	boost::asio::streambuf read_buffer;
+	std::atomic<std::uint64_t> read_total{0};
+	std::atomic<std::uint64_t> write_total{0};
 };
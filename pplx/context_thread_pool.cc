@@ -1,4 +1,6 @@
 #include "context_thread_pool.h"
+#include "public/event_tracer.h"
+#include "public/handler_metrics.h"
 #include <memory>
 
 enum
@@ -47,9 +49,12 @@ void ContextThreadPool::initialize_with_threads(size_t num_threads)
 
 void ContextThreadPool::add_thread()
 {
+	std::string name = "context_thread_pool-" + std::to_string(_threads.size());
 	_threads.push_back(
-		std::make_unique<thread_t>([this]
+		std::make_unique<thread_t>([this, name]
 		{
+			handler_metrics::set_thread_name(name);
+			event_tracer::set_thread_name(name);
 			//auto work_guard = asio::make_work_guard(_context);
 			_context.run();
 		})
@@ -0,0 +1,148 @@
+// 比较逐条在堆上解析和按批次在Arena上解析的内存分配次数与耗时。
+// 通过替换全局operator new统计分配次数。
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chat.pb.h"
+#include "protobuf/public/pb_frame.h"
+#include "protobuf/public/pb_arena.h"
+#include "protobuf/public/pb_message_types.h"
+
+static std::atomic<std::size_t> g_allocations{0};
+
+void *operator new(std::size_t size) {
+    ++g_allocations;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+using bench_clock = std::chrono::steady_clock;
+
+constexpr std::size_t batch_size = 64;
+constexpr std::size_t batch_count = 20000;
+
+// 把batch_size个PRoomInformation编码成一段连续的接收数据
+std::vector<std::uint8_t> make_batch(std::size_t information_size) {
+    pb_frame_pool pool;
+    std::vector<std::uint8_t> data;
+    for (std::size_t i = 0; i < batch_size; ++i) {
+        PRoomInformation msg;
+        msg.set_name("127.0.0.1:" + std::to_string(40000 + i));
+        msg.set_information(std::string(information_size, 'a' + i % 26));
+        pb_frame_ptr frame = pb_encode(pool, msg);
+        data.insert(data.end(), frame->data(), frame->data() + frame->size());
+    }
+    return data;
+}
+
+// 遍历一批数据中的每一帧
+template<typename Handler>
+void for_each_frame(const std::vector<std::uint8_t> &data, Handler &&handler) {
+    std::size_t pos = 0;
+    while (pos < data.size()) {
+        std::uint32_t body_size = 0;
+        int header_size = pb_decode_varint32(data.data() + pos, data.size() - pos, body_size);
+        // 跳过1字节类型ID
+        handler(data.data() + pos + header_size + 1, body_size - 1);
+        pos += header_size + body_size;
+    }
+}
+
+struct bench_result {
+    double allocations_per_msg;
+    double ns_per_msg;
+};
+
+template<typename ParseBatch>
+bench_result run(const std::vector<std::uint8_t> &data, ParseBatch &&parse_batch) {
+    // 预热一批，排除首次分配的影响
+    std::size_t checksum = parse_batch(data);
+
+    std::size_t allocations = g_allocations;
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < batch_count; ++i) {
+        checksum += parse_batch(data);
+    }
+    auto elapsed = bench_clock::now() - start;
+    allocations = g_allocations - allocations;
+
+    if (checksum == 0) {
+        std::cerr << "unexpected empty parse\n";
+    }
+
+    double messages = static_cast<double>(batch_size) * batch_count;
+    return bench_result{
+            static_cast<double>(allocations) / messages,
+            static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / messages
+    };
+}
+
+void print(const char *name, std::size_t information_size, const bench_result &result) {
+    std::cout << name << " information=" << information_size << "B"
+              << " allocations/msg=" << result.allocations_per_msg
+              << " ns/msg=" << result.ns_per_msg << "\n";
+}
+
+int main() {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    for (std::size_t information_size: {16, 200, 2000}) {
+        auto data = make_batch(information_size);
+
+        // 每帧new一个消息对象，处理完即释放
+        print("heap ", information_size, run(data, [](const std::vector<std::uint8_t> &batch) {
+            std::size_t n = 0;
+            for_each_frame(batch, [&n](const std::uint8_t *body, std::size_t size) {
+                auto msg = std::make_unique<PRoomInformation>();
+                pb_parse_body(body, size, *msg);
+                n += msg->information().size();
+            });
+            return n;
+        }));
+
+        // 复用同一个堆上的消息对象
+        PRoomInformation reused;
+        print("reuse", information_size, run(data, [&reused](const std::vector<std::uint8_t> &batch) {
+            std::size_t n = 0;
+            for_each_frame(batch, [&n, &reused](const std::uint8_t *body, std::size_t size) {
+                pb_parse_body(body, size, reused);
+                n += reused.information().size();
+            });
+            return n;
+        }));
+
+        // 整批分配在Arena上，分发完后Reset()
+        pb_batch_arena arena;
+        print("arena", information_size, run(data, [&arena](const std::vector<std::uint8_t> &batch) {
+            std::size_t n = 0;
+            for_each_frame(batch, [&n, &arena](const std::uint8_t *body, std::size_t size) {
+                auto *msg = arena.create<PRoomInformation>();
+                pb_parse_body(body, size, *msg);
+                n += msg->information().size();
+            });
+            arena.reset();
+            return n;
+        }));
+    }
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
@@ -1,129 +1,196 @@
 // https://www.boost.org/doc/libs/1_71_0/doc/html/boost_asio/example/cpp11/chat/chat_client.cpp
+// 消息改为protobuf/public/chat.proto中定义的PChat/PRoomInformation，帧格式见pb_frame.h
+// 连接和请求复用见pb_client.h；指定--calls时不读标准输入，而是用协程流水线发送请求并统计吞吐和延迟
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
-#include <deque>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <string>
 #include <thread>
+#include <utility>
 
 #include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/use_future.hpp>
 
-#include "chat/public/chat_message.h"
+#include "chat.pb.h"
+#include "protobuf/public/pb_client.h"
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
 
 using boost::asio::ip::tcp;
 
-typedef std::deque<chat_message> chat_message_queue;
-
-class chat_client {
-public:
-    chat_client(boost::asio::io_context &io_context, const tcp::resolver::results_type &endpoints)
-            : io_context_(io_context), socket_(io_context) {
-        do_connect(endpoints);
-    }
-
-    void write(const chat_message &msg) {
-        boost::asio::post(io_context_,
-                          [this, msg]() {
-                              bool write_in_progress = !write_msgs_.empty();
-                              write_msgs_.push_back(msg);
-                              if (!write_in_progress) {
-                                  do_write();
-                              }
-                          });
-    }
+struct client_options {
+    bool compression = false;
+    std::size_t compress_min_size = pb_default_compress_min_size;
+    std::size_t calls = 0;      // 流水线模式的请求总数，0表示交互模式
+    std::size_t window = 16;    // 同时在途的请求数
+    std::size_t size = 64;      // 流水线模式的消息体字节数
+};
 
-    void close() {
-        boost::asio::post(io_context_, [this]() { socket_.close(); });
-    }
+// 流水线模式的统计，只在io_context线程中修改
+struct pipeline_stats {
+    latency_histogram latency;
+    std::size_t failed = 0;
+    std::size_t running = 0;
+    std::promise<void> done;
+};
 
-private:
-    void do_connect(const tcp::resolver::results_type &endpoints) {
-        boost::asio::async_connect(socket_, endpoints,
-                                   [this](boost::system::error_code ec, const tcp::endpoint &) {
-                                       if (!ec) {
-                                           do_read_header();
-                                       }
-                                   });
+// 一个协程顺序发送calls个请求，window个协程同时运行时连接上就有window个请求在途
+boost::asio::awaitable<void> run_calls(pb_client &client, std::size_t calls, std::string body,
+                                       pipeline_stats &stats) {
+    for (std::size_t i = 0; i < calls; ++i) {
+        PChat msg;
+        msg.set_information(body);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            PAck ack = co_await client.async_call(std::move(msg), boost::asio::use_awaitable);
+            if (ack.status() != 0) {
+                ++stats.failed;
+            }
+        }
+        catch (const boost::system::system_error &) {
+            ++stats.failed;
+            break;
+        }
+        stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
     }
 
-    void do_read_header() {
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-                                [this](boost::system::error_code ec, std::size_t /*length*/) {
-                                    if (!ec && read_msg_.decode_header()) {
-                                        do_read_body();
-                                    } else {
-                                        socket_.close();
-                                    }
-                                });
+    if (--stats.running == 0) {
+        stats.done.set_value();
     }
+}
 
-    void do_read_body() {
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-                                [this](boost::system::error_code ec, std::size_t /*length*/) {
-                                    if (!ec) {
-                                        std::cout.write(read_msg_.body(), read_msg_.body_length());
-                                        std::cout << "\n";
-                                        do_read_header();
-                                    } else {
-                                        socket_.close();
-                                    }
-                                });
-    }
+bool run_pipeline(boost::asio::io_context &io_context, pb_client &client, const client_options &options) {
+    pipeline_stats stats;
+    std::size_t window = std::min(options.window, options.calls);
+    std::string body(options.size, 'x');
+    stats.running = window;
 
-    void do_write() {
-        boost::asio::async_write(socket_,
-                                 boost::asio::buffer(write_msgs_.front().data(),
-                                                     write_msgs_.front().length()),
-                                 [this](boost::system::error_code ec, std::size_t /*length*/) {
-                                     if (!ec) {
-                                         write_msgs_.pop_front();
-                                         if (!write_msgs_.empty()) {
-                                             do_write();
-                                         }
-                                     } else {
-                                         socket_.close();
-                                     }
-                                 });
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < window; ++i) {
+        std::size_t calls = options.calls / window + (i < options.calls % window ? 1 : 0);
+        boost::asio::co_spawn(io_context, run_calls(client, calls, body, stats), boost::asio::detached);
     }
-
-private:
-    boost::asio::io_context &io_context_;
-    tcp::socket socket_;
-    chat_message read_msg_;
-    chat_message_queue write_msgs_;
-};
+    stats.done.get_future().wait();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const latency_histogram &h = stats.latency;
+    std::cout << "calls=" << h.count() << " failed=" << stats.failed << " window=" << window
+              << " elapsed_s=" << elapsed
+              << " calls_per_sec=" << static_cast<double>(h.count()) / elapsed
+              << " p50_us=" << h.percentile(50.0) / 1000.0
+              << " p99_us=" << h.percentile(99.0) / 1000.0
+              << " max_us=" << h.max() / 1000.0 << "\n";
+    return stats.failed == 0;
+}
 
 int main(int argc, char *argv[]) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    int result = 0;
     try {
-        if (argc != 3) {
-            std::cerr << "Usage: chat_client <host> <port>\n";
+        client_options options;
+        int first = 1;
+        for (; first < argc && std::strncmp(argv[first], "--", 2) == 0; ++first) {
+            const char *arg = argv[first];
+            const char *value = nullptr;
+            if ((value = parse_option(arg, "--compression"))) {
+                options.compression = std::strcmp(value, "deflate") == 0;
+            } else if ((value = parse_option(arg, "--compress-min-size"))) {
+                options.compress_min_size = std::strtoul(value, nullptr, 10);
+            } else if ((value = parse_option(arg, "--calls"))) {
+                options.calls = std::strtoul(value, nullptr, 10);
+            } else if ((value = parse_option(arg, "--window"))) {
+                options.window = std::max<std::size_t>(1, std::strtoul(value, nullptr, 10));
+            } else if ((value = parse_option(arg, "--size"))) {
+                options.size = std::strtoul(value, nullptr, 10);
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
+
+        int positional = argc - first;
+        if (positional != 2 && positional != 3) {
+            std::cerr << "Usage: protobuf_client [--compression=deflate|off] [--compress-min-size=<bytes>]"
+                         " [--calls=<n> [--window=<n>] [--size=<bytes>]] <host> <port> [<name>]\n";
             return 1;
         }
 
         boost::asio::io_context io_context;
 
         tcp::resolver resolver(io_context);
-        auto endpoints = resolver.resolve(argv[1], argv[2]);
-        chat_client c(io_context, endpoints);
+        auto endpoints = resolver.resolve(argv[first], argv[first + 1]);
+
+        pb_client client(io_context);
+        if (options.calls == 0) {
+            client.on_push<PRoomInformation>([](PRoomInformation &msg) {
+                std::cout << msg.name() << ": " << msg.information() << "\n";
+            });
+        }
+
+        std::future<void> connected = client.async_connect(endpoints, boost::asio::use_future);
+        if (options.compression) {
+            client.request_compression(options.compress_min_size);
+        }
+
+        std::future<PAck> bound;
+        if (positional == 3) {
+            PBindName msg;
+            msg.set_name(argv[first + 2]);
+            bound = client.async_call(std::move(msg), boost::asio::use_future);
+        }
 
         std::thread t([&io_context]() { io_context.run(); });
 
-        char line[chat_message::max_body_length + 1];
-        while (std::cin.getline(line, chat_message::max_body_length + 1)) {
-            chat_message msg;
-            msg.body_length(std::strlen(line));
-            std::memcpy(msg.body(), line, msg.body_length());
-            msg.encode_header();
-            c.write(msg);
+        try {
+            connected.get();
+            if (bound.valid()) {
+                PAck ack = bound.get();
+                if (ack.status() != 0) {
+                    std::cerr << "bind name failed: " << ack.error() << "\n";
+                }
+            }
+
+            if (options.calls > 0) {
+                result = run_pipeline(io_context, client, options) ? 0 : 1;
+            } else {
+                std::string line;
+                while (std::getline(std::cin, line)) {
+                    PChat msg;
+                    msg.set_information(line);
+                    client.send(std::move(msg));
+                }
+            }
+        }
+        catch (std::exception &e) {
+            std::cerr << "Exception: " << e.what() << "\n";
+            result = 1;
         }
 
-        c.close();
+        client.close();
         t.join();
+
+        const pb_compression_stats &cs = client.compression_stats();
+        if (cs.compressed_frames + cs.decompressed_frames > 0) {
+            std::cerr << "compression: sent " << cs.compressed_frames << " frames, "
+                      << cs.raw_bytes << " -> " << cs.compressed_bytes << " bytes (x" << cs.ratio() << "), "
+                      << cs.compress_cpu_ns / 1000 << " us; received " << cs.decompressed_frames << " frames, "
+                      << cs.decompress_cpu_ns / 1000 << " us\n";
+        }
     }
     catch (std::exception &e) {
         std::cerr << "Exception: " << e.what() << "\n";
+        result = 1;
     }
 
-    return 0;
+    google::protobuf::ShutdownProtobufLibrary();
+    return result;
 }
@@ -0,0 +1,62 @@
+//
+// 按接收批次使用的protobuf Arena。
+// 一次async_read_some中解析出的所有消息都分配在Arena上，整批分发完后统一Reset()。
+// 初始块由本类持有，Reset()后初始块会被保留复用，消息对象本身不再逐条new/delete。
+// 注意protobuf 3.x的string/bytes字段内容仍由std::string在堆上分配：超过SSO长度的字段
+// 每条消息各有一次malloc/free，Reset()时释放。复用同一个消息对象时字段容量会保留下来，
+// 没有这次分配，benchmark中也比Arena快。
+//
+
+#ifndef TEST_ASIO_PB_ARENA_H
+#define TEST_ASIO_PB_ARENA_H
+
+#include <cstdint>
+#include <memory>
+
+#include <google/protobuf/arena.h>
+
+class pb_batch_arena {
+public:
+    enum {
+        default_block_size = 128 * 1024
+    };
+
+    explicit pb_batch_arena(std::size_t initial_block_size = default_block_size)
+            : block_(new char[initial_block_size]),
+              arena_(make_options(block_.get(), initial_block_size)) {
+    }
+
+    pb_batch_arena(const pb_batch_arena &) = delete;
+    pb_batch_arena &operator=(const pb_batch_arena &) = delete;
+
+    template<typename T>
+    T *create() {
+        return google::protobuf::Arena::CreateMessage<T>(&arena_);
+    }
+
+    google::protobuf::Arena &arena() {
+        return arena_;
+    }
+
+    // 整批消息分发完成后调用，此前create()得到的消息全部失效
+    void reset() {
+        arena_.Reset();
+    }
+
+    std::uint64_t space_allocated() const {
+        return arena_.SpaceAllocated();
+    }
+
+private:
+    static google::protobuf::ArenaOptions make_options(char *block, std::size_t size) {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = size;
+        return options;
+    }
+
+    std::unique_ptr<char[]> block_;
+    google::protobuf::Arena arena_;
+};
+
+#endif //TEST_ASIO_PB_ARENA_H
@@ -0,0 +1,315 @@
+//
+// 在一个连接上复用多个请求的protobuf客户端。
+// 请求消息带request_id（见chat.proto），服务器按request_id回复PAck，
+// 因此不必等上一个请求返回就可以继续发送；排队的帧合并为一次聚集写。
+// async_call遵循asio的CompletionToken约定，可以使用回调、use_future或use_awaitable：
+//     PAck ack = co_await client.async_call(msg, boost::asio::use_awaitable);
+// 所有状态都在内部的strand上访问，公开接口可以从任意线程调用。
+//
+
+#ifndef TEST_ASIO_PB_CLIENT_H
+#define TEST_ASIO_PB_CLIENT_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "chat.pb.h"
+#include "pb_arena.h"
+#include "pb_compression.h"
+#include "pb_dispatcher.h"
+#include "pb_frame.h"
+#include "pb_message_types.h"
+
+class pb_client {
+public:
+    typedef boost::asio::strand<boost::asio::io_context::executor_type> executor_type;
+
+    explicit pb_client(boost::asio::io_context &io_context)
+            : strand_(boost::asio::make_strand(io_context)), socket_(strand_) {
+    }
+
+    pb_client(const pb_client &) = delete;
+    pb_client &operator=(const pb_client &) = delete;
+
+    executor_type get_executor() const {
+        return strand_;
+    }
+
+    // 完成签名void(boost::system::error_code)。连接建立前提交的请求会排队，连接后再发送
+    template<typename CompletionToken>
+    auto async_connect(const boost::asio::ip::tcp::resolver::results_type &endpoints, CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+                [this, endpoints](auto handler) {
+                    boost::asio::async_connect(
+                            socket_, endpoints,
+                            [this, handler = std::move(handler)](boost::system::error_code ec,
+                                                                 const boost::asio::ip::tcp::endpoint &) mutable {
+                                if (!ec) {
+                                    socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+                                    connected_ = true;
+                                    do_read();
+                                    if (!write_frames_.empty()) {
+                                        do_write();
+                                    }
+                                } else {
+                                    fail_all(ec);
+                                }
+                                complete(std::move(handler), ec);
+                            });
+                }, token);
+    }
+
+    // 发送带request_id的请求，完成签名void(boost::system::error_code, PAck)。
+    // Request必须有request_id字段；连接断开时所有未完成的请求以对应的错误完成
+    template<typename Request, typename CompletionToken>
+    auto async_call(Request msg, CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, PAck)>(
+                [this](auto handler, Request msg) {
+                    boost::asio::dispatch(
+                            strand_,
+                            [this, handler = std::move(handler), msg = std::move(msg)]() mutable {
+                                if (closed_) {
+                                    complete(std::move(handler), boost::system::error_code(
+                                            boost::asio::error::not_connected), PAck());
+                                    return;
+                                }
+
+                                std::uint64_t request_id = next_request_id_++;
+                                msg.set_request_id(request_id);
+                                pending_.emplace(request_id,
+                                                 std::make_unique<pending_call_impl<decltype(handler)>>(
+                                                         std::move(handler), strand_));
+                                write_frame(pb_encode(pool_, msg));
+                            });
+                }, token, std::move(msg));
+    }
+
+    // 不需要回复的消息
+    template<typename T>
+    void send(T msg) {
+        boost::asio::dispatch(strand_, [this, msg = std::move(msg)]() {
+            if (!closed_) {
+                write_frame(pb_encode(pool_, msg));
+            }
+        });
+    }
+
+    // 注册服务器主动推送的消息T的处理函数，需要在async_connect之前调用。消息在接收批次的Arena上
+    template<typename T>
+    void on_push(std::function<void(T &)> handler) {
+        push_entry &e = push_[static_cast<std::uint8_t>(pb_message_traits<T>::type)];
+        e.prototype = &T::default_instance();
+        e.invoke = [handler = std::move(handler)](google::protobuf::MessageLite &msg) {
+            handler(static_cast<T &>(msg));
+        };
+    }
+
+    // 请求按连接压缩，服务器可能提高阈值或拒绝
+    void request_compression(std::size_t min_size) {
+        PCompression msg;
+        msg.set_algorithm(PCompression::DEFLATE);
+        msg.set_min_size(static_cast<std::uint32_t>(min_size));
+        send(std::move(msg));
+    }
+
+    // 只在strand上或io_context停止后访问
+    const pb_compression_stats &compression_stats() const {
+        return compression_stats_;
+    }
+
+    void close() {
+        boost::asio::dispatch(strand_, [this]() {
+            fail_all(boost::asio::error::operation_aborted);
+        });
+    }
+
+private:
+    enum {
+        max_gathered_frames = 64
+    };
+
+    struct pending_call {
+        virtual ~pending_call() = default;
+
+        virtual void complete(const boost::system::error_code &ec, PAck ack) = 0;
+    };
+
+    template<typename Handler>
+    struct pending_call_impl : pending_call {
+        pending_call_impl(Handler handler, const executor_type &strand)
+                : handler_(std::move(handler)), strand_(strand) {
+        }
+
+        void complete(const boost::system::error_code &ec, PAck ack) override {
+            auto executor = boost::asio::get_associated_executor(handler_, strand_);
+            boost::asio::dispatch(executor,
+                                  [handler = std::move(handler_), ec, ack = std::move(ack)]() mutable {
+                                      handler(ec, std::move(ack));
+                                  });
+        }
+
+        Handler handler_;
+        executor_type strand_;
+    };
+
+    struct push_entry {
+        const google::protobuf::MessageLite *prototype = nullptr;
+        std::function<void(google::protobuf::MessageLite &)> invoke;
+    };
+
+    // 在handler关联的执行器上完成，没有关联执行器时在strand上完成
+    template<typename Handler, typename... Args>
+    void complete(Handler &&handler, Args &&... args) {
+        auto executor = boost::asio::get_associated_executor(handler, strand_);
+        boost::asio::dispatch(executor,
+                              [handler = std::move(handler), ... args = std::forward<Args>(args)]() mutable {
+                                  handler(std::move(args)...);
+                              });
+    }
+
+    static const pb_dispatcher<pb_client> &dispatcher() {
+        static const pb_dispatcher<pb_client> table = [] {
+            pb_dispatcher<pb_client> d;
+            d.on<PAck, &pb_client::on_ack>()
+                    .on<PCompression, &pb_client::on_compression>();
+            return d;
+        }();
+        return table;
+    }
+
+    bool on_ack(PAck &msg) {
+        auto it = pending_.find(msg.request_id());
+        if (it == pending_.end()) {
+            return true;
+        }
+
+        std::unique_ptr<pending_call> call = std::move(it->second);
+        pending_.erase(it);
+        // 消息在Arena上，拷贝一份交给调用者
+        call->complete(boost::system::error_code(), PAck(msg));
+        return true;
+    }
+
+    bool on_compression(PCompression &msg) {
+        if (msg.algorithm() == PCompression::DEFLATE && !codec_) {
+            codec_ = std::make_unique<pb_deflate_stream>(compression_stats_, msg.min_size());
+        }
+        return true;
+    }
+
+    bool on_frame(const std::uint8_t *data, std::size_t size) {
+        if (size > 0 && (data[0] & pb_compressed_flag) != 0) {
+            if (!codec_ || !codec_->decompress(data, size)) {
+                return false;
+            }
+        }
+        if (size == 0) {
+            return false;
+        }
+
+        const push_entry &e = push_[data[0]];
+        if (e.invoke) {
+            google::protobuf::MessageLite *msg = e.prototype->New(&arena_.arena());
+            if (!pb_parse_body(data + 1, size - 1, *msg)) {
+                return false;
+            }
+            e.invoke(*msg);
+            return true;
+        }
+        return dispatcher().dispatch(*this, data, size, arena_);
+    }
+
+    void fail_all(const boost::system::error_code &ec) {
+        closed_ = true;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        write_frames_.clear();
+
+        auto pending = std::move(pending_);
+        pending_.clear();
+        for (auto &call: pending) {
+            call.second->complete(ec, PAck());
+        }
+    }
+
+    void write_frame(const pb_frame_ptr &frame) {
+        bool write_in_progress = !write_frames_.empty();
+        write_frames_.push_back(codec_ ? codec_->compress(pool_, frame) : frame);
+        if (!write_in_progress && connected_) {
+            do_write();
+        }
+    }
+
+    void do_read() {
+        socket_.async_read_some(reader_.prepare(),
+                                [this](boost::system::error_code ec, std::size_t length) {
+                                    if (!ec) {
+                                        reader_.commit(length);
+                                        bool ok = reader_.parse([this](const std::uint8_t *data, std::size_t size) {
+                                            return on_frame(data, size);
+                                        });
+                                        arena_.reset();
+                                        if (ok) {
+                                            do_read();
+                                            return;
+                                        }
+                                        ec = boost::asio::error::invalid_argument;
+                                    }
+                                    if (!closed_) {
+                                        fail_all(ec);
+                                    }
+                                });
+    }
+
+    void do_write() {
+        write_buffers_.clear();
+        for (auto it = write_frames_.begin();
+             it != write_frames_.end() && write_buffers_.size() < max_gathered_frames; ++it) {
+            write_buffers_.push_back((*it)->buffer());
+        }
+
+        boost::asio::async_write(socket_, write_buffers_,
+                                 [this](boost::system::error_code ec, std::size_t /*length*/) {
+                                     if (closed_) {
+                                         return;
+                                     }
+                                     if (!ec) {
+                                         write_frames_.erase(write_frames_.begin(),
+                                                             write_frames_.begin() + write_buffers_.size());
+                                         if (!write_frames_.empty()) {
+                                             do_write();
+                                         }
+                                     } else {
+                                         fail_all(ec);
+                                     }
+                                 });
+    }
+
+    executor_type strand_;
+    boost::asio::ip::tcp::socket socket_;
+    bool connected_ = false;
+    bool closed_ = false;
+
+    pb_frame_pool pool_;
+    pb_frame_reader reader_;
+    pb_batch_arena arena_{16 * 1024};
+    std::deque<pb_frame_ptr> write_frames_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
+
+    std::uint64_t next_request_id_ = 1;
+    std::unordered_map<std::uint64_t, std::unique_ptr<pending_call>> pending_;
+    std::array<push_entry, 256> push_{};
+
+    pb_compression_stats compression_stats_;
+    std::unique_ptr<pb_deflate_stream> codec_;
+};
+
+#endif //TEST_ASIO_PB_CLIENT_H
@@ -0,0 +1,176 @@
+//
+// 按连接协商的流式压缩（raw deflate）。
+// 每个连接各持有一对z_stream，压缩字典在帧之间延续，同一连接上重复的名字和内容压缩率更高；
+// 因此压缩帧必须按发送顺序逐个解压，压缩后的帧也不能在连接之间共享。
+// 压缩帧的类型ID带pb_compressed_flag，消息体是按Z_SYNC_FLUSH刷出并去掉末尾00 00 FF FF的deflate数据：
+//     varint32(1 + compressed_size) | type_id | 0x80 | deflate(body)
+// 每个连接的压缩状态约300KB内存，所以只在双方协商后开启，并且只压缩超过阈值的帧。
+//
+
+#ifndef TEST_ASIO_PB_COMPRESSION_H
+#define TEST_ASIO_PB_COMPRESSION_H
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include <zlib.h>
+
+#include "pb_frame.h"
+
+enum {
+    pb_compressed_flag = 0x80,
+    pb_default_compress_min_size = 256
+};
+
+struct pb_compression_stats {
+    std::uint64_t compressed_frames = 0;
+    std::uint64_t skipped_frames = 0;       // 低于阈值未压缩的帧数
+    std::uint64_t raw_bytes = 0;            // 压缩前的消息体字节数
+    std::uint64_t compressed_bytes = 0;     // 压缩后的消息体字节数
+    std::uint64_t compress_cpu_ns = 0;
+    std::uint64_t decompressed_frames = 0;
+    std::uint64_t decompress_cpu_ns = 0;
+
+    double ratio() const {
+        return compressed_bytes == 0 ? 0.0 : static_cast<double>(raw_bytes) / compressed_bytes;
+    }
+};
+
+// 当前线程消耗的CPU时间，压缩在io线程中同步执行，用它统计压缩本身的开销
+inline std::uint64_t pb_thread_cpu_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// 一个连接两个方向的压缩上下文，非线程安全。统计累加到外部的stats中，便于按服务器汇总
+class pb_deflate_stream {
+public:
+    pb_deflate_stream(pb_compression_stats &stats, std::size_t min_size = pb_default_compress_min_size,
+                      int level = Z_DEFAULT_COMPRESSION)
+            : stats_(stats), min_size_(min_size) {
+        deflate_ok_ = deflateInit2(&deflate_, level, Z_DEFLATED, -window_bits, mem_level,
+                                   Z_DEFAULT_STRATEGY) == Z_OK;
+        inflate_ok_ = inflateInit2(&inflate_, -window_bits) == Z_OK;
+    }
+
+    ~pb_deflate_stream() {
+        if (deflate_ok_) {
+            deflateEnd(&deflate_);
+        }
+        if (inflate_ok_) {
+            inflateEnd(&inflate_);
+        }
+    }
+
+    pb_deflate_stream(const pb_deflate_stream &) = delete;
+    pb_deflate_stream &operator=(const pb_deflate_stream &) = delete;
+
+    std::size_t min_size() const {
+        return min_size_;
+    }
+
+    // 消息体不小于阈值时返回压缩后的新帧，否则原样返回frame。
+    // 压缩后没有变小时也发送压缩帧，保证对端的解压上下文和本端一致
+    pb_frame_ptr compress(pb_frame_pool &pool, const pb_frame_ptr &frame) {
+        std::uint32_t payload_size = 0;
+        int header_size = pb_decode_varint32(frame->data(), frame->size(), payload_size);
+        if (!deflate_ok_ || header_size <= 0 || payload_size == 0 || payload_size - 1 < min_size_) {
+            ++stats_.skipped_frames;
+            return frame;
+        }
+
+        std::uint64_t start = pb_thread_cpu_ns();
+        const std::uint8_t *payload = frame->data() + header_size;
+        std::size_t body_size = payload_size - 1;
+
+        scratch_.resize(deflateBound(&deflate_, static_cast<uLong>(body_size)) + sync_tail_length);
+        deflate_.next_in = const_cast<Bytef *>(payload + 1);
+        deflate_.avail_in = static_cast<uInt>(body_size);
+        deflate_.next_out = scratch_.data();
+        deflate_.avail_out = static_cast<uInt>(scratch_.size());
+        int ret = deflate(&deflate_, Z_SYNC_FLUSH);
+        // 输出缓冲区用完时同步刷新可能没有写完，压缩结果不完整，和解压一侧一样按失败处理
+        if (ret != Z_OK || deflate_.avail_in != 0 || deflate_.avail_out == 0) {
+            // 流状态已经不可信，之后不再压缩
+            deflate_ok_ = false;
+            ++stats_.skipped_frames;
+            return frame;
+        }
+
+        std::size_t compressed_size = scratch_.size() - deflate_.avail_out - sync_tail_length;
+        pb_frame_ptr result = pool.acquire();
+        result->assign(static_cast<std::uint8_t>(payload[0] | pb_compressed_flag),
+                       scratch_.data(), compressed_size);
+
+        ++stats_.compressed_frames;
+        stats_.raw_bytes += body_size;
+        stats_.compressed_bytes += compressed_size;
+        stats_.compress_cpu_ns += pb_thread_cpu_ns() - start;
+        return result;
+    }
+
+    // payload以带压缩标志的类型ID开头。解压到内部缓冲区后，payload/size指向去掉标志的完整消息，
+    // 在下一次调用前有效。数据非法或超过pb_max_frame_length时返回false
+    bool decompress(const std::uint8_t *&payload, std::size_t &size) {
+        if (!inflate_ok_ || size == 0) {
+            return false;
+        }
+
+        std::uint64_t start = pb_thread_cpu_ns();
+        static const std::uint8_t sync_tail[sync_tail_length] = {0x00, 0x00, 0xFF, 0xFF};
+
+        output_.resize(1 + pb_max_frame_length + 1);
+        output_[0] = static_cast<std::uint8_t>(payload[0] & ~pb_compressed_flag);
+        inflate_.next_out = output_.data() + 1;
+        inflate_.avail_out = static_cast<uInt>(output_.size() - 1);
+
+        if (!inflate_chunk(payload + 1, size - 1) || !inflate_chunk(sync_tail, sync_tail_length)) {
+            inflate_ok_ = false;
+            return false;
+        }
+
+        std::size_t body_size = output_.size() - 1 - inflate_.avail_out;
+        if (body_size > pb_max_frame_length) {
+            inflate_ok_ = false;
+            return false;
+        }
+
+        payload = output_.data();
+        size = 1 + body_size;
+        ++stats_.decompressed_frames;
+        stats_.decompress_cpu_ns += pb_thread_cpu_ns() - start;
+        return true;
+    }
+
+private:
+    enum {
+        window_bits = 15,
+        mem_level = 8,
+        sync_tail_length = 4
+    };
+
+    bool inflate_chunk(const std::uint8_t *data, std::size_t size) {
+        inflate_.next_in = const_cast<Bytef *>(data);
+        inflate_.avail_in = static_cast<uInt>(size);
+        while (inflate_.avail_in > 0) {
+            int ret = inflate(&inflate_, Z_SYNC_FLUSH);
+            if (ret != Z_OK || inflate_.avail_out == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    pb_compression_stats &stats_;
+    std::size_t min_size_;
+    z_stream deflate_{};
+    z_stream inflate_{};
+    bool deflate_ok_ = false;
+    bool inflate_ok_ = false;
+    std::vector<std::uint8_t> scratch_;
+    std::vector<std::uint8_t> output_;
+};
+
+#endif //TEST_ASIO_PB_COMPRESSION_H
@@ -0,0 +1,70 @@
+//
+// 按消息类型ID分发的处理表。
+// 路由就是一次数组下标访问，不需要按类型名查找或dynamic_cast；
+// 未注册的类型直接跳过，不会为它分配任何对象。
+//
+
+#ifndef TEST_ASIO_PB_DISPATCHER_H
+#define TEST_ASIO_PB_DISPATCHER_H
+
+#include <array>
+#include <cstdint>
+
+#include <google/protobuf/message_lite.h>
+
+#include "pb_arena.h"
+#include "pb_frame.h"
+#include "pb_message_types.h"
+
+template<typename Context>
+class pb_dispatcher {
+public:
+    enum {
+        table_size = 256
+    };
+
+    // 注册Context::*Handler处理消息T，Handler返回false时断开连接。
+    // 消息在本批次的Arena上，Handler可以直接取走其中的内容
+    template<typename T, bool (Context::*Handler)(T &)>
+    pb_dispatcher &on() {
+        entry &e = table_[static_cast<std::uint8_t>(pb_message_traits<T>::type)];
+        e.prototype = &T::default_instance();
+        e.invoke = &invoke<T, Handler>;
+        return *this;
+    }
+
+    // data/size为帧的消息体（含1字节类型ID），解析出的消息分配在arena上
+    bool dispatch(Context &context, const std::uint8_t *data, std::size_t size, pb_batch_arena &arena) const {
+        if (size == 0) {
+            return false;
+        }
+
+        const entry &e = table_[data[0]];
+        if (e.invoke == nullptr) {
+            return true;
+        }
+
+        google::protobuf::MessageLite *msg = e.prototype->New(&arena.arena());
+        if (!pb_parse_body(data + 1, size - 1, *msg)) {
+            return false;
+        }
+        return e.invoke(context, *msg);
+    }
+
+private:
+    typedef bool (*invoke_fn)(Context &, google::protobuf::MessageLite &);
+
+    struct entry {
+        const google::protobuf::MessageLite *prototype = nullptr;
+        invoke_fn invoke = nullptr;
+    };
+
+    template<typename T, bool (Context::*Handler)(T &)>
+    static bool invoke(Context &context, google::protobuf::MessageLite &msg) {
+        return (context.*Handler)(static_cast<T &>(msg));
+    }
+
+    std::array<entry, table_size> table_{};
+};
+
+#endif //TEST_ASIO_PB_DISPATCHER_H
@@ -0,0 +1,227 @@
+//
+// Protobuf帧格式：varint32长度前缀 + 1字节类型ID + 消息体，类型ID见pb_message_types.h。
+// 接收端直接在接收缓冲区上解析，发送端直接序列化到池化的输出缓冲区，
+// 中间不经过std::string。
+//
+
+#ifndef TEST_ASIO_PB_FRAME_H
+#define TEST_ASIO_PB_FRAME_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/message_lite.h>
+
+enum {
+    pb_max_varint32_length = 5,
+    pb_max_frame_length = 64 * 1024
+};
+
+class pb_frame_pool;
+
+// 一个完整的待发送帧，引用计数归零时自动回到所属的池中
+class pb_frame {
+public:
+    const std::uint8_t *data() const {
+        return data_.data();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    boost::asio::const_buffer buffer() const {
+        return boost::asio::buffer(data_.data(), size_);
+    }
+
+    // 写入长度前缀和类型ID并把消息序列化到帧内，返回消息体的字节数
+    std::size_t encode(std::uint8_t type, const google::protobuf::MessageLite &msg) {
+        std::size_t body_size = msg.ByteSizeLong();
+        std::size_t payload_size = 1 + body_size;
+        std::size_t header_size = google::protobuf::io::CodedOutputStream::VarintSize32(
+                static_cast<std::uint32_t>(payload_size));
+
+        size_ = header_size + payload_size;
+        if (data_.size() < size_) {
+            data_.resize(size_);
+        }
+
+        std::uint8_t *target = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+                static_cast<std::uint32_t>(payload_size), data_.data());
+        *target++ = type;
+        msg.SerializeWithCachedSizesToArray(target);
+        return body_size;
+    }
+
+    // 用已经编码好的消息体（例如压缩后的数据）组帧
+    void assign(std::uint8_t type, const std::uint8_t *body, std::size_t body_size) {
+        std::size_t payload_size = 1 + body_size;
+        std::size_t header_size = google::protobuf::io::CodedOutputStream::VarintSize32(
+                static_cast<std::uint32_t>(payload_size));
+
+        size_ = header_size + payload_size;
+        if (data_.size() < size_) {
+            data_.resize(size_);
+        }
+
+        std::uint8_t *target = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+                static_cast<std::uint32_t>(payload_size), data_.data());
+        *target++ = type;
+        std::memcpy(target, body, body_size);
+    }
+
+private:
+    friend class pb_frame_pool;
+
+    friend void intrusive_ptr_add_ref(pb_frame *frame) {
+        ++frame->ref_count_;
+    }
+
+    friend void intrusive_ptr_release(pb_frame *frame);
+
+    std::vector<std::uint8_t> data_;
+    std::size_t size_ = 0;
+    std::size_t ref_count_ = 0;
+    std::shared_ptr<std::vector<std::unique_ptr<pb_frame>>> owner_;
+};
+
+typedef boost::intrusive_ptr<pb_frame> pb_frame_ptr;
+
+// 帧缓冲区池，非线程安全，和使用它的io_context在同一线程中访问。
+// 空闲列表由所有帧共享持有，池先于帧销毁时帧仍可安全释放。
+class pb_frame_pool {
+public:
+    enum {
+        max_free_frames = 1024
+    };
+
+    pb_frame_pool()
+            : free_(std::make_shared<std::vector<std::unique_ptr<pb_frame>>>()) {
+        free_->reserve(max_free_frames);
+    }
+
+    pb_frame_ptr acquire() {
+        std::unique_ptr<pb_frame> frame;
+        if (free_->empty()) {
+            frame = std::make_unique<pb_frame>();
+        } else {
+            frame = std::move(free_->back());
+            free_->pop_back();
+        }
+        frame->owner_ = free_;
+        return pb_frame_ptr(frame.release());
+    }
+
+    pb_frame_ptr encode(std::uint8_t type, const google::protobuf::MessageLite &msg) {
+        pb_frame_ptr frame = acquire();
+        frame->encode(type, msg);
+        return frame;
+    }
+
+private:
+    std::shared_ptr<std::vector<std::unique_ptr<pb_frame>>> free_;
+};
+
+inline void intrusive_ptr_release(pb_frame *frame) {
+    if (--frame->ref_count_ != 0) {
+        return;
+    }
+
+    // 空闲的帧不持有池的引用，避免循环引用
+    auto owner = std::move(frame->owner_);
+    if (owner->size() < pb_frame_pool::max_free_frames && frame->data_.size() <= pb_max_frame_length) {
+        owner->emplace_back(frame);
+    } else {
+        delete frame;
+    }
+}
+
+// 解码varint32长度前缀。返回前缀的字节数；数据不足时返回0；前缀非法时返回-1
+inline int pb_decode_varint32(const std::uint8_t *data, std::size_t size, std::uint32_t &value) {
+    value = 0;
+    for (std::size_t i = 0; i < pb_max_varint32_length; ++i) {
+        if (i == size) {
+            return 0;
+        }
+        value |= static_cast<std::uint32_t>(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+            return static_cast<int>(i + 1);
+        }
+    }
+    return -1;
+}
+
+// 直接在接收缓冲区上解析消息体，不产生中间拷贝
+inline bool pb_parse_body(const std::uint8_t *data, std::size_t size, google::protobuf::MessageLite &msg) {
+    google::protobuf::io::ArrayInputStream stream(data, static_cast<int>(size));
+    google::protobuf::io::CodedInputStream input(&stream);
+    return msg.ParseFromCodedStream(&input) && input.ConsumedEntireMessage();
+}
+
+// 可复用的接收缓冲区，一次async_read_some之后取出所有完整的帧
+class pb_frame_reader {
+public:
+    enum {
+        default_capacity = 64 * 1024
+    };
+
+    explicit pb_frame_reader(std::size_t capacity = default_capacity)
+            : buffer_(capacity < max_frame_size ? max_frame_size : capacity) {
+    }
+
+    boost::asio::mutable_buffer prepare() {
+        if (buffer_.size() - end_ < max_frame_size && begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        return boost::asio::buffer(buffer_.data() + end_, buffer_.size() - end_);
+    }
+
+    void commit(std::size_t length) {
+        end_ += length;
+    }
+
+    // 对每个完整的帧调用handler(const std::uint8_t* payload, std::size_t size)，payload以类型ID开头，
+    // handler返回false或遇到非法的长度前缀时返回false
+    template<typename Handler>
+    bool parse(Handler &&handler) {
+        while (begin_ < end_) {
+            std::uint32_t body_size = 0;
+            int header_size = pb_decode_varint32(buffer_.data() + begin_, end_ - begin_, body_size);
+            if (header_size < 0 || body_size > pb_max_frame_length) {
+                return false;
+            }
+            if (header_size == 0 || end_ - begin_ < header_size + body_size) {
+                break;
+            }
+
+            if (!handler(buffer_.data() + begin_ + header_size, static_cast<std::size_t>(body_size))) {
+                return false;
+            }
+            begin_ += header_size + body_size;
+        }
+
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+        return true;
+    }
+
+private:
+    static constexpr std::size_t max_frame_size =
+            std::size_t(pb_max_varint32_length) + pb_max_frame_length;
+
+    std::vector<std::uint8_t> buffer_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+};
+
+#endif //TEST_ASIO_PB_FRAME_H
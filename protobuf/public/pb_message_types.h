@@ -0,0 +1,45 @@
+//
+// 线上的消息类型ID。每帧的消息体前有1字节类型ID：
+//     varint32(1 + body_size) | type_id | body
+// 新增消息时在这里分配ID并用PB_REGISTER_MESSAGE注册，ID一经使用不能修改。
+// 最高位是压缩标志（见pb_compression.h），ID只能使用0~127。
+//
+
+#ifndef TEST_ASIO_PB_MESSAGE_TYPES_H
+#define TEST_ASIO_PB_MESSAGE_TYPES_H
+
+#include <cstdint>
+
+#include "chat.pb.h"
+#include "pb_frame.h"
+
+enum class pb_message_type : std::uint8_t {
+    unknown = 0,
+    bind_name = 1,
+    chat = 2,
+    room_information = 3,
+    compression = 4,
+    ack = 5
+};
+
+template<typename T>
+struct pb_message_traits;
+
+#define PB_REGISTER_MESSAGE(message, id) \
+    template<> \
+    struct pb_message_traits<message> { \
+        static constexpr pb_message_type type = pb_message_type::id; \
+    }
+
+PB_REGISTER_MESSAGE(PBindName, bind_name);
+PB_REGISTER_MESSAGE(PChat, chat);
+PB_REGISTER_MESSAGE(PRoomInformation, room_information);
+PB_REGISTER_MESSAGE(PCompression, compression);
+PB_REGISTER_MESSAGE(PAck, ack);
+
+template<typename T>
+inline pb_frame_ptr pb_encode(pb_frame_pool &pool, const T &msg) {
+    return pool.encode(static_cast<std::uint8_t>(pb_message_traits<T>::type), msg);
+}
+
+#endif //TEST_ASIO_PB_MESSAGE_TYPES_H
@@ -1,22 +1,34 @@
 // https://www.boost.org/doc/libs/1_71_0/doc/html/boost_asio/example/cpp11/chat/chat_server.cpp
+// 消息改为protobuf/public/chat.proto中定义的PChat/PRoomInformation，帧格式见pb_frame.h
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <set>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <boost/asio.hpp>
 
-#include "chat/public/chat_message.h"
+#include "chat.pb.h"
+#include "protobuf/public/pb_frame.h"
+#include "protobuf/public/pb_arena.h"
+#include "protobuf/public/pb_compression.h"
+#include "protobuf/public/pb_dispatcher.h"
+#include "protobuf/public/pb_message_types.h"
+#include "public/command_line.h"
 
 using boost::asio::ip::tcp;
 
 //----------------------------------------------------------------------
 
-typedef std::deque<chat_message> chat_message_queue;
+typedef std::deque<pb_frame_ptr> pb_frame_queue;
 
 //----------------------------------------------------------------------
 
@@ -24,19 +36,32 @@ class chat_participant {
 public:
     virtual ~chat_participant() = default;
 
-    virtual void deliver(const chat_message &msg) = 0;
+    // 帧已经包含长度前缀，多个接收者共享同一个帧，不能修改
+    virtual void deliver(const pb_frame_ptr &frame) = 0;
 };
 
 typedef std::shared_ptr<chat_participant> chat_participant_ptr;
 
 //----------------------------------------------------------------------
 
+struct chat_room_stats {
+    std::uint64_t broadcasts = 0;
+    std::uint64_t serialized_bytes = 0;  // 实际序列化的字节数
+    std::uint64_t saved_bytes = 0;       // 共享帧省去的重复序列化字节数（广播+历史回放）
+};
+
 class chat_room {
 public:
+    explicit chat_room(pb_frame_pool &pool)
+            : pool_(pool), recent_frames_(max_recent_msgs) {
+    }
+
     void join(const chat_participant_ptr &participant) {
         participants_.insert(participant);
-        for (auto msg: recent_msgs_) {
-            participant->deliver(msg);
+        for (std::size_t i = 0; i < recent_count_; ++i) {
+            const pb_frame_ptr &frame = recent_frames_[(recent_head_ + i) % max_recent_msgs];
+            stats_.saved_bytes += frame->size();
+            participant->deliver(frame);
         }
     }
 
@@ -44,24 +69,52 @@ public:
         participants_.erase(participant);
     }
 
-    void deliver(const chat_message &msg) {
-        recent_msgs_.push_back(msg);
-        while (recent_msgs_.size() > max_recent_msgs) {
-            recent_msgs_.pop_front();
+    // 只序列化一次，所有接收者和历史记录共享同一个帧
+    void deliver(const PRoomInformation &msg) {
+        pb_frame_ptr frame = pb_encode(pool_, msg);
+        ++stats_.broadcasts;
+        stats_.serialized_bytes += frame->size();
+        if (!participants_.empty()) {
+            stats_.saved_bytes += frame->size() * (participants_.size() - 1);
+        }
+
+        if (recent_count_ < max_recent_msgs) {
+            recent_frames_[(recent_head_ + recent_count_++) % max_recent_msgs] = frame;
+        } else {
+            recent_frames_[recent_head_] = frame;
+            recent_head_ = (recent_head_ + 1) % max_recent_msgs;
         }
 
         for (const auto &participant: participants_) {
-            participant->deliver(msg);
+            participant->deliver(frame);
         }
     }
 
+    const chat_room_stats &stats() const {
+        return stats_;
+    }
+
+    std::size_t participant_count() const {
+        return participants_.size();
+    }
+
 private:
     enum {
         max_recent_msgs = 100
     };
 
+    pb_frame_pool &pool_;
     std::set<chat_participant_ptr> participants_;
-    chat_message_queue recent_msgs_;
+    std::vector<pb_frame_ptr> recent_frames_;
+    std::size_t recent_head_ = 0;
+    std::size_t recent_count_ = 0;
+    chat_room_stats stats_;
+};
+
+// 服务器端的压缩配置，客户端请求的阈值低于min_size时按min_size处理
+struct chat_compression_options {
+    bool enabled = true;
+    std::size_t min_size = pb_default_compress_min_size;
 };
 
 //----------------------------------------------------------------------
@@ -70,60 +123,170 @@ class chat_session
         : public chat_participant,
           public std::enable_shared_from_this<chat_session> {
 public:
-    chat_session(tcp::socket socket, chat_room &room)
-            : socket_(std::move(socket)), room_(room) {
+    chat_session(tcp::socket socket, chat_room &room, pb_frame_pool &pool, pb_batch_arena &arena,
+                 const chat_compression_options &compression, pb_compression_stats &compression_stats)
+            : socket_(std::move(socket)), room_(room), pool_(pool), arena_(arena),
+              compression_(compression), compression_stats_(compression_stats) {
+        boost::system::error_code ec;
+        auto endpoint = socket_.remote_endpoint(ec);
+        if (!ec) {
+            name_ = endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+        }
     }
 
     void start() {
+        // 广播帧和PAck常常分两次写出，关闭Nagle避免第二次写等待对端的延迟确认
+        boost::system::error_code ec;
+        socket_.set_option(tcp::no_delay(true), ec);
         room_.join(shared_from_this());
-        do_read_header();
+        do_read();
     }
 
-    void deliver(const chat_message &msg) override {
-        bool write_in_progress = !write_msgs_.empty();
-        write_msgs_.push_back(msg);
+    void deliver(const pb_frame_ptr &frame) override {
+        bool write_in_progress = !write_frames_.empty();
+        // 压缩上下文按连接延续，必须按入队顺序压缩；大帧因此不再和其他连接共享
+        write_frames_.push_back(codec_ ? codec_->compress(pool_, frame) : frame);
         if (!write_in_progress) {
             do_write();
         }
     }
 
 private:
-    void do_read_header() {
-        auto self(shared_from_this());
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.data(), chat_message::header_length),
-                                [this, self](boost::system::error_code ec, std::size_t /*length*/) {
-                                    if (!ec && read_msg_.decode_header()) {
-                                        do_read_body();
-                                    } else {
-                                        room_.leave(shared_from_this());
-                                    }
-                                });
+    enum {
+        max_gathered_frames = 64,
+        max_name_length = 256
+    };
+
+    static const pb_dispatcher<chat_session> &dispatcher() {
+        static const pb_dispatcher<chat_session> table = [] {
+            pb_dispatcher<chat_session> d;
+            d.on<PBindName, &chat_session::on_bind_name>()
+                    .on<PChat, &chat_session::on_chat>()
+                    .on<PCompression, &chat_session::on_compression>();
+            return d;
+        }();
+        return table;
+    }
+
+    // 带request_id的请求回复PAck；不带request_id时保持原来的行为，非法请求直接断开
+    bool reply(std::uint64_t request_id, std::uint32_t status = 0, const char *error = nullptr) {
+        if (request_id == 0) {
+            return status == 0;
+        }
+
+        PAck ack;
+        ack.set_request_id(request_id);
+        ack.set_status(status);
+        if (error != nullptr) {
+            ack.set_error(error);
+        }
+        deliver(pb_encode(pool_, ack));
+        return true;
+    }
+
+    bool on_bind_name(PBindName &msg) {
+        if (msg.name().empty()) {
+            return reply(msg.request_id(), 1, "empty name");
+        }
+        if (msg.name().size() > max_name_length) {
+            return reply(msg.request_id(), 1, "name too long");
+        }
+
+        name_ = msg.name();
+        return reply(msg.request_id());
+    }
+
+    bool on_chat(PChat &msg) {
+        auto *room_msg = arena_.create<PRoomInformation>();
+        room_msg->set_name(name_);
+        // 两个消息在同一个Arena上，直接交换内容，省去一次拷贝
+        room_msg->mutable_information()->swap(*msg.mutable_information());
+
+        // 加上发送者名字后的广播帧超出pb_max_frame_length时，所有客户端都会拒收并断开，
+        // 留在历史记录里还会让之后加入的客户端也断开，只能拒绝
+        if (1 + room_msg->ByteSizeLong() > std::size_t(pb_max_frame_length)) {
+            return reply(msg.request_id(), 1, "message too long");
+        }
+        room_.deliver(*room_msg);
+        return reply(msg.request_id());
+    }
+
+    bool on_compression(PCompression &msg) {
+        if (codec_) {
+            return false;
+        }
+
+        PCompression reply;
+        bool accept = compression_.enabled && msg.algorithm() == PCompression::DEFLATE;
+        if (accept) {
+            reply.set_algorithm(PCompression::DEFLATE);
+            reply.set_min_size(static_cast<std::uint32_t>(
+                    std::max<std::size_t>(msg.min_size(), compression_.min_size)));
+        }
+
+        if (!accept) {
+            deliver(pb_encode(pool_, reply));
+            return true;
+        }
+
+        // 回复本身不压缩，必须排在所有压缩帧之前；还没开始发送的帧（通常是加入房间时回放的历史）
+        // 排在回复之后，按顺序重新压缩
+        codec_ = std::make_unique<pb_deflate_stream>(compression_stats_, reply.min_size());
+        std::size_t in_flight = write_frames_.empty() ? 0 : write_buffers_.size();
+        auto pending = write_frames_.begin() + in_flight;
+        for (auto it = pending; it != write_frames_.end(); ++it) {
+            *it = codec_->compress(pool_, *it);
+        }
+        write_frames_.insert(pending, pb_encode(pool_, reply));
+        if (in_flight == 0) {
+            do_write();
+        }
+        return true;
+    }
+
+    bool on_frame(const std::uint8_t *data, std::size_t size) {
+        if (size > 0 && (data[0] & pb_compressed_flag) != 0) {
+            if (!codec_ || !codec_->decompress(data, size)) {
+                return false;
+            }
+        }
+        return dispatcher().dispatch(*this, data, size, arena_);
     }
 
-    void do_read_body() {
+    void do_read() {
         auto self(shared_from_this());
-        boost::asio::async_read(socket_,
-                                boost::asio::buffer(read_msg_.body(), read_msg_.body_length()),
-                                [this, self](boost::system::error_code ec, std::size_t /*length*/) {
+        socket_.async_read_some(reader_.prepare(),
+                                [this, self](boost::system::error_code ec, std::size_t length) {
                                     if (!ec) {
-                                        room_.deliver(read_msg_);
-                                        do_read_header();
-                                    } else {
-                                        room_.leave(shared_from_this());
+                                        reader_.commit(length);
+                                        bool ok = reader_.parse([this](const std::uint8_t *data, std::size_t size) {
+                                            return on_frame(data, size);
+                                        });
+                                        // 整批消息都已序列化进发送帧，Arena上的对象可以一次性释放
+                                        arena_.reset();
+                                        if (ok) {
+                                            do_read();
+                                            return;
+                                        }
                                     }
+                                    room_.leave(shared_from_this());
                                 });
     }
 
     void do_write() {
+        write_buffers_.clear();
+        for (auto it = write_frames_.begin();
+             it != write_frames_.end() && write_buffers_.size() < max_gathered_frames; ++it) {
+            write_buffers_.push_back((*it)->buffer());
+        }
+
         auto self(shared_from_this());
-        boost::asio::async_write(socket_,
-                                 boost::asio::buffer(write_msgs_.front().data(),
-                                                     write_msgs_.front().length()),
+        boost::asio::async_write(socket_, write_buffers_,
                                  [this, self](boost::system::error_code ec, std::size_t /*length*/) {
                                      if (!ec) {
-                                         write_msgs_.pop_front();
-                                         if (!write_msgs_.empty()) {
+                                         write_frames_.erase(write_frames_.begin(),
+                                                             write_frames_.begin() + write_buffers_.size());
+                                         if (!write_frames_.empty()) {
                                              do_write();
                                          }
                                      } else {
@@ -134,17 +297,31 @@ private:
 
     tcp::socket socket_;
     chat_room &room_;
-    chat_message read_msg_;
-    chat_message_queue write_msgs_;
+    pb_frame_pool &pool_;
+    pb_batch_arena &arena_;
+    const chat_compression_options &compression_;
+    pb_compression_stats &compression_stats_;
+    std::unique_ptr<pb_deflate_stream> codec_;
+    std::string name_ = "anonymous";
+
+    pb_frame_reader reader_;
+
+    pb_frame_queue write_frames_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
 };
 
 //----------------------------------------------------------------------
 
 class chat_server {
 public:
-    chat_server(boost::asio::io_context &io_context, const tcp::endpoint &endpoint)
-            : acceptor_(io_context, endpoint) {
+    chat_server(boost::asio::io_context &io_context, const tcp::endpoint &endpoint,
+                std::chrono::seconds stats_interval, const chat_compression_options &compression)
+            : acceptor_(io_context, endpoint), room_(pool_), compression_(compression),
+              stats_timer_(io_context), stats_interval_(stats_interval) {
         do_accept();
+        if (stats_interval_.count() > 0) {
+            do_report();
+        }
     }
 
 private:
@@ -152,32 +329,95 @@ private:
         acceptor_.async_accept(
                 [this](boost::system::error_code ec, tcp::socket socket) {
                     if (!ec) {
-                        std::make_shared<chat_session>(std::move(socket), room_)->start();
+                        std::make_shared<chat_session>(std::move(socket), room_, pool_, arena_,
+                                                       compression_, compression_stats_)->start();
                     }
 
                     do_accept();
                 });
     }
 
+    void do_report() {
+        stats_timer_.expires_after(stats_interval_);
+        stats_timer_.async_wait(
+                [this](boost::system::error_code ec) {
+                    if (ec) {
+                        return;
+                    }
+
+                    const chat_room_stats &stats = room_.stats();
+                    std::cout << "room[" << acceptor_.local_endpoint().port() << "]"
+                              << " participants=" << room_.participant_count()
+                              << " broadcasts=" << stats.broadcasts
+                              << " serialized_bytes=" << stats.serialized_bytes
+                              << " saved_bytes=" << stats.saved_bytes
+                              << std::endl;
+
+                    const pb_compression_stats &cs = compression_stats_;
+                    if (cs.compressed_frames + cs.decompressed_frames > 0) {
+                        std::cout << "compression[" << acceptor_.local_endpoint().port() << "]"
+                                  << " frames=" << cs.compressed_frames
+                                  << " skipped=" << cs.skipped_frames
+                                  << " raw_bytes=" << cs.raw_bytes
+                                  << " compressed_bytes=" << cs.compressed_bytes
+                                  << " ratio=" << cs.ratio()
+                                  << " compress_cpu_us=" << cs.compress_cpu_ns / 1000
+                                  << " inflated_frames=" << cs.decompressed_frames
+                                  << " decompress_cpu_us=" << cs.decompress_cpu_ns / 1000
+                                  << std::endl;
+                    }
+
+                    do_report();
+                });
+    }
+
     tcp::acceptor acceptor_;
+    pb_frame_pool pool_;
     chat_room room_;
+    // 所有会话都在同一个io_context线程中逐批处理，可以共用一个Arena
+    pb_batch_arena arena_;
+    chat_compression_options compression_;
+    pb_compression_stats compression_stats_;
+    boost::asio::steady_timer stats_timer_;
+    std::chrono::seconds stats_interval_;
 };
 
 //----------------------------------------------------------------------
 
 int main(int argc, char *argv[]) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
     try {
-        if (argc < 2) {
-            std::cerr << "Usage: chat_server <port> [<port> ...]\n";
+        std::chrono::seconds stats_interval(0);
+        chat_compression_options compression;
+        int first_port = 1;
+        for (; first_port < argc && std::strncmp(argv[first_port], "--", 2) == 0; ++first_port) {
+            const char *arg = argv[first_port];
+            const char *value = nullptr;
+            if ((value = parse_option(arg, "--stats-interval"))) {
+                stats_interval = std::chrono::seconds(std::atoi(value));
+            } else if ((value = parse_option(arg, "--compression"))) {
+                compression.enabled = std::strcmp(value, "off") != 0;
+            } else if ((value = parse_option(arg, "--compress-min-size"))) {
+                compression.min_size = std::strtoul(value, nullptr, 10);
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
+
+        if (first_port >= argc) {
+            std::cerr << "Usage: protobuf_server [--stats-interval=<seconds>] [--compression=deflate|off]"
+                         " [--compress-min-size=<bytes>] <port> [<port> ...]\n";
             return 1;
         }
 
         boost::asio::io_context io_context;
 
         std::list<chat_server> servers;
-        for (int i = 1; i < argc; ++i) {
+        for (int i = first_port; i < argc; ++i) {
             tcp::endpoint endpoint(tcp::v4(), std::atoi(argv[i]));
-            servers.emplace_back(io_context, endpoint);
+            servers.emplace_back(io_context, endpoint, stats_interval, compression);
         }
 
         io_context.run();
@@ -186,5 +426,6 @@ int main(int argc, char *argv[]) {
         std::cerr << "Exception: " << e.what() << "\n";
     }
 
+    google::protobuf::ShutdownProtobufLibrary();
     return 0;
 }
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include "public/latency_histogram.h"
+
+// 压测程序共用的运行骨架：
+// 每个线程一个worker，worker里有自己的io_context，统计数据只在所属线程中修改，结束后再汇总；
+// 主线程依次切换 connecting -> warmup -> measuring -> done，客户端只在measuring阶段计数。
+
+using bench_clock = std::chrono::steady_clock;
+
+enum class bench_phase
+{
+	connecting,
+	warmup,
+	measuring,
+	done
+};
+
+// 为每个worker启动一个线程运行它的io_context，没有挂起的操作时线程也不退出
+template<typename Worker>
+std::vector<std::thread> start_bench_threads(std::vector<std::unique_ptr<Worker>>& workers)
+{
+	std::vector<std::thread> threads;
+	for (auto& worker : workers)
+	{
+		threads.emplace_back([&worker]()
+		{
+			auto work_guard = boost::asio::make_work_guard(worker->io_context);
+			worker->io_context.run();
+		});
+	}
+	return threads;
+}
+
+template<typename Worker>
+void stop_bench_threads(std::vector<std::unique_ptr<Worker>>& workers, std::vector<std::thread>& threads)
+{
+	for (auto& worker : workers)
+	{
+		worker->io_context.stop();
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+}
+
+// 最多等30秒，直到所有连接建立
+inline void wait_bench_connected(const std::atomic<std::size_t>& connected, std::size_t connections)
+{
+	auto deadline = bench_clock::now() + std::chrono::seconds(30);
+	while (connected < connections && bench_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::cerr << connected << "/" << connections << " connections established\n";
+}
+
+// 预热warmup秒后开始统计，统计duration秒后进入done，返回实际的统计秒数
+inline double run_bench_phases(std::atomic<bench_phase>& phase, int warmup, int duration)
+{
+	phase = bench_phase::warmup;
+	std::this_thread::sleep_for(std::chrono::seconds(warmup));
+
+	auto start = bench_clock::now();
+	phase = bench_phase::measuring;
+	std::this_thread::sleep_for(std::chrono::seconds(duration));
+	phase = bench_phase::done;
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// 以 "name": {...} 的形式输出一个纳秒直方图，单位为微秒
+inline void write_latency_json(std::ostream& os, const char* name, const latency_histogram& h, bool last)
+{
+	auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+	os << "  \"" << name << "\": {\n"
+		<< "    \"min\": " << us(h.min()) << ",\n"
+		<< "    \"mean\": " << h.mean() / 1000.0 << ",\n"
+		<< "    \"p50\": " << us(h.percentile(50.0)) << ",\n"
+		<< "    \"p99\": " << us(h.percentile(99.0)) << ",\n"
+		<< "    \"p99_9\": " << us(h.percentile(99.9)) << ",\n"
+		<< "    \"max\": " << us(h.max()) << "\n"
+		<< "  }" << (last ? "\n" : ",\n");
+}
+
+// 结果写到output指定的文件，为空时写到stdout
+template<typename Write>
+void write_bench_output(const std::string& output, Write&& write)
+{
+	if (output.empty())
+	{
+		write(std::cout);
+		return;
+	}
+
+	std::ofstream file(output);
+	write(file);
+	std::cerr << "results written to " << output << "\n";
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstring>
+
+// 解析形如 --name=value 的参数，匹配成功时返回value
+inline const char* parse_option(const char* arg, const char* name)
+{
+	std::size_t length = std::strlen(name);
+	if (std::strncmp(arg, name, length) == 0 && arg[length] == '=')
+	{
+		return arg + length + 1;
+	}
+	return nullptr;
+}
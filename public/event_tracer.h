@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 低开销的事件跟踪：每个线程一个固定大小的环形缓冲区，只由本线程写入，写满后覆盖最旧的事件。
+// 记录一个事件只是读一次时钟、写几个字段、发布一次写位置，不加锁也不做格式化；
+// 导出时才把所有线程的缓冲区合并成Chrome trace（chrome://tracing、Perfetto可直接打开）的JSON。
+// 用TEST_ASIO_HANDLER_TRACE编译时public/handler_tracking.h会记录每个handler的创建（post/dispatch/async_*）、
+// 开始和结束执行，并用flow事件把创建和执行连起来，可以看到handler跨线程的流转；
+// 其他代码（例如Connection的状态变化）直接调用instant记录。
+// 默认关闭，enable之后才开始记录，关闭时每个记录点只多一次relaxed原子读。
+// 事件的名字和类别必须是静态字符串，缓冲区只保存指针。
+class event_tracer
+{
+public:
+	enum class event_type : std::uint8_t
+	{
+		created,        // 异步操作发起或handler投递
+		begin,          // handler开始执行
+		end,            // handler执行结束
+		instant,        // 其他时刻事件
+	};
+
+	/// 开始记录，capacity为每个线程缓冲区的事件数（向上取2的幂），只在第一次调用时生效
+	static void enable(std::size_t capacity = 65536)
+	{
+		std::size_t size = 1024;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		std::size_t expected = 0;
+		instance()._capacity.compare_exchange_strong(expected, size);
+		instance()._enabled.store(true, std::memory_order_release);
+	}
+
+	static void disable()
+	{
+		instance()._enabled.store(false, std::memory_order_release);
+	}
+
+	static bool enabled()
+	{
+		return instance()._enabled.load(std::memory_order_relaxed);
+	}
+
+	/// 给当前线程命名，导出为Chrome trace的线程名
+	static void set_thread_name(const std::string& name)
+	{
+		thread_buffer* buffer = this_thread();
+		std::lock_guard<std::mutex> lock(instance()._mutex);
+		buffer->name = name;
+	}
+
+	/// 本线程内唯一、跨线程不重复的handler编号
+	static std::uint64_t next_id()
+	{
+		thread_buffer* buffer = this_thread();
+		return (buffer->index + 1) << 40 | ++buffer->next_id;
+	}
+
+	static void record(event_type type, const char* name, const char* category, std::uint64_t id,
+		std::int64_t arg0 = 0, std::int64_t arg1 = -1)
+	{
+		if (!enabled())
+		{
+			return;
+		}
+
+		thread_buffer* buffer = this_thread();
+		if (buffer->events.empty())
+		{
+			buffer->allocate(instance()._capacity.load(std::memory_order_relaxed));
+		}
+
+		std::uint64_t position = buffer->written.load(std::memory_order_relaxed);
+		event& e = buffer->events[position & (buffer->events.size() - 1)];
+		e.timestamp_ns.store(now_ns(), std::memory_order_relaxed);
+		e.id.store(id, std::memory_order_relaxed);
+		e.name.store(name, std::memory_order_relaxed);
+		e.category.store(category, std::memory_order_relaxed);
+		e.arg0.store(arg0, std::memory_order_relaxed);
+		e.arg1.store(arg1, std::memory_order_relaxed);
+		e.type.store(type, std::memory_order_relaxed);
+		buffer->written.store(position + 1, std::memory_order_release);
+	}
+
+	/// 时刻事件，value导出为args.value
+	static void instant(const char* name, const char* category, std::uint64_t id, std::int64_t value)
+	{
+		record(event_type::instant, name, category, id, value);
+	}
+
+	/// 合并所有线程的缓冲区，按Chrome trace的JSON格式输出。可以在记录的同时调用，正在被覆盖的事件会被丢弃
+	static void write_chrome_trace(std::ostream& os)
+	{
+		std::vector<std::pair<std::string, std::vector<event_copy>>> threads;
+		{
+			std::lock_guard<std::mutex> lock(instance()._mutex);
+			for (const auto& buffer : instance()._buffers)
+			{
+				threads.emplace_back(buffer->name, buffer->snapshot());
+			}
+		}
+
+		char line[512];
+		os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+		bool first = true;
+		auto emit = [&](const char* text)
+		{
+			os << (first ? "" : ",\n") << text;
+			first = false;
+		};
+
+		for (std::size_t tid = 0; tid < threads.size(); ++tid)
+		{
+			std::snprintf(line, sizeof(line),
+				"{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+				tid, threads[tid].first.c_str());
+			emit(line);
+
+			for (const event_copy& e : threads[tid].second)
+			{
+				// 时间戳单位是微秒，保留纳秒精度
+				double ts = e.timestamp_ns / 1000.0;
+				switch (e.type)
+				{
+				case event_type::created:
+					std::snprintf(line, sizeof(line),
+						"{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,"
+						"\"args\":{\"id\":%llu}},\n"
+						"{\"ph\":\"s\",\"name\":\"handler\",\"cat\":\"flow\",\"id\":%llu,\"pid\":1,\"tid\":%zu,\"ts\":%.3f}",
+						e.name, e.category, tid, ts, static_cast<unsigned long long>(e.id),
+						static_cast<unsigned long long>(e.id), tid, ts);
+					break;
+				case event_type::begin:
+					std::snprintf(line, sizeof(line),
+						"{\"ph\":\"B\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,"
+						"\"args\":{\"id\":%llu,\"error\":%lld,\"bytes\":%lld}},\n"
+						"{\"ph\":\"f\",\"bp\":\"e\",\"name\":\"handler\",\"cat\":\"flow\",\"id\":%llu,\"pid\":1,\"tid\":%zu,\"ts\":%.3f}",
+						e.name, e.category, tid, ts, static_cast<unsigned long long>(e.id),
+						static_cast<long long>(e.arg0), static_cast<long long>(e.arg1),
+						static_cast<unsigned long long>(e.id), tid, ts);
+					break;
+				case event_type::end:
+					std::snprintf(line, sizeof(line),
+						"{\"ph\":\"E\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f}", tid, ts);
+					break;
+				case event_type::instant:
+					std::snprintf(line, sizeof(line),
+						"{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,"
+						"\"args\":{\"id\":%llu,\"value\":%lld}}",
+						e.name, e.category, tid, ts, static_cast<unsigned long long>(e.id),
+						static_cast<long long>(e.arg0));
+					break;
+				}
+				emit(line);
+			}
+		}
+		os << "\n]}\n";
+	}
+
+	/// 输出到文件，成功返回true
+	static bool write_chrome_trace(const std::string& path)
+	{
+		std::ofstream out(path, std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		write_chrome_trace(out);
+		return static_cast<bool>(out);
+	}
+
+private:
+	// 字段用relaxed原子量，导出线程和写入线程并发访问时没有数据竞争，写入仍然是普通的mov
+	struct event
+	{
+		std::atomic<std::uint64_t> timestamp_ns{0};
+		std::atomic<std::uint64_t> id{0};
+		std::atomic<const char*> name{nullptr};
+		std::atomic<const char*> category{nullptr};
+		std::atomic<std::int64_t> arg0{0};
+		std::atomic<std::int64_t> arg1{0};
+		std::atomic<event_type> type{event_type::instant};
+	};
+
+	struct event_copy
+	{
+		std::uint64_t timestamp_ns;
+		std::uint64_t id;
+		const char* name;
+		const char* category;
+		std::int64_t arg0;
+		std::int64_t arg1;
+		event_type type;
+	};
+
+	struct thread_buffer
+	{
+		std::string name;
+		std::uint64_t index = 0;
+		std::uint64_t next_id = 0;
+		std::vector<event> events;
+		std::atomic<std::uint64_t> written{0};
+
+		// 只在本线程中调用，之后大小不再变化
+		void allocate(std::size_t capacity)
+		{
+			std::vector<event> storage(capacity);
+			std::lock_guard<std::mutex> lock(instance()._mutex);
+			events.swap(storage);
+		}
+
+		// 在登记表的锁内调用，缓冲区不会被重新分配
+		std::vector<event_copy> snapshot() const
+		{
+			std::vector<event_copy> result;
+			if (events.empty())
+			{
+				return result;
+			}
+
+			std::uint64_t capacity = events.size();
+			std::uint64_t end = written.load(std::memory_order_acquire);
+			std::uint64_t begin = end > capacity ? end - capacity : 0;
+			result.reserve(end - begin);
+			for (std::uint64_t i = begin; i < end; ++i)
+			{
+				const event& e = events[i & (capacity - 1)];
+				result.push_back(event_copy{ e.timestamp_ns.load(std::memory_order_relaxed),
+					e.id.load(std::memory_order_relaxed), e.name.load(std::memory_order_relaxed),
+					e.category.load(std::memory_order_relaxed), e.arg0.load(std::memory_order_relaxed),
+					e.arg1.load(std::memory_order_relaxed), e.type.load(std::memory_order_relaxed) });
+			}
+
+			// 复制期间写入线程又写了多少，被覆盖的那部分丢弃。写入线程可能正在填写位置after，
+			// 它和after - capacity共用一个槽位，这个位置也可能是撕裂的，一并丢弃
+			std::uint64_t after = written.load(std::memory_order_acquire);
+			std::uint64_t overwritten = after + 1 > capacity ? after + 1 - capacity : 0;
+			if (overwritten > begin)
+			{
+				result.erase(result.begin(), result.begin() + std::min<std::uint64_t>(overwritten - begin, result.size()));
+			}
+
+			// 环形缓冲区开头可能是丢失了B的E，导出前去掉，避免查看器里出现不成对的结束
+			while (!result.empty() && result.front().type == event_type::end)
+			{
+				result.erase(result.begin());
+			}
+			return result;
+		}
+	};
+
+	static std::uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static event_tracer& instance()
+	{
+		static event_tracer tracer;
+		return tracer;
+	}
+
+	static thread_buffer* this_thread()
+	{
+		thread_local thread_buffer* buffer = instance().add_thread();
+		return buffer;
+	}
+
+	thread_buffer* add_thread()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_buffers.push_back(std::make_unique<thread_buffer>());
+		thread_buffer* buffer = _buffers.back().get();
+		buffer->index = _buffers.size() - 1;
+		buffer->name = "thread-" + std::to_string(buffer->index);
+		return buffer;
+	}
+
+	std::atomic<bool> _enabled{false};
+	std::atomic<std::size_t> _capacity{0};
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<thread_buffer>> _buffers;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+
+// 对象自带的handler内存，按asio的关联分配器（associated_allocator）机制为异步操作提供操作对象的存储。
+// 异步操作完成时asio先释放操作对象再调用handler，所以读→写→读这样串行的一串操作可以反复复用同一块内存，
+// 稳态下不再调用operator new。一块内存同一时刻只能被一个未完成的操作使用：
+// 会同时挂起的操作（例如读和写、读和超时定时器）各用一个handler_memory。
+// 非线程安全，分配和释放由同一个对象的串行操作完成。
+class handler_memory
+{
+public:
+	enum
+	{
+		storage_size = 1024
+	};
+
+	handler_memory() = default;
+	handler_memory(const handler_memory&) = delete;
+	handler_memory& operator=(const handler_memory&) = delete;
+
+	void* allocate(std::size_t size)
+	{
+		if (!_in_use && size <= sizeof(_storage))
+		{
+			_in_use = true;
+			return &_storage;
+		}
+
+		// 正在使用或操作对象过大时退回到堆上
+		++_fallbacks;
+		return ::operator new(size);
+	}
+
+	void deallocate(void* pointer)
+	{
+		if (pointer == &_storage)
+		{
+			_in_use = false;
+		}
+		else
+		{
+			::operator delete(pointer);
+		}
+	}
+
+	/// 没能使用内置存储的次数，稳态下应保持不变
+	std::uint64_t fallbacks() const
+	{
+		return _fallbacks;
+	}
+
+private:
+	alignas(std::max_align_t) unsigned char _storage[storage_size];
+	bool _in_use = false;
+	std::uint64_t _fallbacks = 0;
+};
+
+// 定时器cancel之后立即重新async_wait时，被取消的等待在它的handler执行前还占着原来的内存，
+// 两块handler_memory交替使用，新的等待总是拿到另一块
+class alternating_handler_memory
+{
+public:
+	handler_memory& next()
+	{
+		_current ^= 1;
+		return _memory[_current];
+	}
+
+	std::uint64_t fallbacks() const
+	{
+		return _memory[0].fallbacks() + _memory[1].fallbacks();
+	}
+
+private:
+	handler_memory _memory[2];
+	std::size_t _current = 0;
+};
+
+template<typename T>
+class handler_allocator
+{
+public:
+	using value_type = T;
+
+	explicit handler_allocator(handler_memory& memory)
+		: _memory(memory)
+	{
+	}
+
+	template<typename U>
+	handler_allocator(const handler_allocator<U>& other) noexcept
+		: _memory(other._memory)
+	{
+	}
+
+	T* allocate(std::size_t n) const
+	{
+		return static_cast<T*>(_memory.allocate(sizeof(T) * n));
+	}
+
+	void deallocate(T* p, std::size_t /*n*/) const
+	{
+		_memory.deallocate(p);
+	}
+
+	bool operator==(const handler_allocator& other) const noexcept
+	{
+		return &_memory == &other._memory;
+	}
+
+	bool operator!=(const handler_allocator& other) const noexcept
+	{
+		return &_memory != &other._memory;
+	}
+
+private:
+	template<typename>
+	friend class handler_allocator;
+
+	handler_memory& _memory;
+};
+
+// 给handler关联上handler_memory的分配器，其余行为和原handler一致
+template<typename Handler>
+class custom_alloc_handler
+{
+public:
+	using allocator_type = handler_allocator<Handler>;
+
+	custom_alloc_handler(handler_memory& memory, Handler handler)
+		: _memory(memory), _handler(std::move(handler))
+	{
+	}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return allocator_type(_memory);
+	}
+
+	template<typename... Args>
+	void operator()(Args&&... args)
+	{
+		_handler(std::forward<Args>(args)...);
+	}
+
+	const Handler& handler() const
+	{
+		return _handler;
+	}
+
+private:
+	handler_memory& _memory;
+	Handler _handler;
+};
+
+template<typename Handler>
+inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_memory& memory, Handler handler)
+{
+	return custom_alloc_handler<Handler>(memory, std::move(handler));
+}
+
+namespace boost
+{
+namespace asio
+{
+
+// 包装后仍使用原handler关联的执行器（例如bind_executor绑定的strand）
+template<typename Handler, typename Executor>
+struct associated_executor<custom_alloc_handler<Handler>, Executor>
+{
+	typedef typename associated_executor<Handler, Executor>::type type;
+
+	static type get(const custom_alloc_handler<Handler>& h, const Executor& ex = Executor()) noexcept
+	{
+		return associated_executor<Handler, Executor>::get(h.handler(), ex);
+	}
+};
+
+}
+}
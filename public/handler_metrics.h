@@ -0,0 +1,384 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(TEST_ASIO_HANDLER_METRICS) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// io_context运行时指标：每个线程执行的handler数、handler执行时间分布、忙碌和空闲时间，
+// 以及投递到执行的调度延迟（需要set_scheduling_delay_enabled打开）。
+// 数据由public/handler_tracking.h中的asio handler跟踪钩子记录，需要用TEST_ASIO_HANDLER_METRICS选项编译，
+// 未打开时enabled()为false，导出的计数全部为0，asio内部也没有任何额外开销。
+// 每个线程第一次记录时在全局注册表中登记一份自己的统计（只在登记时加锁），之后只由本线程写入；
+// 导出时其他线程用relaxed原子读，不加锁也不打断工作线程。线程退出后统计保留，数值不再变化。
+class handler_metrics
+{
+public:
+	// 以纳秒为单位的2的幂分桶：第i个桶统计[2^(i-1), 2^i)
+	class log2_histogram
+	{
+	public:
+		enum
+		{
+			bucket_count = 40     // 上限约9分钟
+		};
+
+		// 单写者，读取和写入不需要原子的读-改-写
+		void record(std::uint64_t ns)
+		{
+			std::size_t index = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+			if (index >= bucket_count)
+			{
+				index = bucket_count - 1;
+			}
+			bump(_buckets[index], 1);
+			bump(_sum, ns);
+		}
+
+		std::uint64_t bucket(std::size_t index) const
+		{
+			return _buckets[index].load(std::memory_order_relaxed);
+		}
+
+		/// 第index个桶的上界（纳秒）
+		static std::uint64_t upper_bound(std::size_t index)
+		{
+			return std::uint64_t(1) << index;
+		}
+
+		std::uint64_t sum() const
+		{
+			return _sum.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::array<std::atomic<std::uint64_t>, bucket_count> _buckets{};
+		std::atomic<std::uint64_t> _sum{0};
+	};
+
+	struct thread_stats
+	{
+		std::string name;
+		std::uint64_t started_ns = 0;
+		std::atomic<std::uint64_t> created{0};          // 本线程发起的异步操作和投递
+		std::atomic<std::uint64_t> finished{0};         // 本线程执行或销毁的handler
+		std::atomic<std::uint64_t> handlers{0};         // 本线程执行的handler
+		std::atomic<std::uint64_t> busy_ns{0};          // 执行最外层handler的时间
+		log2_histogram execution;                       // handler执行时间
+		log2_histogram scheduling_delay;                // post/dispatch/defer投递到开始执行的时间
+		int depth = 0;                                  // handler嵌套深度，只有本线程访问
+	};
+
+	static constexpr bool enabled()
+	{
+#if defined(TEST_ASIO_HANDLER_METRICS)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/// 是否统计投递到执行的调度延迟。需要在投递时多读一次时钟，默认关闭，
+	/// 打开前已经投递的handler不计入
+	static void set_scheduling_delay_enabled(bool enabled)
+	{
+		_scheduling_delay_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	static bool scheduling_delay_enabled()
+	{
+		return _scheduling_delay_enabled.load(std::memory_order_relaxed);
+	}
+
+	// 打开统计时，x86上直接读TSC再按第一次调用时校准的系数换算成纳秒，比steady_clock::now()便宜约一半。
+	// 每个handler执行前后各读一次，是打开统计后的主要开销。假定TSC恒定频率且各核同步（constant_tsc）
+	static std::uint64_t now_ns()
+	{
+#if defined(TEST_ASIO_HANDLER_METRICS) && defined(__x86_64__)
+		static const std::uint64_t scale = calibrate_tsc();
+		return static_cast<std::uint64_t>((static_cast<unsigned __int128>(__rdtsc()) * scale) >> 32);
+#else
+		return steady_ns();
+#endif
+	}
+
+	/// 当前线程的统计，第一次调用时登记
+	static thread_stats& this_thread()
+	{
+		thread_local thread_stats* stats = registry().add();
+		return *stats;
+	}
+
+	/// 给当前线程命名，导出时作为thread标签，在线程开始运行io_context前调用
+	static void set_thread_name(const std::string& name)
+	{
+		thread_stats& stats = this_thread();
+		std::lock_guard<std::mutex> lock(registry()._mutex);
+		stats.name = name;
+	}
+
+	static void on_created()
+	{
+		bump(this_thread().created, 1);
+	}
+
+	// 下面三个由同一次完成调用，stats是调用方取一次this_thread()的结果。
+	// 返回开始时间，传给on_invocation_end；created_ns为0表示没有记录投递时间
+	static std::uint64_t on_invocation_begin(thread_stats& stats, std::uint64_t created_ns)
+	{
+		std::uint64_t start = now_ns();
+		if (created_ns != 0 && start > created_ns)
+		{
+			stats.scheduling_delay.record(start - created_ns);
+		}
+		++stats.depth;
+		return start;
+	}
+
+	static void on_invocation_end(thread_stats& stats, std::uint64_t start_ns)
+	{
+		std::uint64_t end = now_ns();
+		std::uint64_t elapsed = end > start_ns ? end - start_ns : 0;
+		stats.execution.record(elapsed);
+		bump(stats.handlers, 1);
+		// 嵌套执行（例如strand内部的handler）的时间已经包含在外层handler里
+		if (--stats.depth == 0)
+		{
+			bump(stats.busy_ns, elapsed);
+		}
+	}
+
+	static void on_finished(thread_stats& stats)
+	{
+		bump(stats.finished, 1);
+	}
+
+	/// Prometheus文本格式
+	static void write_prometheus(std::ostream& os)
+	{
+		auto threads = registry().snapshot();
+		std::uint64_t now = now_ns();
+		char line[256];
+
+		os << "# HELP asio_handler_metrics_enabled Whether handler tracking is compiled in.\n"
+			<< "# TYPE asio_handler_metrics_enabled gauge\n"
+			<< "asio_handler_metrics_enabled " << (enabled() ? 1 : 0) << "\n";
+
+		os << "# HELP asio_handlers_total Handlers executed.\n# TYPE asio_handlers_total counter\n";
+		for (const auto& t : threads)
+		{
+			os << "asio_handlers_total{thread=\"" << t.name << "\"} " << t.handlers << "\n";
+		}
+
+		os << "# HELP asio_handlers_outstanding Handlers created but not yet executed or destroyed, across all threads.\n"
+			<< "# TYPE asio_handlers_outstanding gauge\n";
+		std::uint64_t created = 0;
+		std::uint64_t finished = 0;
+		for (const auto& t : threads)
+		{
+			created += t.created;
+			finished += t.finished;
+		}
+		os << "asio_handlers_outstanding " << (created > finished ? created - finished : 0) << "\n";
+
+		os << "# HELP asio_thread_busy_seconds_total Time spent executing handlers.\n"
+			<< "# TYPE asio_thread_busy_seconds_total counter\n";
+		for (const auto& t : threads)
+		{
+			std::snprintf(line, sizeof(line), "asio_thread_busy_seconds_total{thread=\"%s\"} %.9f\n",
+				t.name.c_str(), t.busy_ns / 1e9);
+			os << line;
+		}
+
+		os << "# HELP asio_thread_idle_seconds_total Time since the thread was registered not spent executing handlers.\n"
+			<< "# TYPE asio_thread_idle_seconds_total counter\n";
+		for (const auto& t : threads)
+		{
+			std::uint64_t wall = now - t.stats->started_ns;
+			std::snprintf(line, sizeof(line), "asio_thread_idle_seconds_total{thread=\"%s\"} %.9f\n",
+				t.name.c_str(), wall > t.busy_ns ? (wall - t.busy_ns) / 1e9 : 0.0);
+			os << line;
+		}
+
+		write_prometheus_histogram(os, threads, "asio_handler_execution_seconds",
+			"Handler execution time.", &thread_stats::execution);
+		write_prometheus_histogram(os, threads, "asio_handler_scheduling_delay_seconds",
+			"Time from post/dispatch/defer to the start of execution, when enabled.", &thread_stats::scheduling_delay);
+	}
+
+	/// JSON格式，直方图只输出非空的桶
+	static void write_json(std::ostream& os)
+	{
+		auto threads = registry().snapshot();
+		std::uint64_t now = now_ns();
+
+		os << "{\"enabled\":" << (enabled() ? "true" : "false") << ",\"threads\":[";
+		for (std::size_t i = 0; i < threads.size(); ++i)
+		{
+			const auto& t = threads[i];
+			std::uint64_t wall = now - t.stats->started_ns;
+			os << (i > 0 ? "," : "")
+				<< "{\"thread\":\"" << t.name << "\""
+				<< ",\"handlers\":" << t.handlers
+				<< ",\"created\":" << t.created
+				<< ",\"finished\":" << t.finished
+				<< ",\"busy_ns\":" << t.busy_ns
+				<< ",\"idle_ns\":" << (wall > t.busy_ns ? wall - t.busy_ns : 0)
+				<< ",\"execution_ns\":";
+			write_json_histogram(os, t.stats->execution);
+			os << ",\"scheduling_delay_ns\":";
+			write_json_histogram(os, t.stats->scheduling_delay);
+			os << "}";
+		}
+		os << "]}\n";
+	}
+
+private:
+	// 导出时读取的一份计数，名字在登记表的锁内复制
+	struct thread_snapshot
+	{
+		const thread_stats* stats;
+		std::string name;
+		std::uint64_t created;
+		std::uint64_t finished;
+		std::uint64_t handlers;
+		std::uint64_t busy_ns;
+	};
+
+	class registry_type
+	{
+	public:
+		thread_stats* add()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_threads.push_back(std::make_unique<thread_stats>());
+			thread_stats* stats = _threads.back().get();
+			stats->name = "thread-" + std::to_string(_threads.size() - 1);
+			stats->started_ns = now_ns();
+			return stats;
+		}
+
+		std::vector<thread_snapshot> snapshot()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::vector<thread_snapshot> result;
+			for (const auto& t : _threads)
+			{
+				result.push_back(thread_snapshot{ t.get(), t->name,
+					t->created.load(std::memory_order_relaxed),
+					t->finished.load(std::memory_order_relaxed),
+					t->handlers.load(std::memory_order_relaxed),
+					t->busy_ns.load(std::memory_order_relaxed) });
+			}
+			return result;
+		}
+
+		std::mutex _mutex;
+
+	private:
+		std::vector<std::unique_ptr<thread_stats>> _threads;
+	};
+
+	static std::uint64_t steady_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+#if defined(TEST_ASIO_HANDLER_METRICS) && defined(__x86_64__)
+	// 第一次读时钟时用steady_clock测5ms内的TSC计数，得到每个TSC周期的纳秒数（32位定点小数）
+	static std::uint64_t calibrate_tsc()
+	{
+		std::uint64_t start_ns = steady_ns();
+		std::uint64_t start_tsc = __rdtsc();
+		std::uint64_t end_ns;
+		do
+		{
+			end_ns = steady_ns();
+		} while (end_ns - start_ns < 5000000);
+		std::uint64_t ticks = __rdtsc() - start_tsc;
+		return ((end_ns - start_ns) << 32) / (ticks != 0 ? ticks : 1);
+	}
+#endif
+
+	inline static std::atomic<bool> _scheduling_delay_enabled{false};
+
+	static registry_type& registry()
+	{
+		static registry_type instance;
+		return instance;
+	}
+
+	static void bump(std::atomic<std::uint64_t>& value, std::uint64_t n)
+	{
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	static void write_prometheus_histogram(std::ostream& os, const std::vector<thread_snapshot>& threads,
+		const char* name, const char* help, log2_histogram thread_stats::* member)
+	{
+		char line[256];
+		os << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+		for (const auto& t : threads)
+		{
+			const log2_histogram& h = t.stats->*member;
+			std::uint64_t counts[log2_histogram::bucket_count];
+			std::size_t used = 0;
+			for (std::size_t i = 0; i < log2_histogram::bucket_count; ++i)
+			{
+				counts[i] = h.bucket(i);
+				if (counts[i] != 0)
+				{
+					used = i + 1;
+				}
+			}
+
+			// 从第一个桶输出到最高的非空桶，中间的空桶也要输出，否则按le插值分位数时会把空区间算进相邻的桶。
+			// 最后一个桶还包含超出上限的值，只计入+Inf
+			std::uint64_t cumulative = 0;
+			for (std::size_t i = 0; i < log2_histogram::bucket_count; ++i)
+			{
+				if (i < used && i + 1 < log2_histogram::bucket_count)
+				{
+					std::snprintf(line, sizeof(line), "%s_bucket{thread=\"%s\",le=\"%.9g\"} %llu\n", name,
+						t.name.c_str(), log2_histogram::upper_bound(i) / 1e9,
+						static_cast<unsigned long long>(cumulative + counts[i]));
+					os << line;
+				}
+				cumulative += counts[i];
+			}
+			std::snprintf(line, sizeof(line), "%s_bucket{thread=\"%s\",le=\"+Inf\"} %llu\n%s_sum{thread=\"%s\"} %.9f\n"
+				"%s_count{thread=\"%s\"} %llu\n",
+				name, t.name.c_str(), static_cast<unsigned long long>(cumulative),
+				name, t.name.c_str(), h.sum() / 1e9,
+				name, t.name.c_str(), static_cast<unsigned long long>(cumulative));
+			os << line;
+		}
+	}
+
+	static void write_json_histogram(std::ostream& os, const log2_histogram& h)
+	{
+		os << "{\"sum\":" << h.sum() << ",\"buckets\":{";
+		bool first = true;
+		for (std::size_t i = 0; i < log2_histogram::bucket_count; ++i)
+		{
+			std::uint64_t n = h.bucket(i);
+			if (n != 0)
+			{
+				os << (first ? "" : ",") << "\"" << log2_histogram::upper_bound(i) << "\":" << n;
+				first = false;
+			}
+		}
+		os << "}}";
+	}
+};
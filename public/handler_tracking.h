@@ -0,0 +1,204 @@
+#pragma once
+
+// asio自定义handler跟踪钩子，通过BOOST_ASIO_CUSTOM_HANDLER_TRACKING引入
+// （见CMake选项TEST_ASIO_HANDLER_METRICS和TEST_ASIO_HANDLER_TRACE），
+// 把handler的创建、开始执行、执行结束转给handler_metrics统计和（或）event_tracer记录。
+// 这个头文件在asio内部很早就被包含，只能依赖标准库，不能包含asio的头文件。
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(TEST_ASIO_HANDLER_METRICS)
+#include "public/handler_metrics.h"
+#endif
+
+#if defined(TEST_ASIO_HANDLER_TRACE)
+#include "public/event_tracer.h"
+#endif
+
+namespace test_asio_tracking
+{
+
+// asio所有操作对象的基类，记录创建时间、是否是投递和跟踪用的编号
+class tracked_handler
+{
+protected:
+	tracked_handler() = default;
+	~tracked_handler() = default;
+
+private:
+	friend class completion;
+	friend void creation(boost::asio::execution_context&, tracked_handler&, const char*, void*,
+		std::uintmax_t, const char*);
+
+#if defined(TEST_ASIO_HANDLER_METRICS)
+	std::uint64_t _created_ns = 0;     // 为0表示不统计调度延迟
+#endif
+#if defined(TEST_ASIO_HANDLER_TRACE)
+	std::uint64_t _trace_id = 0;        // 为0表示创建时没有在记录
+	const char* _op_name = nullptr;
+	const char* _object_type = nullptr;
+#endif
+};
+
+// 异步I/O操作名都以async_开头，其余的post/dispatch/defer/execute是投递。
+// 只在打开调度延迟统计时给投递记录创建时间，否则创建时不读时钟，每个handler只在执行前后各读一次
+inline void creation(boost::asio::execution_context&, tracked_handler& h, const char* object_type,
+	void* /*object*/, std::uintmax_t /*native_handle*/, const char* op_name)
+{
+#if defined(TEST_ASIO_HANDLER_METRICS)
+	if (handler_metrics::scheduling_delay_enabled() && std::strncmp(op_name, "async_", 6) != 0)
+	{
+		h._created_ns = handler_metrics::now_ns();
+	}
+	handler_metrics::on_created();
+#endif
+#if defined(TEST_ASIO_HANDLER_TRACE)
+	if (event_tracer::enabled())
+	{
+		h._trace_id = event_tracer::next_id();
+		h._op_name = op_name;
+		h._object_type = object_type;
+		event_tracer::record(event_tracer::event_type::created, op_name, object_type, h._trace_id);
+	}
+#else
+	(void)object_type;
+	(void)op_name;
+#endif
+}
+
+class completion
+{
+public:
+	explicit completion(const tracked_handler& h)
+#if defined(TEST_ASIO_HANDLER_METRICS)
+		: _stats(handler_metrics::this_thread()), _created_ns(h._created_ns)
+#endif
+	{
+#if defined(TEST_ASIO_HANDLER_TRACE)
+		_trace_id = h._trace_id;
+		_op_name = h._op_name;
+		_object_type = h._object_type;
+#endif
+		(void)h;
+	}
+
+	completion(const completion&) = delete;
+	completion& operator=(const completion&) = delete;
+
+	// 执行结束或未执行就销毁（io_context关闭时）都算作完成
+	~completion()
+	{
+		if (_invoked)
+		{
+			invocation_end();
+		}
+#if defined(TEST_ASIO_HANDLER_METRICS)
+		handler_metrics::on_finished(_stats);
+#endif
+	}
+
+	void invocation_begin()
+	{
+		begin(0, -1);
+	}
+
+	// 等待、连接等只有错误码的完成
+	template<typename Error>
+	void invocation_begin(const Error& ec)
+	{
+		begin(ec.value(), -1);
+	}
+
+	// 读写完成带传输的字节数，信号完成带信号值
+	template<typename Error, typename Arg>
+	void invocation_begin(const Error& ec, const Arg& arg)
+	{
+		if constexpr (std::is_arithmetic_v<Arg>)
+		{
+			begin(ec.value(), static_cast<std::int64_t>(arg));
+		}
+		else
+		{
+			begin(ec.value(), -1);
+		}
+	}
+
+	void invocation_end()
+	{
+		_invoked = false;
+#if defined(TEST_ASIO_HANDLER_TRACE)
+		if (_trace_id != 0)
+		{
+			event_tracer::record(event_tracer::event_type::end, _op_name, _object_type, _trace_id);
+		}
+#endif
+#if defined(TEST_ASIO_HANDLER_METRICS)
+		handler_metrics::on_invocation_end(_stats, _start_ns);
+#endif
+	}
+
+private:
+	void begin(std::int64_t error, std::int64_t value)
+	{
+		_invoked = true;
+#if defined(TEST_ASIO_HANDLER_METRICS)
+		_start_ns = handler_metrics::on_invocation_begin(_stats, _created_ns);
+#endif
+#if defined(TEST_ASIO_HANDLER_TRACE)
+		if (_trace_id != 0)
+		{
+			event_tracer::record(event_tracer::event_type::begin, _op_name, _object_type, _trace_id, error, value);
+		}
+#else
+		(void)error;
+		(void)value;
+#endif
+	}
+
+#if defined(TEST_ASIO_HANDLER_METRICS)
+	handler_metrics::thread_stats& _stats;
+	std::uint64_t _created_ns;
+	std::uint64_t _start_ns = 0;
+#endif
+#if defined(TEST_ASIO_HANDLER_TRACE)
+	std::uint64_t _trace_id;
+	const char* _op_name;
+	const char* _object_type;
+#endif
+	bool _invoked = false;
+};
+
+}
+
+# define BOOST_ASIO_INHERIT_TRACKED_HANDLER \
+  : public test_asio_tracking::tracked_handler
+
+# define BOOST_ASIO_ALSO_INHERIT_TRACKED_HANDLER \
+  , public test_asio_tracking::tracked_handler
+
+# define BOOST_ASIO_HANDLER_TRACKING_INIT (void)0
+
+# define BOOST_ASIO_HANDLER_LOCATION(args) (void)0
+
+# define BOOST_ASIO_HANDLER_CREATION(args) \
+  test_asio_tracking::creation args
+
+# define BOOST_ASIO_HANDLER_COMPLETION(args) \
+  test_asio_tracking::completion tracked_completion args
+
+# define BOOST_ASIO_HANDLER_INVOCATION_BEGIN(args) \
+  tracked_completion.invocation_begin args
+
+# define BOOST_ASIO_HANDLER_INVOCATION_END \
+  tracked_completion.invocation_end()
+
+# define BOOST_ASIO_HANDLER_OPERATION(args) (void)0
+# define BOOST_ASIO_HANDLER_REACTOR_REGISTRATION(args) (void)0
+# define BOOST_ASIO_HANDLER_REACTOR_DEREGISTRATION(args) (void)0
+# define BOOST_ASIO_HANDLER_REACTOR_READ_EVENT 1
+# define BOOST_ASIO_HANDLER_REACTOR_WRITE_EVENT 2
+# define BOOST_ASIO_HANDLER_REACTOR_ERROR_EVENT 4
+# define BOOST_ASIO_HANDLER_REACTOR_EVENTS(args) (void)0
+# define BOOST_ASIO_HANDLER_REACTOR_OPERATION(args) (void)0
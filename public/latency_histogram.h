@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+// HDR风格的对数-线性直方图：
+// 每个2的幂区间再细分为128个子桶，相对误差不超过1%，记录只需一次位运算和一次自增。
+// 非线程安全，每个线程各自记录，结束时再merge。
+class latency_histogram
+{
+public:
+	enum
+	{
+		sub_bucket_bits = 8,
+		sub_bucket_count = 1 << sub_bucket_bits,
+		sub_bucket_half = sub_bucket_count / 2,
+		bucket_count = (64 - sub_bucket_bits + 2) * sub_bucket_half
+	};
+
+	latency_histogram()
+		: _counts(bucket_count, 0)
+	{
+	}
+
+	void record(std::uint64_t value)
+	{
+		++_counts[index_of(value)];
+		++_total;
+		_min = std::min(_min, value);
+		_max = std::max(_max, value);
+		_sum += value;
+	}
+
+	void merge(const latency_histogram& other)
+	{
+		for (std::size_t i = 0; i < _counts.size(); ++i)
+		{
+			_counts[i] += other._counts[i];
+		}
+		_total += other._total;
+		_min = std::min(_min, other._min);
+		_max = std::max(_max, other._max);
+		_sum += other._sum;
+	}
+
+	void reset()
+	{
+		std::fill(_counts.begin(), _counts.end(), 0);
+		_total = 0;
+		_min = std::numeric_limits<std::uint64_t>::max();
+		_max = 0;
+		_sum = 0;
+	}
+
+	std::uint64_t count() const
+	{
+		return _total;
+	}
+
+	std::uint64_t min() const
+	{
+		return _total == 0 ? 0 : _min;
+	}
+
+	std::uint64_t max() const
+	{
+		return _max;
+	}
+
+	double mean() const
+	{
+		return _total == 0 ? 0.0 : static_cast<double>(_sum) / static_cast<double>(_total);
+	}
+
+	/// 返回百分位（0~100）对应的值，取所在桶的上界，不超过记录到的最大值
+	std::uint64_t percentile(double p) const
+	{
+		if (_total == 0)
+		{
+			return 0;
+		}
+
+		auto rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(_total) + 0.5);
+		rank = std::clamp<std::uint64_t>(rank, 1, _total);
+
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < _counts.size(); ++i)
+		{
+			seen += _counts[i];
+			if (seen >= rank)
+			{
+				return std::min(highest_equivalent(i), _max);
+			}
+		}
+		return _max;
+	}
+
+	/// 以"上界 数量"的形式输出非空桶，便于离线绘图
+	void print_buckets(std::ostream& os) const
+	{
+		for (std::size_t i = 0; i < _counts.size(); ++i)
+		{
+			if (_counts[i] != 0)
+			{
+				os << highest_equivalent(i) << ' ' << _counts[i] << '\n';
+			}
+		}
+	}
+
+private:
+	static std::size_t index_of(std::uint64_t value)
+	{
+		if (value < sub_bucket_count)
+		{
+			return static_cast<std::size_t>(value);
+		}
+
+		int msb = 63 - __builtin_clzll(value);
+		int shift = msb - sub_bucket_bits + 1;
+		return static_cast<std::size_t>(shift) * sub_bucket_half + static_cast<std::size_t>(value >> shift);
+	}
+
+	static std::uint64_t lowest_equivalent(std::size_t index)
+	{
+		if (index < sub_bucket_count)
+		{
+			return index;
+		}
+
+		std::size_t shift = index / sub_bucket_half - 1;
+		return static_cast<std::uint64_t>(index - shift * sub_bucket_half) << shift;
+	}
+
+	static std::uint64_t highest_equivalent(std::size_t index)
+	{
+		if (index + 1 >= bucket_count)
+		{
+			return std::numeric_limits<std::uint64_t>::max();
+		}
+		return lowest_equivalent(index + 1) - 1;
+	}
+
+private:
+	std::vector<std::uint64_t> _counts;
+	std::uint64_t _total = 0;
+	std::uint64_t _min = std::numeric_limits<std::uint64_t>::max();
+	std::uint64_t _max = 0;
+	std::uint64_t _sum = 0;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "public/handler_metrics.h"
+
+// 把handler_metrics导出到本地文件或本地端口：
+// 文件按interval定期整体重写（先写临时文件再rename，读取方不会看到写了一半的内容），
+// 文件名以.json结尾时写JSON，否则写Prometheus文本，可以交给node_exporter的textfile收集器。
+// 端口只监听127.0.0.1，每个连接读一个HTTP请求，返回一次快照后关闭，路径中含有json时返回JSON，
+// 可以直接作为Prometheus的抓取目标，也可以用curl查看。
+class metrics_exporter
+{
+public:
+	struct options
+	{
+		std::string file;                               // 为空时不写文件
+		unsigned short port = 0;                        // 为0时不监听
+		std::chrono::seconds interval{10};
+	};
+
+	metrics_exporter(boost::asio::io_context& io_context, const options& opts)
+		: _options(opts), _timer(io_context), _acceptor(io_context)
+	{
+		if (!_options.file.empty())
+		{
+			write_file();
+			schedule();
+		}
+
+		if (_options.port != 0)
+		{
+			boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), _options.port);
+			_acceptor.open(endpoint.protocol());
+			_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+			_acceptor.bind(endpoint);
+			_acceptor.listen();
+			accept();
+		}
+	}
+
+	/// 立即写一次文件，例如进程退出前
+	void write_file()
+	{
+		bool json = _options.file.size() >= 5 && _options.file.compare(_options.file.size() - 5, 5, ".json") == 0;
+		std::string temp = _options.file + ".tmp";
+		{
+			std::ofstream out(temp, std::ios::trunc);
+			if (!out)
+			{
+				return;
+			}
+			json ? handler_metrics::write_json(out) : handler_metrics::write_prometheus(out);
+		}
+		std::rename(temp.c_str(), _options.file.c_str());
+	}
+
+private:
+	class http_session : public std::enable_shared_from_this<http_session>
+	{
+	public:
+		explicit http_session(boost::asio::ip::tcp::socket socket)
+			: _socket(std::move(socket)), _request(4096)
+		{
+		}
+
+		void start()
+		{
+			auto self(shared_from_this());
+			boost::asio::async_read_until(_socket, _request, "\r\n\r\n",
+				[this, self](boost::system::error_code ec, std::size_t length)
+				{
+					if (ec)
+					{
+						return;
+					}
+
+					std::string request(boost::asio::buffers_begin(_request.data()),
+						boost::asio::buffers_begin(_request.data()) + length);
+					std::string request_line = request.substr(0, request.find("\r\n"));
+					bool json = request_line.find("json") != std::string::npos;
+
+					std::ostringstream body;
+					json ? handler_metrics::write_json(body) : handler_metrics::write_prometheus(body);
+					std::string content = body.str();
+
+					std::ostringstream response;
+					response << "HTTP/1.0 200 OK\r\nContent-Type: "
+						<< (json ? "application/json" : "text/plain; version=0.0.4")
+						<< "\r\nContent-Length: " << content.size() << "\r\nConnection: close\r\n\r\n" << content;
+					_response = response.str();
+
+					boost::asio::async_write(_socket, boost::asio::buffer(_response),
+						[this, self](boost::system::error_code, std::size_t)
+						{
+							boost::system::error_code ignored;
+							_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+						});
+				});
+		}
+
+	private:
+		boost::asio::ip::tcp::socket _socket;
+		boost::asio::streambuf _request;
+		std::string _response;
+	};
+
+	void schedule()
+	{
+		_timer.expires_after(_options.interval);
+		_timer.async_wait([this](boost::system::error_code ec)
+		{
+			if (ec)
+			{
+				return;
+			}
+			write_file();
+			schedule();
+		});
+	}
+
+	void accept()
+	{
+		_acceptor.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+		{
+			if (ec == boost::asio::error::operation_aborted)
+			{
+				return;
+			}
+			if (!ec)
+			{
+				std::make_shared<http_session>(std::move(socket))->start();
+			}
+			accept();
+		});
+	}
+
+	options _options;
+	boost::asio::steady_timer _timer;
+	boost::asio::ip::tcp::acceptor _acceptor;
+};
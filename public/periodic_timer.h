@@ -0,0 +1,282 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+// io_context上共享的周期定时服务，通过asio::use_service<periodic_timer_service>(io_context)取得。
+// 相同周期的回调归入同一个桶，每个桶只用一个steady_timer，到期时顺序遍历一个紧凑的回调数组，
+// 代替每个对象各自持有一个定时器并在每次到期后重新async_wait。
+// 注册和取消都是O(1)：回调数组按"与末尾交换后删除"维护，槽位表记录每个注册在数组中的下标。
+// 桶在第一个注册加入时开始计时，之后加入的注册跟随桶的相位，第一次触发可能早于一个完整周期。
+// 下一次到期时间按上一次到期时间累加周期计算，不随回调耗时漂移。
+// 非线程安全：io_context由多个线程运行时不同桶的回调可能并发执行，add/cancel需要调用方自己串行化。
+class periodic_timer_service : public boost::asio::execution_context::service
+{
+	struct bucket;
+
+public:
+	static inline boost::asio::execution_context::id id;
+
+	using clock_type = std::chrono::steady_clock;
+	using callback_type = void (*)(void*);
+
+	// 注册句柄，默认构造的句柄不对应任何注册
+	class ticker
+	{
+	public:
+		ticker() = default;
+
+		explicit operator bool() const
+		{
+			return _bucket != nullptr;
+		}
+
+	private:
+		friend class periodic_timer_service;
+
+		ticker(bucket* b, std::uint32_t slot)
+			: _bucket(b), _slot(slot)
+		{
+		}
+
+		bucket* _bucket = nullptr;
+		std::uint32_t _slot = 0;
+	};
+
+	explicit periodic_timer_service(boost::asio::execution_context& context)
+		: boost::asio::execution_context::service(context),
+		_io_context(static_cast<boost::asio::io_context&>(context))
+	{
+	}
+
+	/// 每隔period调用一次callback(arg)
+	ticker add(clock_type::duration period, callback_type callback, void* arg)
+	{
+		auto& b = _buckets[period.count()];
+		if (!b)
+		{
+			b.reset(new bucket(_io_context, period));
+		}
+
+		std::uint32_t slot = b->acquire_slot();
+		if (b->firing)
+		{
+			// 遍历过程中数组不能增长，本轮结束后再加入
+			b->slots[slot] = pending_slot;
+			b->pending_adds.push_back(entry{ callback, arg, slot });
+		}
+		else
+		{
+			b->append(entry{ callback, arg, slot });
+			if (b->entries.size() == 1)
+			{
+				start(*b);
+			}
+		}
+		return ticker(b.get(), slot);
+	}
+
+	/// 每隔period调用一次object->*Tick()
+	template<typename T, void (T::*Tick)()>
+	ticker add(clock_type::duration period, T* object)
+	{
+		return add(period, [](void* arg) { (static_cast<T*>(arg)->*Tick)(); }, object);
+	}
+
+	/// 取消注册并清空句柄。可以在回调（包括被取消的回调自己）中调用
+	void cancel(ticker& t)
+	{
+		bucket* b = t._bucket;
+		if (b == nullptr)
+		{
+			return;
+		}
+		t._bucket = nullptr;
+
+		std::uint32_t index = b->slots[t._slot];
+		if (index == pending_slot)
+		{
+			for (auto& e : b->pending_adds)
+			{
+				if (e.slot == t._slot)
+				{
+					e = b->pending_adds.back();
+					b->pending_adds.pop_back();
+					break;
+				}
+			}
+		}
+		else if (b->firing)
+		{
+			// 遍历过程中只打标记，本轮结束后再删除
+			b->entries[index].callback = nullptr;
+			b->pending_removes.push_back(t._slot);
+			return;
+		}
+		else
+		{
+			b->remove(index);
+			if (b->entries.empty())
+			{
+				b->timer.cancel();
+			}
+		}
+		b->release_slot(t._slot);
+	}
+
+	/// 注册所在桶当前这一轮的到期时间，在回调中调用即本次触发对应的计划时间
+	clock_type::time_point expiry(const ticker& t) const
+	{
+		return t._bucket != nullptr ? t._bucket->deadline : clock_type::time_point();
+	}
+
+	/// 当前的桶数和注册数
+	std::size_t bucket_count() const
+	{
+		return _buckets.size();
+	}
+
+	std::size_t size() const
+	{
+		std::size_t n = 0;
+		for (const auto& b : _buckets)
+		{
+			n += b.second->entries.size() + b.second->pending_adds.size() - b.second->pending_removes.size();
+		}
+		return n;
+	}
+
+private:
+	static constexpr std::uint32_t pending_slot = 0xffffffffu;
+	static constexpr std::uint32_t free_slot = 0xfffffffeu;
+
+	struct entry
+	{
+		callback_type callback;
+		void* arg;
+		std::uint32_t slot;
+	};
+
+	struct bucket
+	{
+		bucket(boost::asio::io_context& io_context, clock_type::duration p)
+			: timer(io_context), period(p)
+		{
+		}
+
+		std::uint32_t acquire_slot()
+		{
+			if (!free_slots.empty())
+			{
+				std::uint32_t slot = free_slots.back();
+				free_slots.pop_back();
+				return slot;
+			}
+			slots.push_back(free_slot);
+			return static_cast<std::uint32_t>(slots.size() - 1);
+		}
+
+		void release_slot(std::uint32_t slot)
+		{
+			slots[slot] = free_slot;
+			free_slots.push_back(slot);
+		}
+
+		void append(const entry& e)
+		{
+			slots[e.slot] = static_cast<std::uint32_t>(entries.size());
+			entries.push_back(e);
+		}
+
+		// 与末尾交换后删除
+		void remove(std::uint32_t index)
+		{
+			if (index + 1 != entries.size())
+			{
+				entries[index] = entries.back();
+				slots[entries[index].slot] = index;
+			}
+			entries.pop_back();
+		}
+
+		boost::asio::steady_timer timer;
+		clock_type::duration period;
+		clock_type::time_point deadline;
+		std::vector<entry> entries;
+		std::vector<std::uint32_t> slots;       // 槽位 -> entries下标
+		std::vector<std::uint32_t> free_slots;
+		std::vector<entry> pending_adds;
+		std::vector<std::uint32_t> pending_removes;
+		std::uint64_t generation = 0;   // 每次重新开始计时加一，用来丢弃取消前已经完成的等待
+		bool firing = false;
+	};
+
+	void start(bucket& b)
+	{
+		++b.generation;
+		b.deadline = clock_type::now() + b.period;
+		wait(b);
+	}
+
+	void wait(bucket& b)
+	{
+		b.timer.expires_at(b.deadline);
+		b.timer.async_wait([this, &b, generation = b.generation](const boost::system::error_code& ec)
+		{
+			if (!ec && generation == b.generation)
+			{
+				fire(b);
+			}
+		});
+	}
+
+	void fire(bucket& b)
+	{
+		b.firing = true;
+		for (std::size_t i = 0; i < b.entries.size(); ++i)
+		{
+			const entry& e = b.entries[i];
+			if (e.callback != nullptr)
+			{
+				e.callback(e.arg);
+			}
+		}
+		b.firing = false;
+
+		for (std::uint32_t slot : b.pending_removes)
+		{
+			b.remove(b.slots[slot]);
+			b.release_slot(slot);
+		}
+		b.pending_removes.clear();
+
+		for (const entry& e : b.pending_adds)
+		{
+			b.append(e);
+		}
+		b.pending_adds.clear();
+
+		if (!b.entries.empty())
+		{
+			b.deadline += b.period;
+			wait(b);
+		}
+	}
+
+	void shutdown() override
+	{
+		_buckets.clear();
+	}
+
+	boost::asio::io_context& _io_context;
+	std::unordered_map<clock_type::rep, std::unique_ptr<bucket>> _buckets;
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+// 数值越小越优先
+enum class handler_priority
+{
+	urgent = 0,     // 控制消息、心跳
+	high = 1,
+	normal = 2,
+	bulk = 3,       // 大块数据传输
+};
+
+// io_context上的优先级调度服务，通过asio::use_service<priority_scheduler>(io_context)取得。
+// 每个优先级一个队列。投递一个handler时入队，并向io_context投递一个"令牌"；
+// 每个令牌执行时取出当前最高优先级的一个handler执行，而不一定是投递它的那个。
+// 这样新来的紧急handler会在下一个令牌被处理，越过所有还在排队的低优先级handler，
+// 令牌和I/O完成一起在io_context中排队，所以高优先级的工作在I/O完成之间被优先执行。
+// 只有同样经过本服务投递的handler才参与排序，直接asio::post到io_context的工作仍按先进先出执行。
+class priority_scheduler : public boost::asio::execution_context::service
+{
+public:
+	static inline boost::asio::execution_context::id id;
+
+	enum
+	{
+		levels = 4
+	};
+
+	// 满足asio执行器要求，可用于asio::post、asio::dispatch和asio::bind_executor。
+	// dispatch也入队：I/O完成时asio通过dispatch调用关联执行器，直接执行就失去了排序的机会
+	class executor_type
+	{
+	public:
+		executor_type(priority_scheduler& scheduler, handler_priority priority)
+			: _scheduler(&scheduler), _priority(priority)
+		{
+		}
+
+		boost::asio::io_context& context() const noexcept
+		{
+			return _scheduler->_io_context;
+		}
+
+		void on_work_started() const noexcept
+		{
+			_scheduler->_io_context.get_executor().on_work_started();
+		}
+
+		void on_work_finished() const noexcept
+		{
+			_scheduler->_io_context.get_executor().on_work_finished();
+		}
+
+		template<typename Function, typename Allocator>
+		void dispatch(Function&& f, const Allocator& a) const
+		{
+			_scheduler->enqueue(_priority, std::forward<Function>(f), a);
+		}
+
+		template<typename Function, typename Allocator>
+		void post(Function&& f, const Allocator& a) const
+		{
+			_scheduler->enqueue(_priority, std::forward<Function>(f), a);
+		}
+
+		template<typename Function, typename Allocator>
+		void defer(Function&& f, const Allocator& a) const
+		{
+			_scheduler->enqueue(_priority, std::forward<Function>(f), a);
+		}
+
+		handler_priority priority() const noexcept
+		{
+			return _priority;
+		}
+
+		friend bool operator==(const executor_type& a, const executor_type& b) noexcept
+		{
+			return a._scheduler == b._scheduler && a._priority == b._priority;
+		}
+
+		friend bool operator!=(const executor_type& a, const executor_type& b) noexcept
+		{
+			return !(a == b);
+		}
+
+	private:
+		priority_scheduler* _scheduler;
+		handler_priority _priority;
+	};
+
+	explicit priority_scheduler(boost::asio::execution_context& context)
+		: boost::asio::execution_context::service(context),
+		_io_context(static_cast<boost::asio::io_context&>(context))
+	{
+	}
+
+	~priority_scheduler() override
+	{
+		destroy_all();
+	}
+
+	executor_type get_executor(handler_priority priority = handler_priority::normal)
+	{
+		return executor_type(*this, priority);
+	}
+
+	/// 各优先级已执行的handler数量
+	std::uint64_t executed(handler_priority priority) const
+	{
+		return _executed[static_cast<std::size_t>(priority)].load(std::memory_order_relaxed);
+	}
+
+private:
+	struct op
+	{
+		void (*complete)(op*, bool invoke);
+	};
+
+	template<typename Function, typename Allocator>
+	struct op_impl : op
+	{
+		using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<op_impl>;
+
+		op_impl(Function&& f, const Allocator& a)
+			: function(std::move(f)), allocator(a)
+		{
+			complete = &op_impl::do_complete;
+		}
+
+		// 先释放操作对象再调用handler，handler里再次投递时可以复用同一块内存
+		static void do_complete(op* base, bool invoke)
+		{
+			op_impl* self = static_cast<op_impl*>(base);
+			allocator_type allocator(self->allocator);
+			Function function(std::move(self->function));
+			std::allocator_traits<allocator_type>::destroy(allocator, self);
+			std::allocator_traits<allocator_type>::deallocate(allocator, self, 1);
+			if (invoke)
+			{
+				function();
+			}
+		}
+
+		Function function;
+		allocator_type allocator;
+	};
+
+	template<typename Function, typename Allocator>
+	void enqueue(handler_priority priority, Function&& f, const Allocator& a)
+	{
+		using impl = op_impl<std::decay_t<Function>, Allocator>;
+		typename impl::allocator_type allocator(a);
+		impl* o = std::allocator_traits<typename impl::allocator_type>::allocate(allocator, 1);
+		new (o) impl(std::decay_t<Function>(std::forward<Function>(f)), a);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_queues[static_cast<std::size_t>(priority)].push_back(o);
+		}
+		boost::asio::post(_io_context, [this]() { run_one(); });
+	}
+
+	// 令牌：执行当前优先级最高的一个handler
+	void run_one()
+	{
+		op* o = nullptr;
+		std::size_t level = 0;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (; level < levels; ++level)
+			{
+				if (!_queues[level].empty())
+				{
+					o = _queues[level].front();
+					_queues[level].pop_front();
+					break;
+				}
+			}
+		}
+
+		if (o != nullptr)
+		{
+			_executed[level].fetch_add(1, std::memory_order_relaxed);
+			o->complete(o, true);
+		}
+	}
+
+	void shutdown() override
+	{
+		destroy_all();
+	}
+
+	void destroy_all()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& queue : _queues)
+		{
+			for (op* o : queue)
+			{
+				o->complete(o, false);
+			}
+			queue.clear();
+		}
+	}
+
+	boost::asio::io_context& _io_context;
+	std::mutex _mutex;
+	std::array<std::deque<op*>, levels> _queues;
+	std::array<std::atomic<std::uint64_t>, levels> _executed{};
+};
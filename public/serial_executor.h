@@ -0,0 +1,304 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include "public/strand_profiler.h"
+
+// 轻量的串行执行器，可替代io_context::strand / asio::strand：
+// 投递的handler进入一个无锁的多生产者单消费者队列（Vyukov侵入式队列），
+// 只用一个running标志保证同一时刻最多一个线程在执行队列。入队的线程把running从false改为true时，
+// 向内部执行器投递一次drain，drain依次执行队列中的handler，取空后清除running。
+// 每次drain最多执行batch个handler就重新投递自己，避免长队列一直占住一个工作线程。
+// 满足asio的执行器要求（context/on_work_started/on_work_finished/dispatch/post/defer），
+// 可以直接用于asio::post、asio::dispatch和asio::bind_executor。
+template<typename Executor>
+class serial_executor
+{
+public:
+	using inner_executor_type = Executor;
+
+	enum
+	{
+		batch = 64
+	};
+
+	explicit serial_executor(const Executor& inner, strand_profiler* profiler = nullptr)
+		: _impl(std::make_shared<impl>(inner, profiler))
+	{
+	}
+
+	/// 从执行上下文构造，和io_context::strand(io_context)的用法一致
+	template<typename ExecutionContext,
+		typename = std::enable_if_t<std::is_base_of_v<boost::asio::execution_context, ExecutionContext>>>
+	explicit serial_executor(ExecutionContext& context, strand_profiler* profiler = nullptr)
+		: serial_executor(context.get_executor(), profiler)
+	{
+	}
+
+	boost::asio::execution_context& context() const noexcept
+	{
+		return _impl->_inner.context();
+	}
+
+	void on_work_started() const noexcept
+	{
+		_impl->_inner.on_work_started();
+	}
+
+	void on_work_finished() const noexcept
+	{
+		_impl->_inner.on_work_finished();
+	}
+
+	Executor get_inner_executor() const noexcept
+	{
+		return _impl->_inner;
+	}
+
+	/// 当前线程是否正在执行这个执行器的队列
+	bool running_in_this_thread() const noexcept
+	{
+		return current() == _impl.get();
+	}
+
+	template<typename Function, typename Allocator>
+	void dispatch(Function&& f, const Allocator& a) const
+	{
+		if (running_in_this_thread())
+		{
+			std::decay_t<Function> tmp(std::forward<Function>(f));
+			tmp();
+			return;
+		}
+		post(std::forward<Function>(f), a);
+	}
+
+	/// 操作对象通过handler关联的分配器分配，和priority_scheduler一致
+	template<typename Function, typename Allocator>
+	void post(Function&& f, const Allocator& a) const
+	{
+		using op_type = op_impl<std::decay_t<Function>, Allocator>;
+		typename op_type::allocator_type allocator(a);
+		op_type* o = std::allocator_traits<typename op_type::allocator_type>::allocate(allocator, 1);
+		new (o) op_type(std::decay_t<Function>(std::forward<Function>(f)), a);
+		impl::enqueue(_impl, o);
+	}
+
+	template<typename Function, typename Allocator>
+	void defer(Function&& f, const Allocator& a) const
+	{
+		post(std::forward<Function>(f), a);
+	}
+
+	friend bool operator==(const serial_executor& a, const serial_executor& b) noexcept
+	{
+		return a._impl == b._impl;
+	}
+
+	friend bool operator!=(const serial_executor& a, const serial_executor& b) noexcept
+	{
+		return a._impl != b._impl;
+	}
+
+private:
+	struct op
+	{
+		std::atomic<op*> next{nullptr};
+		std::uint64_t enqueued_ns = 0;
+		void (*complete)(op*, bool invoke) = nullptr;
+	};
+
+	template<typename Function, typename Allocator>
+	struct op_impl : op
+	{
+		using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<op_impl>;
+
+		op_impl(Function&& f, const Allocator& a)
+			: function(std::move(f)), allocator(a)
+		{
+			this->complete = &op_impl::do_complete;
+		}
+
+		// 先释放操作对象再调用handler，handler里再次投递时可以复用同一块内存
+		static void do_complete(op* base, bool invoke)
+		{
+			op_impl* self = static_cast<op_impl*>(base);
+			allocator_type allocator(self->allocator);
+			Function function(std::move(self->function));
+			std::allocator_traits<allocator_type>::destroy(allocator, self);
+			std::allocator_traits<allocator_type>::deallocate(allocator, self, 1);
+			if (invoke)
+			{
+				function();
+			}
+		}
+
+		Function function;
+		allocator_type allocator;
+	};
+
+	class impl
+	{
+	public:
+		impl(const Executor& inner, strand_profiler* profiler)
+			: _inner(inner), _profiler(profiler), _head(&_stub), _tail(&_stub)
+		{
+		}
+
+		~impl()
+		{
+			while (op* o = pop())
+			{
+				o->complete(o, false);
+			}
+		}
+
+		static void enqueue(const std::shared_ptr<impl>& self, op* o)
+		{
+			if (self->_profiler)
+			{
+				o->enqueued_ns = self->_profiler->on_enqueue();
+			}
+
+			self->_size.fetch_add(1, std::memory_order_relaxed);
+			self->push(o);
+			if (!self->_running.exchange(true, std::memory_order_acq_rel))
+			{
+				schedule(self);
+			}
+		}
+
+		Executor _inner;
+
+	private:
+		static void schedule(std::shared_ptr<impl> self)
+		{
+			Executor inner = self->_inner;
+			boost::asio::post(inner, [self = std::move(self)]() { drain(self); });
+		}
+
+		static void drain(const std::shared_ptr<impl>& self)
+		{
+			// handler抛出异常时队列里剩下的handler交给下一次drain执行，running保持为true
+			struct reschedule_on_throw
+			{
+				const std::shared_ptr<impl>& self;
+				const void* previous;
+
+				~reschedule_on_throw()
+				{
+					current() = previous;
+					if (std::uncaught_exceptions() > 0)
+					{
+						schedule(self);
+					}
+				}
+			} guard{self, current()};
+			current() = self.get();
+
+			for (std::size_t executed = 0; executed < batch; ++executed)
+			{
+				op* o = self->pop();
+				if (o == nullptr)
+				{
+					if (self->_size.load(std::memory_order_acquire) > 0)
+					{
+						// 生产者交换了头指针但还没链接next，稍后再试
+						schedule(self);
+						return;
+					}
+
+					self->_running.store(false, std::memory_order_seq_cst);
+					if (self->_size.load(std::memory_order_seq_cst) == 0
+						|| self->_running.exchange(true, std::memory_order_acq_rel))
+					{
+						return;
+					}
+					continue;
+				}
+
+				self->_size.fetch_sub(1, std::memory_order_relaxed);
+				if (self->_profiler)
+				{
+					std::uint64_t start = self->_profiler->on_start(o->enqueued_ns);
+					o->complete(o, true);
+					self->_profiler->on_finish(start);
+				}
+				else
+				{
+					o->complete(o, true);
+				}
+			}
+
+			schedule(self);
+		}
+
+		void push(op* o)
+		{
+			o->next.store(nullptr, std::memory_order_relaxed);
+			op* prev = _head.exchange(o, std::memory_order_acq_rel);
+			prev->next.store(o, std::memory_order_release);
+		}
+
+		// 只在持有running的线程中调用。队列为空或生产者尚未完成链接时返回nullptr
+		op* pop()
+		{
+			op* tail = _tail;
+			op* next = tail->next.load(std::memory_order_acquire);
+			if (tail == &_stub)
+			{
+				if (next == nullptr)
+				{
+					return nullptr;
+				}
+				_tail = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next != nullptr)
+			{
+				_tail = next;
+				return tail;
+			}
+
+			if (tail != _head.load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+
+			push(&_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next != nullptr)
+			{
+				_tail = next;
+				return tail;
+			}
+			return nullptr;
+		}
+
+		strand_profiler* _profiler;
+		op _stub;
+		std::atomic<op*> _head;
+		op* _tail;
+		std::atomic<std::size_t> _size{0};
+		std::atomic<bool> _running{false};
+	};
+
+	static const void*& current()
+	{
+		thread_local const void* running = nullptr;
+		return running;
+	}
+
+	std::shared_ptr<impl> _impl;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+
+#include "public/latency_histogram.h"
+
+// 统计一个strand（或任何串行执行器）上handler的排队深度、等待时间和执行时间。
+// 入队可以发生在任意线程，只动原子计数；开始/结束执行总在strand内串行发生，直方图不需要加锁。
+// 用法：asio::post(strand, profiler.wrap(handler))，或由serial_executor在入队和执行时直接调用。
+class strand_profiler
+{
+public:
+	explicit strand_profiler(std::string name = "strand")
+		: _name(std::move(name))
+	{
+	}
+
+	static std::uint64_t now_ns()
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	/// 入队时调用，返回入队时刻，执行时交给on_start
+	std::uint64_t on_enqueue()
+	{
+		std::uint64_t depth = _depth.fetch_add(1, std::memory_order_relaxed) + 1;
+		_enqueued.fetch_add(1, std::memory_order_relaxed);
+		_depth_sum.fetch_add(depth, std::memory_order_relaxed);
+
+		std::uint64_t max = _max_depth.load(std::memory_order_relaxed);
+		while (depth > max && !_max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed))
+		{
+		}
+		return now_ns();
+	}
+
+	/// 在strand上开始执行handler时调用，返回开始时刻
+	std::uint64_t on_start(std::uint64_t enqueued_ns)
+	{
+		_depth.fetch_sub(1, std::memory_order_relaxed);
+		std::uint64_t start = now_ns();
+		_wait.record(start - enqueued_ns);
+		return start;
+	}
+
+	/// handler执行完后调用
+	void on_finish(std::uint64_t start_ns)
+	{
+		_exec.record(now_ns() - start_ns);
+	}
+
+	template<typename Handler>
+	class profiled_handler
+	{
+	public:
+		profiled_handler(strand_profiler& profiler, Handler handler)
+			: _profiler(profiler), _handler(std::move(handler)), _enqueued(profiler.on_enqueue())
+		{
+		}
+
+		template<typename... Args>
+		void operator()(Args&&... args)
+		{
+			std::uint64_t start = _profiler.on_start(_enqueued);
+			_handler(std::forward<Args>(args)...);
+			_profiler.on_finish(start);
+		}
+
+		const Handler& handler() const
+		{
+			return _handler;
+		}
+
+	private:
+		strand_profiler& _profiler;
+		Handler _handler;
+		std::uint64_t _enqueued;
+	};
+
+	/// 包装handler，包装时记为入队，调用时记录等待和执行时间
+	template<typename Handler>
+	profiled_handler<Handler> wrap(Handler handler)
+	{
+		return profiled_handler<Handler>(*this, std::move(handler));
+	}
+
+	std::uint64_t executed() const
+	{
+		return _exec.count();
+	}
+
+	const latency_histogram& wait_time() const
+	{
+		return _wait;
+	}
+
+	const latency_histogram& exec_time() const
+	{
+		return _exec;
+	}
+
+	std::uint64_t max_depth() const
+	{
+		return _max_depth.load(std::memory_order_relaxed);
+	}
+
+	/// 每次入队时看到的平均排队深度（含自己）
+	double mean_depth() const
+	{
+		std::uint64_t n = _enqueued.load(std::memory_order_relaxed);
+		return n == 0 ? 0.0 : static_cast<double>(_depth_sum.load(std::memory_order_relaxed)) / static_cast<double>(n);
+	}
+
+	/// 在strand上的handler都执行完之后调用
+	void report(std::ostream& os) const
+	{
+		auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+		os << _name << ": handlers=" << executed()
+			<< " depth(mean/max)=" << mean_depth() << "/" << max_depth()
+			<< " wait_us(p50/p99/max)=" << us(_wait.percentile(50.0)) << "/" << us(_wait.percentile(99.0)) << "/" << us(_wait.max())
+			<< " exec_us(p50/p99/max)=" << us(_exec.percentile(50.0)) << "/" << us(_exec.percentile(99.0)) << "/" << us(_exec.max())
+			<< '\n';
+	}
+
+private:
+	std::string _name;
+	std::atomic<std::uint64_t> _depth{0};
+	std::atomic<std::uint64_t> _max_depth{0};
+	std::atomic<std::uint64_t> _depth_sum{0};
+	std::atomic<std::uint64_t> _enqueued{0};
+	latency_histogram _wait;
+	latency_histogram _exec;
+};
+
+namespace boost
+{
+namespace asio
+{
+
+// 包装后的handler仍然使用原handler关联的执行器和分配器
+template<typename Handler, typename Executor>
+struct associated_executor<strand_profiler::profiled_handler<Handler>, Executor>
+{
+	typedef typename associated_executor<Handler, Executor>::type type;
+
+	static type get(const strand_profiler::profiled_handler<Handler>& h, const Executor& ex = Executor()) noexcept
+	{
+		return associated_executor<Handler, Executor>::get(h.handler(), ex);
+	}
+};
+
+template<typename Handler, typename Allocator>
+struct associated_allocator<strand_profiler::profiled_handler<Handler>, Allocator>
+{
+	typedef typename associated_allocator<Handler, Allocator>::type type;
+
+	static type get(const strand_profiler::profiled_handler<Handler>& h, const Allocator& a = Allocator()) noexcept
+	{
+		return associated_allocator<Handler, Allocator>::get(h.handler(), a);
+	}
+};
+
+}
+}
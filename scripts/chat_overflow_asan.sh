@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+#
+# 用AddressSanitizer构建chat_server和chat_benchmark，以drop-oldest/coalesce策略和很小的队列上限
+# 运行服务器，接入几个慢速读取的客户端，再用chat_benchmark持续广播，
+# 检查丢弃未写入消息时不会破坏正在聚集写入的消息。
+#
+# 用法：scripts/chat_overflow_asan.sh
+# 环境变量：BUILD_DIR 构建目录，DURATION 每种策略的压测秒数，PORT chat_server端口。
+#
+
+set -euo pipefail
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-/tmp/test_asio_asan}
+DURATION=${DURATION:-5}
+PORT=${PORT:-9600}
+
+cmake -S "$ROOT" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Debug \
+    -DCMAKE_CXX_FLAGS="-fsanitize=address -fno-omit-frame-pointer" > /dev/null
+cmake --build "$BUILD_DIR" -j"$(nproc)" --target chat_server chat_benchmark > /dev/null
+
+# 每50ms只读几百字节，服务器端的写队列会持续积压
+slow_reader() {
+    exec 3<> "/dev/tcp/127.0.0.1/$PORT"
+    while head -c 256 <&3 > /dev/null; do
+        sleep 0.05
+    done
+}
+
+run_policy() {
+    local policy=$1
+    local log=$BUILD_DIR/chat_server-$policy.log
+
+    ASAN_OPTIONS=halt_on_error=1 "$BUILD_DIR/chat/server/chat_server" \
+        --max-queue-msgs=100 --overflow="$policy" "$PORT" > /dev/null 2> "$log" &
+    local server=$!
+    sleep 0.5
+
+    local readers=()
+    for _ in $(seq 16); do
+        slow_reader &
+        readers+=($!)
+    done
+
+    "$BUILD_DIR/chat/benchmark/chat_benchmark" 127.0.0.1 "$PORT" \
+        --connections=32 --rate=1000 --size=512 --warmup=0 --duration="$DURATION" > /dev/null 2>&1 || true
+
+    kill "${readers[@]}" 2> /dev/null || true
+    local status=0
+    if ! kill "$server" 2> /dev/null; then
+        # 服务器已经退出，说明ASan报告了错误
+        status=1
+    fi
+    wait "$server" 2> /dev/null || true
+
+    if [ $status -ne 0 ] || grep -q "ERROR: AddressSanitizer" "$log"; then
+        echo "== $policy: FAILED, see $log"
+        return 1
+    fi
+    echo "== $policy: ok"
+}
+
+result=0
+run_policy drop-oldest || result=1
+run_policy coalesce || result=1
+exit $result
@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+#
+# 分别用epoll（默认）和io_uring（-DTEST_ASIO_IO_URING=ON，需要Boost 1.78以上和liburing）构建，
+# 在不同连接数下对比echo和chat服务器：
+#   echo: echo_benchmark进程内回显，输出吞吐和往返延迟；
+#   chat: 启动chat_server，用chat_benchmark压测，结果写入JSON。
+#
+# 用法：scripts/compare_reactors.sh [连接数 ...]，默认 1 16 128 512。
+# 环境变量：BUILD_ROOT 构建和结果目录，DURATION chat压测秒数，PORT chat_server端口。
+#
+
+set -euo pipefail
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_ROOT=${BUILD_ROOT:-/tmp/test_asio_reactors}
+DURATION=${DURATION:-5}
+PORT=${PORT:-9500}
+CONNECTIONS=("$@")
+if [ ${#CONNECTIONS[@]} -eq 0 ]; then
+    CONNECTIONS=(1 16 128 512)
+fi
+
+RESULTS=$BUILD_ROOT/results
+mkdir -p "$RESULTS"
+
+build() {
+    local backend=$1 uring=$2
+    cmake -S "$ROOT" -B "$BUILD_ROOT/$backend" -DCMAKE_BUILD_TYPE=Release -DTEST_ASIO_IO_URING="$uring" > /dev/null
+    cmake --build "$BUILD_ROOT/$backend" -j"$(nproc)" \
+        --target echo_benchmark chat_server chat_benchmark > /dev/null
+}
+
+run_echo() {
+    local backend=$1 connections=$2
+    echo "== $backend echo, $connections connections"
+    "$BUILD_ROOT/$backend/echo/benchmark/echo_benchmark" --connections="$connections" \
+        --modes=fixed,adaptive --sizes=1024,65536 --bytes=$((32 * 1024 * 1024)) \
+        | tee "$RESULTS/$backend-echo-$connections.txt"
+}
+
+run_chat() {
+    local backend=$1 connections=$2
+    local output=$RESULTS/$backend-chat-$connections.json
+    "$BUILD_ROOT/$backend/chat/server/chat_server" "$PORT" > /dev/null &
+    local server=$!
+    sleep 0.5
+    "$BUILD_ROOT/$backend/chat/benchmark/chat_benchmark" 127.0.0.1 "$PORT" \
+        --connections="$connections" --rate=10 --warmup=1 --duration="$DURATION" --output="$output" 2> /dev/null || true
+    kill "$server"
+    wait "$server" 2> /dev/null || true
+    echo "== $backend chat, $connections connections: $(grep -E '"delivered_per_sec"|"p99"' "$output" | tr -d ' \n')"
+}
+
+BACKENDS=(epoll)
+build epoll OFF
+if build io_uring ON 2> /dev/null; then
+    BACKENDS+=(io_uring)
+else
+    echo "io_uring build unavailable (needs Boost >= 1.78 and liburing), comparing epoll only" >&2
+fi
+
+for connections in "${CONNECTIONS[@]}"; do
+    for backend in "${BACKENDS[@]}"; do
+        run_echo "$backend" "$connections"
+        run_chat "$backend" "$connections"
+    done
+done
+
+echo "results in $RESULTS"
@@ -1,27 +1,41 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/bind.hpp>
 
+#include "public/command_line.h"
+#include "public/handler_allocator.h"
+#include "public/periodic_timer.h"
+#include "public/serial_executor.h"
+#include "public/strand_profiler.h"
+
 namespace asio = boost::asio;
 using error_code = boost::system::error_code;
 
+// Strand可以是io_context::strand或serial_executor，两者都能从io_context构造。
+// 周期触发使用io_context共享的periodic_timer_service，同一周期的printer共用一个定时器
+template<typename Strand>
 class printer
 {
-	using timer_t = asio::high_resolution_timer;
-	using timer_ptr = std::shared_ptr<timer_t>;
-
 public:
 	explicit printer(asio::io_context& ioc)
 		: _strand(ioc),
-		  _timer(std::make_shared<timer_t>(ioc)),
+		  _timers(asio::use_service<periodic_timer_service>(ioc)),
 		  _count(0)
 	{
-		startPrint();
+		_ticker = _timers.add<printer, &printer::tick>(std::chrono::milliseconds(1000), this);
 	}
 
 	~printer()
 	{
+		_timers.cancel(_ticker);
 		std::cout << "Final count is " << _count << std::endl;
 	}
 
@@ -29,45 +43,116 @@ public:
 	{
 		std::cout << "Timer 1: " << _count << "  thread id：" << std::this_thread::get_id() << std::endl;
 		++_count;
-
-		startPrint();
 	}
 
 private:
-	void startPrint()
+	// 定时器回调可能在任一运行io_context的线程上执行，print()总是经过_strand串行执行
+	void tick()
 	{
-		_timer->expires_after(std::chrono::milliseconds(1000));
-
-		if (_withStrand)
+		asio::dispatch(_strand, make_custom_alloc_handler(_tickMemory, [this]()
 		{
-			_timer->async_wait(_strand.wrap([this](error_code ec)
-			{
-				print();
-			}));
-		}
-		else
-		{
-			_timer->async_wait([this](error_code ec)
-			{
-				print();
-			});
-		}
+			print();
+		}));
 	}
 
 private:
-	asio::io_context::strand _strand;
-	timer_ptr _timer;
+	Strand _strand;
+	periodic_timer_service& _timers;
+	periodic_timer_service::ticker _ticker;
+	// 每次到期最多一个投递到strand的handler，复用同一块内存
+	handler_memory _tickMemory;
 	std::atomic_int64_t _count;
-	std::atomic_bool _withStrand{ false };
 };
 
 // https://www.crazygaze.com/blog/2016/03/17/how-strands-work-and-why-you-should-use-them/
 // https://www.jianshu.com/p/70286c2ab544
 
-int main()
+//----------------------------------------------------------------------
+// strand交接开销对比：threads个线程运行同一个io_context，每个线程各投递handlers/threads个handler到同一个strand，
+// 统计全部执行完的耗时，并用strand_profiler记录排队深度、等待时间和执行时间。
+// handler里对普通变量自增，结束时检查总数，验证确实是串行执行的。
+
+template<typename Strand>
+void run_handoff(const char* name, std::size_t threads, std::size_t handlers)
+{
+	asio::io_context ioc(static_cast<int>(threads));
+	strand_profiler profiler(name);
+	std::size_t counter = 0;
+	std::size_t per_thread = handlers / threads;
+
+	// serial_executor在入队和执行时直接调用profiler，asio的strand通过包装handler统计
+	auto post_one = [&](auto& strand)
+	{
+		if constexpr (std::is_same_v<Strand, serial_executor<asio::io_context::executor_type>>)
+		{
+			asio::post(strand, [&counter] { ++counter; });
+		}
+		else
+		{
+			asio::post(strand, profiler.wrap([&counter] { ++counter; }));
+		}
+	};
+
+	std::unique_ptr<Strand> strand;
+	if constexpr (std::is_same_v<Strand, serial_executor<asio::io_context::executor_type>>)
+	{
+		strand.reset(new Strand(ioc, &profiler));
+	}
+	else if constexpr (std::is_same_v<Strand, asio::io_context::strand>)
+	{
+		strand.reset(new Strand(ioc));
+	}
+	else
+	{
+		strand.reset(new Strand(ioc.get_executor()));
+	}
+
+	for (std::size_t i = 0; i < threads; ++i)
+	{
+		asio::post(ioc, [&]
+		{
+			for (std::size_t n = 0; n < per_thread; ++n)
+			{
+				post_one(*strand);
+			}
+		});
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (std::size_t i = 0; i < threads; ++i)
+	{
+		workers.emplace_back([&ioc] { ioc.run(); });
+	}
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::size_t expected = per_thread * threads;
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-20s threads=%-3zu %8.1f ns/handler %s\n", name, threads,
+		seconds * 1e9 / static_cast<double>(expected), counter == expected ? "" : "COUNT MISMATCH");
+	std::cout << line << "  ";
+	profiler.report(std::cout);
+}
+
+void run_benchmark(std::size_t handlers)
+{
+	for (std::size_t threads : { 2, 8, 32 })
+	{
+		run_handoff<asio::io_context::strand>("io_context::strand", threads, handlers);
+		run_handoff<asio::strand<asio::io_context::executor_type>>("asio::strand", threads, handlers);
+		run_handoff<serial_executor<asio::io_context::executor_type>>("serial_executor", threads, handlers);
+	}
+}
+
+template<typename Strand>
+void run_printer()
 {
 	asio::io_context ioc;
-	printer p(ioc);
+	printer<Strand> p(ioc);
 
 	std::shared_ptr<std::thread> threads[2];
 
@@ -84,6 +169,52 @@ int main()
 	{
 		i->join();
 	}
+}
+
+// asio_strand                     定时打印，使用io_context::strand
+// asio_strand --serial            定时打印，使用serial_executor
+// asio_strand --benchmark [--handlers=<n>]
+int main(int argc, char* argv[])
+{
+	bool serial = false;
+	bool benchmark = false;
+	std::size_t handlers = 1000000;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if (std::strcmp(argv[i], "--serial") == 0)
+		{
+			serial = true;
+		}
+		else if (std::strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmark = true;
+		}
+		else if ((value = parse_option(argv[i], "--handlers")))
+		{
+			handlers = std::strtoul(value, nullptr, 10);
+		}
+		else
+		{
+			std::cerr << "Usage: asio_strand [--serial] [--benchmark [--handlers=<n>]]" << std::endl;
+			return 1;
+		}
+	}
+
+	if (benchmark)
+	{
+		run_benchmark(handlers);
+		return 0;
+	}
+
+	if (serial)
+	{
+		run_printer<serial_executor<asio::io_context::executor_type>>();
+	}
+	else
+	{
+		run_printer<asio::io_context::strand>();
+	}
 
 	getchar();
 	return 0;
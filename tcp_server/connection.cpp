@@ -1,559 +1,662 @@
-//
-// Created by YLB on 2022/6/6.
-//
-
-#include "connection.h"
-
-#include <boost/asio/placeholders.hpp>
-#include <boost/asio/write.hpp>
-#include <boost/asio/read.hpp>
-
-#include "singleton.h"
-
-bool Connection::m_logError = true;
-
-Connection::Connection(boost::asio::ip::tcp::socket* socket,
-	boost::asio::io_context& ioc,
-	ServicePort_ptr service_port)
-	: m_socket(socket),
-	  m_readTimer(ioc),
-	  m_writeTimer(ioc),
-	  m_io_context(ioc),
-	  m_service_port(service_port)
-{
-	m_refCount = 0;
-	m_protocol = NULL;
-	m_pendingWrite = 0;
-	m_pendingRead = 0;
-	m_connectionState = CONNECTION_STATE_OPEN;
-	m_receivedFirst = false;
-	m_writeError = false;
-	m_readError = false;
-}
-
-Connection::~Connection()
-{
-}
-
-boost::asio::ip::tcp::socket& Connection::getHandle()
-{
-	return *m_socket;
-}
-
-void Connection::closeConnection()
-{
-	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
-	if (m_connectionState == CONNECTION_STATE_CLOSED || m_connectionState == CONNECTION_STATE_REQUEST_CLOSE)
-		return;
-
-	m_connectionState = CONNECTION_STATE_REQUEST_CLOSE;
-
-	g_dispatcher.addTask(
-		createTask(boost::bind(&Connection::closeConnectionTask, this)));
-}
-
-void Connection::closeConnectionTask()
-{
-	m_connectionLock.lock();
-	if (m_connectionState != CONNECTION_STATE_REQUEST_CLOSE)
-	{
-		std::cout << "Error: [Connection::closeConnectionTask] m_connectionState = " << m_connectionState << std::endl;
-		m_connectionLock.unlock();
-		return;
-	}
-
-	if (m_protocol)
-	{
-		m_protocol->setConnection(Connection_ptr());
-		m_protocol->releaseProtocol();
-		m_protocol = NULL;
-	}
-
-	m_connectionState = CONNECTION_STATE_CLOSING;
-
-	if (m_pendingWrite == 0 || m_writeError)
-	{
-		closeSocket();
-		releaseConnection();
-		m_connectionState = CONNECTION_STATE_CLOSED;
-	}
-	else
-	{
-		//will be closed by onWriteOperation/handleWriteTimeout/handleReadTimeout instead
-	}
-
-	m_connectionLock.unlock();
-}
-
-void Connection::closeSocket()
-{
-	m_connectionLock.lock();
-
-	if (m_socket->is_open())
-	{
-		m_pendingRead = 0;
-		m_pendingWrite = 0;
-
-		try
-		{
-			boost::system::error_code error;
-			m_socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
-			if (error)
-			{
-				if (error == boost::asio::error::not_connected)
-				{
-					//Transport endpoint is not connected.
-				}
-				else
-				{
-					PRINT_ASIO_ERROR("Shutdown");
-				}
-			}
-			m_socket->close(error);
-
-			if (error)
-			{
-				PRINT_ASIO_ERROR("Close");
-			}
-		}
-		catch (boost::system::system_error& e)
-		{
-			if (m_logError)
-			{
-				m_logError = false;
-			}
-		}
-	}
-
-	m_connectionLock.unlock();
-}
-
-void Connection::releaseConnection()
-{
-	if (m_refCount > 0)
-	{
-		//Reschedule it and try again.
-		g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS,
-			boost::bind(&Connection::releaseConnection, this)));
-	}
-	else
-	{
-		deleteConnectionTask();
-	}
-}
-
-void Connection::onStopOperation()
-{
-	//io_context thread
-	m_connectionLock.lock();
-	m_readTimer.cancel();
-	m_writeTimer.cancel();
-
-	try
-	{
-		if (m_socket->is_open())
-		{
-			boost::system::error_code error;
-			m_socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
-			m_socket->close();
-		}
-	}
-	catch (boost::system::system_error&)
-	{
-		//
-	}
-
-	delete m_socket;
-	m_socket = nullptr;
-
-	m_connectionLock.unlock();
-	ConnectionManager::getInstance()->releaseConnection(shared_from_this());
-}
-
-void Connection::deleteConnectionTask()
-{
-	//dispather thread
-	assert(m_refCount == 0);
-	try
-	{
-		m_io_context.dispatch(boost::bind(&Connection::onStopOperation, this));
-	}
-	catch (boost::system::system_error& e)
-	{
-		if (m_logError)
-		{
-			m_logError = false;
-		}
-	}
-}
-
-void Connection::acceptConnection(Protocol* protocol)
-{
-	m_protocol = protocol;
-	m_protocol->onConnect();
-
-	acceptConnection();
-}
-
-void Connection::acceptConnection()
-{
-	try
-	{
-		++m_pendingRead;
-		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
-		m_readTimer.async_wait(boost::bind(&Connection::handleReadTimeout,
-			boost::weak_ptr<Connection>(shared_from_this()),
-			boost::asio::placeholders::error));
-
-		// Read size of the first packet
-		boost::asio::async_read(getHandle(),
-			boost::asio::buffer(m_msg.getBuffer(), NetworkMessage::header_length),
-			boost::bind(&Connection::parseHeader, shared_from_this(), boost::asio::placeholders::error));
-	}
-	catch (boost::system::system_error& e)
-	{
-		if (m_logError)
-		{
-			m_logError = false;
-			closeConnection();
-		}
-	}
-}
-
-void Connection::parseHeader(const boost::system::error_code& error)
-{
-	m_connectionLock.lock();
-	m_readTimer.cancel();
-
-	int32_t size = m_msg.decodeHeader();
-	if (error || size <= 0 || size >= NETWORKMESSAGE_MAXSIZE - 16)
-	{
-		handleReadError(error);
-	}
-
-	if (m_connectionState != CONNECTION_STATE_OPEN || m_readError)
-	{
-		closeConnection();
-		m_connectionLock.unlock();
-		return;
-	}
-
-	--m_pendingRead;
-
-	try
-	{
-		++m_pendingRead;
-		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
-		m_readTimer
-			.async_wait(boost::bind(&Connection::handleReadTimeout, boost::weak_ptr<Connection>(shared_from_this()),
-				boost::asio::placeholders::error));
-
-		// Read packet content
-		m_msg.setMessageLength(size + NetworkMessage::header_length);
-		boost::asio::async_read(getHandle(), boost::asio::buffer(m_msg.getBodyBuffer(), size),
-			boost::bind(&Connection::parsePacket, shared_from_this(), boost::asio::placeholders::error));
-	}
-	catch (boost::system::system_error& e)
-	{
-		if (m_logError)
-		{
-			m_logError = false;
-			closeConnection();
-		}
-	}
-
-	m_connectionLock.unlock();
-}
-
-void Connection::parsePacket(const boost::system::error_code& error)
-{
-	m_connectionLock.lock();
-	m_readTimer.cancel();
-
-	if (error)
-	{
-		handleReadError(error);
-	}
-
-	if (m_connectionState != CONNECTION_STATE_OPEN || m_readError)
-	{
-		closeConnection();
-		m_connectionLock.unlock();
-		return;
-	}
-
-	--m_pendingRead;
-
-	//Check packet checksum
-	uint32_t recvChecksum = m_msg.PeekU32();
-	uint32_t checksum = 0;
-	int32_t len = m_msg.getMessageLength() - m_msg.getReadPos() - 4;
-	if (len > 0)
-	{
-		checksum = adlerChecksum((uint8_t*)(m_msg.getBuffer() + m_msg.getReadPos() + 4), len);
-	}
-
-	if (recvChecksum == checksum)
-		// remove the checksum
-		m_msg.GetU32();
-
-	if (!m_receivedFirst)
-	{
-		m_receivedFirst = true;
-		// First message received
-		if (!m_protocol)
-		{ // Game protocol has already been created at this point
-			m_protocol = m_service_port->make_protocol(recvChecksum == checksum, m_msg);
-			if (!m_protocol)
-			{
-				closeConnection();
-				m_connectionLock.unlock();
-				return;
-			}
-			m_protocol->setConnection(shared_from_this());
-		}
-		else
-		{
-			// Skip protocol ID
-			m_msg.GetByte();
-		}
-		m_protocol->onRecvFirstMessage(m_msg);
-	}
-	else
-	{
-		// Send the packet to the current protocol
-		m_protocol->onRecvMessage(m_msg);
-	}
-
-	try
-	{
-		++m_pendingRead;
-		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
-		m_readTimer
-			.async_wait(boost::bind(&Connection::handleReadTimeout, boost::weak_ptr<Connection>(shared_from_this()),
-				boost::asio::placeholders::error));
-
-		// Wait to the next packet
-		boost::asio::async_read(getHandle(),
-			boost::asio::buffer(m_msg.getBuffer(), NetworkMessage::header_length),
-			boost::bind(&Connection::parseHeader, shared_from_this(), boost::asio::placeholders::error));
-	}
-	catch (boost::system::system_error& e)
-	{
-		if (m_logError)
-		{
-			m_logError = false;
-			closeConnection();
-		}
-	}
-
-	m_connectionLock.unlock();
-}
-
-bool Connection::send(OutputMessage_ptr msg)
-{
-	m_connectionLock.lock();
-	if (m_connectionState != CONNECTION_STATE_OPEN || m_writeError)
-	{
-		m_connectionLock.unlock();
-		return false;
-	}
-
-	if (m_pendingWrite == 0)
-	{
-		msg->getProtocol()->onSendMessage(msg);
-		internalSend(msg);
-	}
-	else
-	{
-		OutputMessagePool* outputPool = OutputMessagePool::getInstance();
-		outputPool->addToAutoSend(msg);
-	}
-
-	m_connectionLock.unlock();
-	return true;
-}
-
-void Connection::internalSend(OutputMessage_ptr msg)
-{
-	TRACK_MESSAGE(msg);
-
-	try
-	{
-		++m_pendingWrite;
-		m_writeTimer.expires_from_now(boost::posix_time::seconds(Connection::write_timeout));
-		m_writeTimer
-			.async_wait(boost::bind(&Connection::handleWriteTimeout, boost::weak_ptr<Connection>(shared_from_this()),
-				boost::asio::placeholders::error));
-
-		boost::asio::async_write(getHandle(),
-			boost::asio::buffer(msg->getOutputBuffer(), msg->getMessageLength()),
-			boost::bind(&Connection::onWriteOperation, shared_from_this(), msg, boost::asio::placeholders::error));
-	}
-	catch (boost::system::system_error& e)
-	{
-		if (m_logError)
-		{
-			m_logError = false;
-		}
-	}
-}
-
-uint32_t Connection::getIP() const
-{
-	//Ip is expressed in network byte order
-	boost::system::error_code error;
-	const boost::asio::ip::tcp::endpoint endpoint = m_socket->remote_endpoint(error);
-	if (!error)
-	{
-		return htonl(endpoint.address().to_v4().to_ulong());
-	}
-	else
-	{
-		return 0;
-	}
-}
-
-uint32_t Connection::addRef()
-{
-	return ++m_refCount;
-}
-
-uint32_t Connection::unRef()
-{
-	return --m_refCount;
-}
-
-void Connection::onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error)
-{
-	m_connectionLock.lock();
-	m_writeTimer.cancel();
-
-	TRACK_MESSAGE(msg);
-	msg.reset();
-
-	if (error)
-	{
-		handleWriteError(error);
-	}
-
-	if (m_connectionState != CONNECTION_STATE_OPEN || m_writeError)
-	{
-		closeSocket();
-		closeConnection();
-		m_connectionLock.unlock();
-		return;
-	}
-
-	--m_pendingWrite;
-	m_connectionLock.unlock();
-}
-
-void Connection::handleReadError(const boost::system::error_code& error)
-{
-	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
-
-	if (error == boost::asio::error::operation_aborted)
-	{
-		//Operation aborted because connection will be closed
-		//Do NOT call closeConnection() from here
-	}
-	else if (error == boost::asio::error::eof)
-	{
-		//No more to read
-		closeConnection();
-	}
-	else if (error == boost::asio::error::connection_reset ||
-		error == boost::asio::error::connection_aborted)
-	{
-		//Connection closed remotely
-		closeConnection();
-	}
-	else
-	{
-		closeConnection();
-	}
-	m_readError = true;
-}
-
-void Connection::onReadTimeout()
-{
-	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
-
-	if (m_pendingRead > 0 || m_readError)
-	{
-		closeSocket();
-		closeConnection();
-	}
-}
-
-void Connection::onWriteTimeout()
-{
-	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
-
-	if (m_pendingWrite > 0 || m_writeError)
-	{
-		closeSocket();
-		closeConnection();
-	}
-}
-
-void Connection::handleReadTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error)
-{
-	if (error != boost::asio::error::operation_aborted)
-	{
-		if (weak_conn.expired())
-		{
-			return;
-		}
-
-		if (boost::shared_ptr<Connection> connection = weak_conn.lock())
-		{
-			connection->onReadTimeout();
-		}
-	}
-}
-
-void Connection::handleWriteError(const boost::system::error_code& error)
-{
-	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
-
-	if (error == boost::asio::error::operation_aborted)
-	{
-		//Operation aborted because connection will be closed
-		//Do NOT call closeConnection() from here
-	}
-	else if (error == boost::asio::error::eof)
-	{
-		//No more to read
-		closeConnection();
-	}
-	else if (error == boost::asio::error::connection_reset ||
-		error == boost::asio::error::connection_aborted)
-	{
-		//Connection closed remotely
-		closeConnection();
-	}
-	else
-	{
-		closeConnection();
-	}
-	m_writeError = true;
-}
-
-void Connection::handleWriteTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error)
-{
-	if (error != boost::asio::error::operation_aborted)
-	{
-		if (weak_conn.expired())
-		{
-			return;
-		}
-
-		if (boost::shared_ptr<Connection> connection = weak_conn.lock())
-		{
-			connection->onWriteTimeout();
-		}
-	}
-}
-
+//
+// Created by YLB on 2022/6/6.
+//
+
+#include "connection.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/read.hpp>
+
+#include "singleton.h"
+#include "public/handler_allocator.h"
+
+bool Connection::m_logError = true;
+
+Connection::Connection(boost::asio::ip::tcp::socket* socket,
+	boost::asio::io_context& ioc,
+	ServicePort_ptr service_port)
+	: m_socket(socket),
+	  m_readTimer(ioc),
+	  m_writeTimer(ioc),
+	  m_io_context(ioc),
+	  m_service_port(service_port),
+	  m_executor(boost::asio::use_service<priority_scheduler>(ioc).get_executor(handler_priority::normal))
+{
+	m_refCount = 0;
+	m_protocol = NULL;
+	m_pendingWrite = 0;
+	m_pendingRead = 0;
+	setConnectionState(CONNECTION_STATE_OPEN);
+	m_receivedFirst = false;
+	m_writeError = false;
+	m_readError = false;
+	m_writeStartUs = 0;
+	m_checksumEnabled = false;
+}
+
+Connection::~Connection()
+{
+}
+
+boost::asio::ip::tcp::socket& Connection::getHandle()
+{
+	return *m_socket;
+}
+
+void Connection::closeConnection()
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+	if (m_connectionState == CONNECTION_STATE_CLOSED || m_connectionState == CONNECTION_STATE_REQUEST_CLOSE)
+		return;
+
+	setConnectionState(CONNECTION_STATE_REQUEST_CLOSE);
+
+	g_dispatcher.addTask(
+		createTask(boost::bind(&Connection::closeConnectionTask, this)));
+}
+
+void Connection::setConnectionState(ConnectionState_t state)
+{
+	m_connectionState = state;
+	event_tracer::instant("connection_state", "connection", reinterpret_cast<uintptr_t>(this), state);
+}
+
+void Connection::closeConnectionTask()
+{
+	m_connectionLock.lock();
+	if (m_connectionState != CONNECTION_STATE_REQUEST_CLOSE)
+	{
+		std::cout << "Error: [Connection::closeConnectionTask] m_connectionState = " << m_connectionState << std::endl;
+		m_connectionLock.unlock();
+		return;
+	}
+
+	if (m_protocol)
+	{
+		m_protocol->setConnection(Connection_ptr());
+		m_protocol->releaseProtocol();
+		m_protocol = NULL;
+	}
+
+	setConnectionState(CONNECTION_STATE_CLOSING);
+
+	if (m_pendingWrite == 0 || m_writeError)
+	{
+		closeSocket();
+		releaseConnection();
+		setConnectionState(CONNECTION_STATE_CLOSED);
+	}
+	else
+	{
+		//will be closed by onWriteOperation/handleWriteTimeout/handleReadTimeout instead
+	}
+
+	m_connectionLock.unlock();
+}
+
+void Connection::closeSocket()
+{
+	m_connectionLock.lock();
+
+	if (m_socket->is_open())
+	{
+		m_pendingRead = 0;
+		m_pendingWrite = 0;
+
+		try
+		{
+			boost::system::error_code error;
+			m_socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+			if (error)
+			{
+				if (error == boost::asio::error::not_connected)
+				{
+					//Transport endpoint is not connected.
+				}
+				else
+				{
+					PRINT_ASIO_ERROR("Shutdown");
+				}
+			}
+			m_socket->close(error);
+
+			if (error)
+			{
+				PRINT_ASIO_ERROR("Close");
+			}
+		}
+		catch (boost::system::system_error& e)
+		{
+			if (m_logError)
+			{
+				m_logError = false;
+			}
+		}
+	}
+
+	m_connectionLock.unlock();
+}
+
+void Connection::releaseConnection()
+{
+	if (m_refCount > 0)
+	{
+		//Reschedule it and try again.
+		g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS,
+			boost::bind(&Connection::releaseConnection, this)));
+	}
+	else
+	{
+		deleteConnectionTask();
+	}
+}
+
+void Connection::onStopOperation()
+{
+	//io_context thread
+	m_connectionLock.lock();
+	m_readTimer.cancel();
+	m_writeTimer.cancel();
+
+	try
+	{
+		if (m_socket->is_open())
+		{
+			boost::system::error_code error;
+			m_socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+			m_socket->close();
+		}
+	}
+	catch (boost::system::system_error&)
+	{
+		//
+	}
+
+	delete m_socket;
+	m_socket = nullptr;
+	m_counters.detach();
+
+	m_connectionLock.unlock();
+	ConnectionManager::getInstance()->releaseConnection(shared_from_this());
+}
+
+void Connection::deleteConnectionTask()
+{
+	//dispather thread
+	assert(m_refCount == 0);
+	try
+	{
+		m_io_context.dispatch(boost::bind(&Connection::onStopOperation, this));
+	}
+	catch (boost::system::system_error& e)
+	{
+		if (m_logError)
+		{
+			m_logError = false;
+		}
+	}
+}
+
+void Connection::acceptConnection(Protocol* protocol)
+{
+	m_protocol = protocol;
+	m_protocol->onConnect();
+
+	acceptConnection();
+}
+
+void Connection::acceptConnection()
+{
+	boost::system::error_code endpointError;
+	boost::asio::ip::tcp::endpoint local = getHandle().local_endpoint(endpointError);
+	m_counters.attach(endpointError ? 0 : local.port());
+
+	try
+	{
+		++m_pendingRead;
+		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
+		m_readTimer.async_wait(make_custom_alloc_handler(m_readTimerMemory.next(), boost::bind(&Connection::handleReadTimeout,
+			boost::weak_ptr<Connection>(shared_from_this()),
+			boost::asio::placeholders::error)));
+
+		// Read size of the first packet
+		boost::asio::async_read(getHandle(),
+			boost::asio::buffer(m_msg.getBuffer(), NetworkMessage::header_length),
+			make_custom_alloc_handler(m_readMemory, boost::asio::bind_executor(m_executor,
+				boost::bind(&Connection::parseHeader, shared_from_this(), boost::asio::placeholders::error))));
+	}
+	catch (boost::system::system_error& e)
+	{
+		if (m_logError)
+		{
+			m_logError = false;
+			closeConnection();
+		}
+	}
+}
+
+void Connection::parseHeader(const boost::system::error_code& error)
+{
+	m_connectionLock.lock();
+	m_readTimer.cancel();
+
+	int32_t size = m_msg.decodeHeader();
+	if (error || size <= 0 || size >= NETWORKMESSAGE_MAXSIZE - 16)
+	{
+		handleReadError(error);
+	}
+
+	if (m_connectionState != CONNECTION_STATE_OPEN || m_readError)
+	{
+		closeConnection();
+		m_connectionLock.unlock();
+		return;
+	}
+
+	--m_pendingRead;
+
+	try
+	{
+		++m_pendingRead;
+		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
+		m_readTimer
+			.async_wait(make_custom_alloc_handler(m_readTimerMemory.next(), boost::bind(&Connection::handleReadTimeout,
+				boost::weak_ptr<Connection>(shared_from_this()), boost::asio::placeholders::error)));
+
+		// Read packet content
+		m_msg.setMessageLength(size + NetworkMessage::header_length);
+		boost::asio::async_read(getHandle(), boost::asio::buffer(m_msg.getBodyBuffer(), size),
+			make_custom_alloc_handler(m_readMemory, boost::asio::bind_executor(m_executor,
+				boost::bind(&Connection::parsePacket, shared_from_this(), boost::asio::placeholders::error))));
+	}
+	catch (boost::system::system_error& e)
+	{
+		if (m_logError)
+		{
+			m_logError = false;
+			closeConnection();
+		}
+	}
+
+	m_connectionLock.unlock();
+}
+
+void Connection::parsePacket(const boost::system::error_code& error)
+{
+	m_connectionLock.lock();
+	m_readTimer.cancel();
+
+	if (error)
+	{
+		handleReadError(error);
+	}
+
+	if (m_connectionState != CONNECTION_STATE_OPEN || m_readError)
+	{
+		closeConnection();
+		m_connectionLock.unlock();
+		return;
+	}
+
+	--m_pendingRead;
+
+	//Check packet checksum
+	uint32_t recvChecksum = m_msg.PeekU32();
+	uint32_t checksum = 0;
+	int32_t len = m_msg.getMessageLength() - m_msg.getReadPos() - 4;
+	if (len > 0)
+	{
+		checksum = adlerChecksum((uint8_t*)(m_msg.getBuffer() + m_msg.getReadPos() + 4), len);
+	}
+
+	if (recvChecksum == checksum)
+		// remove the checksum
+		m_msg.GetU32();
+
+	m_counters.onMessageRead(m_msg.getMessageLength());
+	if (!m_receivedFirst)
+	{
+		m_checksumEnabled = recvChecksum == checksum;
+	}
+	else if (m_checksumEnabled && recvChecksum != checksum)
+	{
+		m_counters.onChecksumFailure();
+	}
+
+	if (!m_receivedFirst)
+	{
+		m_receivedFirst = true;
+		// First message received
+		if (!m_protocol)
+		{ // Game protocol has already been created at this point
+			m_protocol = m_service_port->make_protocol(recvChecksum == checksum, m_msg);
+			if (!m_protocol)
+			{
+				closeConnection();
+				m_connectionLock.unlock();
+				return;
+			}
+			m_protocol->setConnection(shared_from_this());
+		}
+		else
+		{
+			// Skip protocol ID
+			m_msg.GetByte();
+		}
+		m_protocol->onRecvFirstMessage(m_msg);
+	}
+	else
+	{
+		// Send the packet to the current protocol
+		m_protocol->onRecvMessage(m_msg);
+	}
+
+	try
+	{
+		++m_pendingRead;
+		m_readTimer.expires_from_now(boost::posix_time::seconds(Connection::read_timeout));
+		m_readTimer
+			.async_wait(make_custom_alloc_handler(m_readTimerMemory.next(), boost::bind(&Connection::handleReadTimeout,
+				boost::weak_ptr<Connection>(shared_from_this()), boost::asio::placeholders::error)));
+
+		// Wait to the next packet
+		boost::asio::async_read(getHandle(),
+			boost::asio::buffer(m_msg.getBuffer(), NetworkMessage::header_length),
+			make_custom_alloc_handler(m_readMemory, boost::asio::bind_executor(m_executor,
+				boost::bind(&Connection::parseHeader, shared_from_this(), boost::asio::placeholders::error))));
+	}
+	catch (boost::system::system_error& e)
+	{
+		if (m_logError)
+		{
+			m_logError = false;
+			closeConnection();
+		}
+	}
+
+	m_connectionLock.unlock();
+}
+
+bool Connection::send(OutputMessage_ptr msg)
+{
+	m_connectionLock.lock();
+	if (m_connectionState != CONNECTION_STATE_OPEN || m_writeError)
+	{
+		m_connectionLock.unlock();
+		return false;
+	}
+
+	if (m_pendingWrite == 0)
+	{
+		msg->getProtocol()->onSendMessage(msg);
+		// send()可能在调度线程中调用，写和写超时的handler内存只能在io_context线程中分配和释放
+		++m_pendingWrite;
+		boost::asio::dispatch(m_io_context, boost::bind(&Connection::internalSend, shared_from_this(), msg));
+	}
+	else
+	{
+		OutputMessagePool* outputPool = OutputMessagePool::getInstance();
+		outputPool->addToAutoSend(msg);
+		m_counters.onDeferredSend();
+	}
+
+	m_connectionLock.unlock();
+	return true;
+}
+
+void Connection::internalSend(OutputMessage_ptr msg)
+{
+	//io_context thread
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+	TRACK_MESSAGE(msg);
+
+	if (m_socket == nullptr)
+	{
+		return;
+	}
+	if (!m_socket->is_open())
+	{
+		// 投递之后连接已经关闭，按写被取消处理
+		onWriteOperation(msg, boost::asio::error::operation_aborted);
+		return;
+	}
+
+	try
+	{
+		m_writeStartUs = m_counters.onWriteStart();
+		m_writeTimer.expires_from_now(boost::posix_time::seconds(Connection::write_timeout));
+		m_writeTimer
+			.async_wait(make_custom_alloc_handler(m_writeTimerMemory.next(), boost::bind(&Connection::handleWriteTimeout,
+				boost::weak_ptr<Connection>(shared_from_this()), boost::asio::placeholders::error)));
+
+		boost::asio::async_write(getHandle(),
+			boost::asio::buffer(msg->getOutputBuffer(), msg->getMessageLength()),
+			make_custom_alloc_handler(m_writeMemory, boost::asio::bind_executor(m_executor,
+				boost::bind(&Connection::onWriteOperation, shared_from_this(), msg, boost::asio::placeholders::error))));
+	}
+	catch (boost::system::system_error& e)
+	{
+		if (m_logError)
+		{
+			m_logError = false;
+		}
+	}
+}
+
+void Connection::setPriority(handler_priority priority)
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+	m_executor = boost::asio::use_service<priority_scheduler>(m_io_context).get_executor(priority);
+}
+
+uint32_t Connection::getIP() const
+{
+	//Ip is expressed in network byte order
+	boost::system::error_code error;
+	const boost::asio::ip::tcp::endpoint endpoint = m_socket->remote_endpoint(error);
+	if (!error)
+	{
+		return htonl(endpoint.address().to_v4().to_ulong());
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+const ConnectionCounters& Connection::getCounters() const
+{
+	return m_counters;
+}
+
+uint32_t Connection::addRef()
+{
+	return ++m_refCount;
+}
+
+uint32_t Connection::unRef()
+{
+	return --m_refCount;
+}
+
+void Connection::onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error)
+{
+	m_connectionLock.lock();
+	m_writeTimer.cancel();
+
+	TRACK_MESSAGE(msg);
+	m_counters.onWriteComplete(m_writeStartUs, msg->getMessageLength(), !error);
+	msg.reset();
+
+	if (error)
+	{
+		handleWriteError(error);
+	}
+
+	if (m_connectionState != CONNECTION_STATE_OPEN || m_writeError)
+	{
+		closeSocket();
+		closeConnection();
+		m_connectionLock.unlock();
+		return;
+	}
+
+	--m_pendingWrite;
+	m_connectionLock.unlock();
+}
+
+void Connection::handleReadError(const boost::system::error_code& error)
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+
+	if (error == boost::asio::error::operation_aborted)
+	{
+		//Operation aborted because connection will be closed
+		//Do NOT call closeConnection() from here
+	}
+	else if (error == boost::asio::error::eof)
+	{
+		//No more to read
+		closeConnection();
+	}
+	else if (error == boost::asio::error::connection_reset ||
+		error == boost::asio::error::connection_aborted)
+	{
+		//Connection closed remotely
+		closeConnection();
+	}
+	else
+	{
+		closeConnection();
+	}
+	m_readError = true;
+}
+
+void Connection::onReadTimeout()
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+
+	if (m_pendingRead > 0 || m_readError)
+	{
+		closeSocket();
+		closeConnection();
+	}
+}
+
+void Connection::onWriteTimeout()
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+
+	if (m_pendingWrite > 0 || m_writeError)
+	{
+		closeSocket();
+		closeConnection();
+	}
+}
+
+void Connection::handleReadTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error)
+{
+	if (error != boost::asio::error::operation_aborted)
+	{
+		if (weak_conn.expired())
+		{
+			return;
+		}
+
+		if (boost::shared_ptr<Connection> connection = weak_conn.lock())
+		{
+			connection->onReadTimeout();
+		}
+	}
+}
+
+void Connection::handleWriteError(const boost::system::error_code& error)
+{
+	boost::recursive_mutex::scoped_lock lockClass(m_connectionLock);
+
+	if (error == boost::asio::error::operation_aborted)
+	{
+		//Operation aborted because connection will be closed
+		//Do NOT call closeConnection() from here
+	}
+	else if (error == boost::asio::error::eof)
+	{
+		//No more to read
+		closeConnection();
+	}
+	else if (error == boost::asio::error::connection_reset ||
+		error == boost::asio::error::connection_aborted)
+	{
+		//Connection closed remotely
+		closeConnection();
+	}
+	else
+	{
+		closeConnection();
+	}
+	m_writeError = true;
+}
+
+void Connection::handleWriteTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error)
+{
+	if (error != boost::asio::error::operation_aborted)
+	{
+		if (weak_conn.expired())
+		{
+			return;
+		}
+
+		if (boost::shared_ptr<Connection> connection = weak_conn.lock())
+		{
+			connection->onWriteTimeout();
+		}
+	}
+}
+
+
+void ConnectionManager::dumpStats(std::ostream& os, std::size_t topConnections)
+{
+	ConnectionStats::getInstance().dump(os);
+
+	// 计数本身不需要锁，这里的锁只保护连接列表
+	std::vector<std::pair<uint64_t, Connection_ptr>> connections;
+	{
+		boost::recursive_mutex::scoped_lock lockClass(m_connectionManagerLock);
+		for (const Connection_ptr& connection : m_connections)
+		{
+			TrafficSnapshot traffic = connection->getCounters().getTraffic();
+			connections.emplace_back(traffic.bytesIn + traffic.bytesOut, connection);
+		}
+	}
+
+	std::size_t count = std::min(topConnections, connections.size());
+	std::partial_sort(connections.begin(), connections.begin() + count, connections.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; });
+
+	os << "ip                port      msg_in     msg_out      bytes_in     bytes_out  crc_fail queue\n";
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const Connection_ptr& connection = connections[i].second;
+		const ConnectionCounters& counters = connection->getCounters();
+		TrafficSnapshot traffic = counters.getTraffic();
+		uint32_t ip = ntohl(connection->getIP());
+		char address[16];
+		std::snprintf(address, sizeof(address), "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+		char line[200];
+		std::snprintf(line, sizeof(line), "%-15s %6u %11llu %11llu %13llu %13llu %9llu %5lld\n",
+			address, counters.getPortStats() ? counters.getPortStats()->getPort() : 0,
+			static_cast<unsigned long long>(traffic.messagesIn), static_cast<unsigned long long>(traffic.messagesOut),
+			static_cast<unsigned long long>(traffic.bytesIn), static_cast<unsigned long long>(traffic.bytesOut),
+			static_cast<unsigned long long>(traffic.checksumFailures),
+			static_cast<long long>(counters.getSendQueueDepth()));
+		os << line;
+	}
+}
@@ -1,115 +1,151 @@
-//
-// Created by YLB on 2022/6/6.
-//
-
-#ifndef CONNECTION_H
-#define CONNECTION_H
-
-#include <boost/noncopyable.hpp>
-#include <boost/enable_shared_from_this.hpp>
-#include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/io_context.hpp>
-#include <boost/asio/deadline_timer.hpp>
-#include <boost/thread/recursive_mutex.hpp>
-
-class Connection;
-class ServiceBase;
-class ServicePort;
-
-typedef boost::shared_ptr<Connection> Connection_ptr;
-typedef boost::shared_ptr<ServiceBase> Service_ptr;
-typedef boost::shared_ptr<ServicePort> ServicePort_ptr;
-
-class Connection : public boost::enable_shared_from_this<Connection>, boost::noncopyable
-{
-	friend class ConnectionManager;
-
-public:
-	Connection(boost::asio::ip::tcp::socket* socket,
-		boost::asio::io_context& ioc,
-		ServicePort_ptr service_port);
-	~Connection();
-
-	enum { write_timeout = 30 };
-	enum { read_timeout = 30 };
-
-	enum ConnectionState_t {
-		CONNECTION_STATE_OPEN = 0,
-		CONNECTION_STATE_REQUEST_CLOSE = 1,
-		CONNECTION_STATE_CLOSING = 2,
-		CONNECTION_STATE_CLOSED = 3
-	};
-
-	boost::asio::ip::tcp::socket& getHandle();
-
-	void closeConnection();
-	// Used by protocols that require server to send first
-	void acceptConnection(Protocol* protocol);
-	void acceptConnection();
-
-	bool send(OutputMessage_ptr msg);
-
-	uint32_t getIP() const;
-
-	uint32_t addRef();
-	uint32_t unRef();
-
-private:
-	void parseHeader(const boost::system::error_code& error);
-	void parsePacket(const boost::system::error_code& error);
-
-	void onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error);
-
-	void onStopOperation();
-	void handleReadError(const boost::system::error_code& error);
-	void handleWriteError(const boost::system::error_code& error);
-
-	static void handleReadTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error);
-	static void handleWriteTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error);
-
-	void closeConnectionTask();
-	void deleteConnectionTask();
-	void releaseConnection();
-	void closeSocket();
-	void onReadTimeout();
-	void onWriteTimeout();
-
-	void internalSend(OutputMessage_ptr msg);
-
-	NetworkMessage m_msg;
-	boost::asio::ip::tcp::socket* m_socket;
-	boost::asio::deadline_timer m_readTimer;
-	boost::asio::deadline_timer m_writeTimer;
-	boost::asio::io_context& m_io_context;
-	ServicePort_ptr m_service_port;
-	bool m_receivedFirst;
-	bool m_writeError;
-	bool m_readError;
-
-	int32_t m_pendingWrite;
-	int32_t m_pendingRead;
-	ConnectionState_t m_connectionState;
-	uint32_t m_refCount;
-	static bool m_logError;
-	boost::recursive_mutex m_connectionLock;
-
-	Protocol* m_protocol;
-};
-
-class ConnectionManager
-{
-public:
-	static ConnectionManager* getInstance();
-
-	Connection_ptr createConnection(boost::asio::ip::tcp::socket* socket,
-		boost::asio::io_context& io_context, ServicePort_ptr servicers);
-	void releaseConnection(Connection_ptr connection);
-	void closeAll();
-
-protected:
-	std::list<Connection_ptr> m_connections;
-	boost::recursive_mutex m_connectionManagerLock;
-};
-
-
-#endif //CONNECTION_H
+//
+// Created by YLB on 2022/6/6.
+//
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+
+#include <iosfwd>
+#include <list>
+
+#include "public/handler_allocator.h"
+#include "public/priority_scheduler.h"
+#include "public/event_tracer.h"
+#include "connection_stats.h"
+
+class Connection;
+class ServiceBase;
+class ServicePort;
+
+typedef boost::shared_ptr<Connection> Connection_ptr;
+typedef boost::shared_ptr<ServiceBase> Service_ptr;
+typedef boost::shared_ptr<ServicePort> ServicePort_ptr;
+
+class Connection : public boost::enable_shared_from_this<Connection>, boost::noncopyable
+{
+	friend class ConnectionManager;
+
+public:
+	Connection(boost::asio::ip::tcp::socket* socket,
+		boost::asio::io_context& ioc,
+		ServicePort_ptr service_port);
+	~Connection();
+
+	enum { write_timeout = 30 };
+	enum { read_timeout = 30 };
+
+	enum ConnectionState_t {
+		CONNECTION_STATE_OPEN = 0,
+		CONNECTION_STATE_REQUEST_CLOSE = 1,
+		CONNECTION_STATE_CLOSING = 2,
+		CONNECTION_STATE_CLOSED = 3
+	};
+
+	boost::asio::ip::tcp::socket& getHandle();
+
+	void closeConnection();
+	// Used by protocols that require server to send first
+	void acceptConnection(Protocol* protocol);
+	void acceptConnection();
+
+	bool send(OutputMessage_ptr msg);
+
+	// 之后发起的读写完成时按这个优先级调度，例如控制连接设为urgent、批量传输设为bulk
+	void setPriority(handler_priority priority);
+
+	uint32_t getIP() const;
+
+	// 流量和写延迟计数，可在任意线程不加锁读取
+	const ConnectionCounters& getCounters() const;
+
+	uint32_t addRef();
+	uint32_t unRef();
+
+private:
+	void parseHeader(const boost::system::error_code& error);
+	void parsePacket(const boost::system::error_code& error);
+
+	void onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error);
+
+	void onStopOperation();
+	void handleReadError(const boost::system::error_code& error);
+	void handleWriteError(const boost::system::error_code& error);
+
+	static void handleReadTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error);
+	static void handleWriteTimeout(boost::weak_ptr<Connection> weak_conn, const boost::system::error_code& error);
+
+	// 修改连接状态并记录一个跟踪事件
+	void setConnectionState(ConnectionState_t state);
+
+	void closeConnectionTask();
+	void deleteConnectionTask();
+	void releaseConnection();
+	void closeSocket();
+	void onReadTimeout();
+	void onWriteTimeout();
+
+	void internalSend(OutputMessage_ptr msg);
+
+	NetworkMessage m_msg;
+	boost::asio::ip::tcp::socket* m_socket;
+	boost::asio::deadline_timer m_readTimer;
+	boost::asio::deadline_timer m_writeTimer;
+	boost::asio::io_context& m_io_context;
+	ServicePort_ptr m_service_port;
+	bool m_receivedFirst;
+	bool m_writeError;
+	bool m_readError;
+
+	int32_t m_pendingWrite;
+	int32_t m_pendingRead;
+	ConnectionState_t m_connectionState;
+	uint32_t m_refCount;
+	static bool m_logError;
+	boost::recursive_mutex m_connectionLock;
+
+	Protocol* m_protocol;
+
+	// 同时计入本地端口和全局的汇总；同一时刻最多一个写在进行，m_writeStartUs是它的发起时间
+	ConnectionCounters m_counters;
+	uint64_t m_writeStartUs;
+	// 第一条消息校验和正确时认为协议使用校验和，之后的不匹配计为校验失败
+	bool m_checksumEnabled;
+
+	// 读写完成handler经io_context上的priority_scheduler执行
+	priority_scheduler::executor_type m_executor;
+
+	// 异步操作的handler内存：读、写和两个超时定时器会同时挂起，各用一块。
+	// 定时器每次都是cancel后立即重新等待，交替使用两块；全部只在io_context线程中分配和释放
+	handler_memory m_readMemory;
+	handler_memory m_writeMemory;
+	alternating_handler_memory m_readTimerMemory;
+	alternating_handler_memory m_writeTimerMemory;
+};
+
+class ConnectionManager
+{
+public:
+	static ConnectionManager* getInstance();
+
+	Connection_ptr createConnection(boost::asio::ip::tcp::socket* socket,
+		boost::asio::io_context& io_context, ServicePort_ptr servicers);
+	void releaseConnection(Connection_ptr connection);
+	void closeAll();
+
+	// 输出全局和各端口的汇总，以及收发字节最多的topConnections个连接
+	void dumpStats(std::ostream& os, std::size_t topConnections = 10);
+
+protected:
+	std::list<Connection_ptr> m_connections;
+	boost::recursive_mutex m_connectionManagerLock;
+};
+
+
+#endif //CONNECTION_H
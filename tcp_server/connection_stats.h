@@ -0,0 +1,436 @@
+#ifndef CONNECTION_STATS_H
+#define CONNECTION_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <thread>
+
+// 连接的流量和延迟统计，按连接、监听端口（ServicePort）和全局三级汇总。
+// 所有计数都是relaxed原子量，读取不加锁，不会阻塞I/O线程。
+// 端口和全局的计数（包括写延迟分布）被很多连接同时更新，分成若干个按线程选择的条带，
+// 各自独占缓存行，读取时再求和。
+
+// 写延迟分布：以微秒为单位的2的幂分桶，第i个桶统计[2^(i-1), 2^i)微秒
+class WriteLatencyHistogram
+{
+public:
+	enum { bucket_count = 32 };
+
+	using Buckets = std::array<uint64_t, bucket_count>;
+
+	void record(uint64_t us)
+	{
+		std::size_t index = us == 0 ? 0 : 64 - __builtin_clzll(us);
+		if (index >= bucket_count)
+		{
+			index = bucket_count - 1;
+		}
+		m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint64_t getBucket(std::size_t index) const
+	{
+		return m_buckets[index].load(std::memory_order_relaxed);
+	}
+
+	void addTo(Buckets& buckets) const
+	{
+		for (std::size_t i = 0; i < bucket_count; ++i)
+		{
+			buckets[i] += getBucket(i);
+		}
+	}
+
+	/// 近似百分位（返回所在桶的上界，微秒）
+	uint64_t getPercentile(double p) const
+	{
+		Buckets buckets{};
+		addTo(buckets);
+		return getPercentile(buckets, p);
+	}
+
+	static uint64_t getPercentile(const Buckets& buckets, double p)
+	{
+		uint64_t total = 0;
+		for (uint64_t count : buckets)
+		{
+			total += count;
+		}
+		if (total == 0)
+		{
+			return 0;
+		}
+
+		uint64_t target = static_cast<uint64_t>(total * p / 100.0);
+		uint64_t seen = 0;
+		for (std::size_t i = 0; i < bucket_count; ++i)
+		{
+			seen += buckets[i];
+			if (seen > target)
+			{
+				return uint64_t(1) << i;
+			}
+		}
+		return uint64_t(1) << (bucket_count - 1);
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+};
+
+// 一组计数的普通值拷贝，用于读取和排序
+struct TrafficSnapshot
+{
+	uint64_t bytesIn = 0;
+	uint64_t bytesOut = 0;
+	uint64_t messagesIn = 0;
+	uint64_t messagesOut = 0;
+	uint64_t checksumFailures = 0;
+	uint64_t deferredSends = 0;     // 有写在进行时交给OutputMessagePool自动发送的消息
+};
+
+struct alignas(64) TrafficCounters
+{
+	std::atomic<uint64_t> bytesIn{0};
+	std::atomic<uint64_t> bytesOut{0};
+	std::atomic<uint64_t> messagesIn{0};
+	std::atomic<uint64_t> messagesOut{0};
+	std::atomic<uint64_t> checksumFailures{0};
+	std::atomic<uint64_t> deferredSends{0};
+
+	void addTo(TrafficSnapshot& snapshot) const
+	{
+		snapshot.bytesIn += bytesIn.load(std::memory_order_relaxed);
+		snapshot.bytesOut += bytesOut.load(std::memory_order_relaxed);
+		snapshot.messagesIn += messagesIn.load(std::memory_order_relaxed);
+		snapshot.messagesOut += messagesOut.load(std::memory_order_relaxed);
+		snapshot.checksumFailures += checksumFailures.load(std::memory_order_relaxed);
+		snapshot.deferredSends += deferredSends.load(std::memory_order_relaxed);
+	}
+};
+
+// 一个监听端口（或全局）的汇总
+class PortStats
+{
+public:
+	enum { stripe_count = 8 };
+
+	uint16_t getPort() const
+	{
+		return static_cast<uint16_t>(m_port.load(std::memory_order_acquire));
+	}
+
+	TrafficSnapshot getTraffic() const
+	{
+		TrafficSnapshot snapshot;
+		for (const auto& stripe : m_stripes)
+		{
+			stripe.traffic.addTo(snapshot);
+		}
+		return snapshot;
+	}
+
+	int64_t getActiveConnections() const
+	{
+		return m_activeConnections.load(std::memory_order_relaxed);
+	}
+
+	uint64_t getTotalConnections() const
+	{
+		return m_totalConnections.load(std::memory_order_relaxed);
+	}
+
+	/// 已发起但还没完成的写
+	int64_t getSendQueueDepth() const
+	{
+		return m_sendQueueDepth.load(std::memory_order_relaxed);
+	}
+
+	/// 各条带写延迟分布的合计
+	WriteLatencyHistogram::Buckets getWriteLatency() const
+	{
+		WriteLatencyHistogram::Buckets buckets{};
+		for (const auto& stripe : m_stripes)
+		{
+			stripe.writeLatency.addTo(buckets);
+		}
+		return buckets;
+	}
+
+	uint64_t getWriteLatencyPercentile(double p) const
+	{
+		return WriteLatencyHistogram::getPercentile(getWriteLatency(), p);
+	}
+
+private:
+	friend class ConnectionStats;
+	friend class ConnectionCounters;
+
+	struct alignas(64) Stripe
+	{
+		TrafficCounters traffic;
+		WriteLatencyHistogram writeLatency;
+	};
+
+	Stripe& stripe()
+	{
+		thread_local const std::size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % stripe_count;
+		return m_stripes[index];
+	}
+
+	std::atomic<uint32_t> m_port{0};
+	std::array<Stripe, stripe_count> m_stripes;
+	std::atomic<int64_t> m_activeConnections{0};
+	std::atomic<uint64_t> m_totalConnections{0};
+	std::atomic<int64_t> m_sendQueueDepth{0};
+};
+
+// 按端口登记的汇总表：固定数量的槽位，第一次出现的端口用CAS占用一个空槽，之后的查找和更新都不加锁。
+// 槽位用完后新端口只计入全局。
+class ConnectionStats
+{
+public:
+	enum { max_ports = 64 };
+
+	static ConnectionStats& getInstance()
+	{
+		static ConnectionStats instance;
+		return instance;
+	}
+
+	/// 端口对应的汇总，端口为0或槽位已满时返回nullptr
+	PortStats* getPort(uint16_t port)
+	{
+		if (port == 0)
+		{
+			return nullptr;
+		}
+
+		for (auto& slot : m_ports)
+		{
+			uint32_t current = slot.m_port.load(std::memory_order_acquire);
+			if (current == port)
+			{
+				return &slot;
+			}
+			if (current == 0)
+			{
+				uint32_t expected = 0;
+				if (slot.m_port.compare_exchange_strong(expected, port, std::memory_order_acq_rel)
+					|| expected == port)
+				{
+					return &slot;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	PortStats& getGlobal()
+	{
+		return m_global;
+	}
+
+	/// 输出全局和各端口的汇总
+	void dump(std::ostream& os)
+	{
+		os << "port     active      total      msg_in     msg_out      bytes_in     bytes_out  crc_fail"
+			" deferred queue  write_p50_us  write_p99_us\n";
+		dumpLine(os, "all", m_global);
+		for (auto& slot : m_ports)
+		{
+			uint16_t port = slot.getPort();
+			if (port != 0)
+			{
+				char name[8];
+				std::snprintf(name, sizeof(name), "%u", port);
+				dumpLine(os, name, slot);
+			}
+		}
+	}
+
+private:
+	ConnectionStats() = default;
+
+	static void dumpLine(std::ostream& os, const char* name, const PortStats& stats)
+	{
+		TrafficSnapshot traffic = stats.getTraffic();
+		WriteLatencyHistogram::Buckets writeLatency = stats.getWriteLatency();
+		char line[200];
+		std::snprintf(line, sizeof(line), "%-6s %8lld %10llu %11llu %11llu %13llu %13llu %9llu %8llu %5lld %13llu %13llu\n",
+			name, static_cast<long long>(stats.getActiveConnections()),
+			static_cast<unsigned long long>(stats.getTotalConnections()),
+			static_cast<unsigned long long>(traffic.messagesIn), static_cast<unsigned long long>(traffic.messagesOut),
+			static_cast<unsigned long long>(traffic.bytesIn), static_cast<unsigned long long>(traffic.bytesOut),
+			static_cast<unsigned long long>(traffic.checksumFailures),
+			static_cast<unsigned long long>(traffic.deferredSends),
+			static_cast<long long>(stats.getSendQueueDepth()),
+			static_cast<unsigned long long>(WriteLatencyHistogram::getPercentile(writeLatency, 50.0)),
+			static_cast<unsigned long long>(WriteLatencyHistogram::getPercentile(writeLatency, 99.0)));
+		os << line;
+	}
+
+	std::array<PortStats, max_ports> m_ports;
+	PortStats m_global;
+};
+
+// 单个连接的计数，同时累加到所属端口和全局的汇总
+class ConnectionCounters
+{
+public:
+	ConnectionCounters() = default;
+	ConnectionCounters(const ConnectionCounters&) = delete;
+	ConnectionCounters& operator=(const ConnectionCounters&) = delete;
+
+	~ConnectionCounters()
+	{
+		detach();
+	}
+
+	/// 连接建立后按本地端口登记，只调用一次
+	void attach(uint16_t localPort)
+	{
+		if (m_attached)
+		{
+			return;
+		}
+		m_attached = true;
+		m_port = ConnectionStats::getInstance().getPort(localPort);
+		forEach([](PortStats& stats)
+		{
+			stats.m_activeConnections.fetch_add(1, std::memory_order_relaxed);
+			stats.m_totalConnections.fetch_add(1, std::memory_order_relaxed);
+		});
+	}
+
+	void detach()
+	{
+		if (!m_attached)
+		{
+			return;
+		}
+		m_attached = false;
+		int64_t queued = m_sendQueueDepth.exchange(0, std::memory_order_relaxed);
+		forEach([queued](PortStats& stats)
+		{
+			stats.m_activeConnections.fetch_sub(1, std::memory_order_relaxed);
+			stats.m_sendQueueDepth.fetch_sub(queued, std::memory_order_relaxed);
+		});
+	}
+
+	void onMessageRead(uint32_t bytes)
+	{
+		m_traffic.bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+		m_traffic.messagesIn.fetch_add(1, std::memory_order_relaxed);
+		forEach([bytes](PortStats& stats)
+		{
+			TrafficCounters& stripe = stats.stripe().traffic;
+			stripe.bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+			stripe.messagesIn.fetch_add(1, std::memory_order_relaxed);
+		});
+	}
+
+	void onChecksumFailure()
+	{
+		m_traffic.checksumFailures.fetch_add(1, std::memory_order_relaxed);
+		forEach([](PortStats& stats)
+		{
+			stats.stripe().traffic.checksumFailures.fetch_add(1, std::memory_order_relaxed);
+		});
+	}
+
+	void onDeferredSend()
+	{
+		m_traffic.deferredSends.fetch_add(1, std::memory_order_relaxed);
+		forEach([](PortStats& stats)
+		{
+			stats.stripe().traffic.deferredSends.fetch_add(1, std::memory_order_relaxed);
+		});
+	}
+
+	// 发起写时调用，返回的时间戳传给onWriteComplete
+	uint64_t onWriteStart()
+	{
+		m_sendQueueDepth.fetch_add(1, std::memory_order_relaxed);
+		forEach([](PortStats& stats)
+		{
+			stats.m_sendQueueDepth.fetch_add(1, std::memory_order_relaxed);
+		});
+		return nowUs();
+	}
+
+	void onWriteComplete(uint64_t startUs, uint32_t bytes, bool success)
+	{
+		if (m_sendQueueDepth.load(std::memory_order_relaxed) > 0)
+		{
+			m_sendQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+			forEach([](PortStats& stats)
+			{
+				stats.m_sendQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+			});
+		}
+		if (!success)
+		{
+			return;
+		}
+
+		uint64_t elapsed = nowUs() - startUs;
+		m_traffic.bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+		m_traffic.messagesOut.fetch_add(1, std::memory_order_relaxed);
+		forEach([bytes, elapsed](PortStats& stats)
+		{
+			PortStats::Stripe& stripe = stats.stripe();
+			stripe.traffic.bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+			stripe.traffic.messagesOut.fetch_add(1, std::memory_order_relaxed);
+			stripe.writeLatency.record(elapsed);
+		});
+	}
+
+	TrafficSnapshot getTraffic() const
+	{
+		TrafficSnapshot snapshot;
+		m_traffic.addTo(snapshot);
+		return snapshot;
+	}
+
+	int64_t getSendQueueDepth() const
+	{
+		return m_sendQueueDepth.load(std::memory_order_relaxed);
+	}
+
+	/// 所属端口的汇总，未登记或槽位已满时为nullptr
+	const PortStats* getPortStats() const
+	{
+		return m_port;
+	}
+
+private:
+	static uint64_t nowUs()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	template<typename F>
+	void forEach(F f)
+	{
+		if (m_port)
+		{
+			f(*m_port);
+		}
+		f(ConnectionStats::getInstance().getGlobal());
+	}
+
+	TrafficCounters m_traffic;
+	std::atomic<int64_t> m_sendQueueDepth{0};
+	PortStats* m_port = nullptr;
+	bool m_attached = false;
+};
+
+#endif //CONNECTION_STATS_H
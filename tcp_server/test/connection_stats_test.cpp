@@ -0,0 +1,171 @@
+// connection_stats.h的多线程检查：
+// 多个线程各自建立若干连接的计数，分别挂在两个端口上并发收发，
+// 结束后核对连接、端口和全局三级的流量、活跃连接数、发送队列深度和写延迟分布。
+// tcp_server依赖的NetworkMessage等类型不在这个仓库里，计数部分单独构建和测试。
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcp_server/connection_stats.h"
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* expression, int line)
+	{
+		if (!condition)
+		{
+			std::cerr << "line " << line << ": check failed: " << expression << "\n";
+			++failures;
+		}
+	}
+
+#define CHECK(expression) check((expression), #expression, __LINE__)
+
+	enum
+	{
+		thread_count = 8,
+		connections_per_thread = 4,
+		messages_per_connection = 10000,
+		read_bytes = 100,
+		write_bytes = 200
+	};
+
+	const uint16_t ports[] = {7171, 7172};
+
+	void run()
+	{
+		std::vector<std::unique_ptr<ConnectionCounters>> connections;
+		for (int i = 0; i < connections_per_thread; ++i)
+		{
+			connections.push_back(std::make_unique<ConnectionCounters>());
+			connections.back()->attach(ports[i % 2]);
+		}
+
+		for (int n = 0; n < messages_per_connection; ++n)
+		{
+			for (auto& connection : connections)
+			{
+				connection->onMessageRead(read_bytes);
+				uint64_t start = connection->onWriteStart();
+				connection->onWriteComplete(start, write_bytes, true);
+			}
+		}
+
+		// 失败的写只减少发送队列深度，不计入流量
+		uint64_t start = connections.front()->onWriteStart();
+		connections.front()->onWriteComplete(start, write_bytes, false);
+		connections.front()->onChecksumFailure();
+		connections.back()->onDeferredSend();
+
+		for (const auto& connection : connections)
+		{
+			TrafficSnapshot traffic = connection->getTraffic();
+			CHECK(traffic.messagesIn == messages_per_connection);
+			CHECK(traffic.bytesIn == uint64_t(messages_per_connection) * read_bytes);
+			CHECK(traffic.messagesOut == messages_per_connection);
+			CHECK(traffic.bytesOut == uint64_t(messages_per_connection) * write_bytes);
+			CHECK(connection->getSendQueueDepth() == 0);
+			CHECK(connection->getPortStats() != nullptr);
+		}
+		CHECK(connections.front()->getTraffic().checksumFailures == 1);
+		CHECK(connections.back()->getTraffic().deferredSends == 1);
+	}
+
+	uint64_t total(const WriteLatencyHistogram::Buckets& buckets)
+	{
+		uint64_t sum = 0;
+		for (uint64_t count : buckets)
+		{
+			sum += count;
+		}
+		return sum;
+	}
+}
+
+int main()
+{
+	ConnectionStats& stats = ConnectionStats::getInstance();
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < thread_count; ++i)
+	{
+		threads.emplace_back(run);
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	const uint64_t connections = uint64_t(thread_count) * connections_per_thread;
+	const uint64_t messages = connections * messages_per_connection;
+
+	PortStats& global = stats.getGlobal();
+	TrafficSnapshot traffic = global.getTraffic();
+	CHECK(traffic.messagesIn == messages);
+	CHECK(traffic.bytesIn == messages * read_bytes);
+	CHECK(traffic.messagesOut == messages);
+	CHECK(traffic.bytesOut == messages * write_bytes);
+	CHECK(traffic.checksumFailures == thread_count);
+	CHECK(traffic.deferredSends == thread_count);
+	CHECK(global.getTotalConnections() == connections);
+	CHECK(global.getActiveConnections() == 0);
+	CHECK(global.getSendQueueDepth() == 0);
+	CHECK(total(global.getWriteLatency()) == messages);
+	CHECK(global.getWriteLatencyPercentile(50.0) <= global.getWriteLatencyPercentile(99.0));
+
+	for (uint16_t port : ports)
+	{
+		PortStats* portStats = stats.getPort(port);
+		CHECK(portStats != nullptr);
+		if (portStats == nullptr)
+		{
+			continue;
+		}
+
+		CHECK(portStats->getPort() == port);
+		CHECK(portStats->getTraffic().messagesIn == messages / 2);
+		CHECK(portStats->getTraffic().bytesOut == messages / 2 * write_bytes);
+		CHECK(portStats->getTotalConnections() == connections / 2);
+		CHECK(portStats->getActiveConnections() == 0);
+		CHECK(total(portStats->getWriteLatency()) == messages / 2);
+	}
+
+	// 端口0不登记，只计入全局
+	{
+		ConnectionCounters counters;
+		counters.attach(0);
+		CHECK(counters.getPortStats() == nullptr);
+		CHECK(global.getActiveConnections() == 1);
+	}
+	CHECK(global.getActiveConnections() == 0);
+
+	WriteLatencyHistogram histogram;
+	histogram.record(0);
+	histogram.record(3);
+	histogram.record(1000);
+	CHECK(histogram.getBucket(0) == 1);
+	CHECK(histogram.getBucket(2) == 1);
+	CHECK(histogram.getBucket(10) == 1);
+	CHECK(histogram.getPercentile(99.0) == 1024);
+
+	std::ostringstream dump;
+	stats.dump(dump);
+	CHECK(dump.str().find("7171") != std::string::npos);
+	CHECK(dump.str().find("7172") != std::string::npos);
+
+	if (failures != 0)
+	{
+		std::cerr << failures << " checks failed\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "connection_stats: all checks passed\n";
+	return EXIT_SUCCESS;
+}
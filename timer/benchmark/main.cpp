@@ -0,0 +1,219 @@
+// 周期定时器开销对比：单线程io_context上注册tickers个周期回调，周期在periods中轮流取值，运行duration秒。
+// per-object: 每个对象持有一个steady_timer，每次到期后expires_at(上次到期+周期)并重新async_wait。
+// coalesced:  所有对象注册到periodic_timer_service，同一周期共用一个定时器，到期时顺序遍历回调数组。
+// 统计注册和取消的耗时、运行期间的CPU时间、实际触发次数、每次触发的CPU开销，
+// 以及每次回调相对计划到期时间的延迟分布。
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+#include "public/periodic_timer.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct bench_options {
+    std::size_t tickers = 100000;
+    std::vector<int> periods{100, 250, 500, 1000};  // 毫秒
+    int duration = 5;                                // 每种模式的测试秒数
+};
+
+struct bench_result {
+    double setup_ns = 0;        // 每个注册的耗时
+    double teardown_ns = 0;     // 每个取消的耗时
+    double cpu_seconds = 0;
+    double elapsed = 0;
+    std::uint64_t ticks = 0;
+    std::uint64_t expected = 0;
+    latency_histogram lateness;
+};
+
+double process_cpu_seconds() {
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+std::uint64_t nanoseconds_since(bench_clock::time_point t) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t).count();
+    return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+}
+
+std::uint64_t expected_ticks(const bench_options &options) {
+    std::uint64_t expected = 0;
+    for (std::size_t i = 0; i < options.tickers; ++i) {
+        expected += options.duration * 1000ull / options.periods[i % options.periods.size()];
+    }
+    return expected;
+}
+
+//----------------------------------------------------------------------
+
+class object_ticker {
+public:
+    object_ticker(boost::asio::io_context &io_context, bench_clock::duration period, bench_result &result)
+            : timer_(io_context), period_(period), result_(result) {
+        timer_.expires_after(period_);
+        wait();
+    }
+
+private:
+    void wait() {
+        timer_.async_wait([this](const boost::system::error_code &ec) {
+            if (ec) {
+                return;
+            }
+            ++result_.ticks;
+            result_.lateness.record(nanoseconds_since(timer_.expiry()));
+            timer_.expires_at(timer_.expiry() + period_);
+            wait();
+        });
+    }
+
+    boost::asio::steady_timer timer_;
+    bench_clock::duration period_;
+    bench_result &result_;
+};
+
+class coalesced_ticker {
+public:
+    coalesced_ticker(periodic_timer_service &timers, bench_clock::duration period, bench_result &result)
+            : timers_(timers), result_(result) {
+        ticker_ = timers_.add<coalesced_ticker, &coalesced_ticker::tick>(period, this);
+    }
+
+    ~coalesced_ticker() {
+        timers_.cancel(ticker_);
+    }
+
+private:
+    void tick() {
+        ++result_.ticks;
+        result_.lateness.record(nanoseconds_since(timers_.expiry(ticker_)));
+    }
+
+    periodic_timer_service &timers_;
+    periodic_timer_service::ticker ticker_;
+    bench_result &result_;
+};
+
+template<typename Ticker, typename Owner>
+void run_mode(const bench_options &options, bench_result &result, Owner &owner,
+              boost::asio::io_context &io_context) {
+    std::vector<std::unique_ptr<Ticker>> tickers;
+    tickers.reserve(options.tickers);
+
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < options.tickers; ++i) {
+        auto period = std::chrono::milliseconds(options.periods[i % options.periods.size()]);
+        tickers.push_back(std::make_unique<Ticker>(owner, period, result));
+    }
+    result.setup_ns = static_cast<double>(nanoseconds_since(start)) / options.tickers;
+
+    boost::asio::steady_timer stop(io_context, std::chrono::seconds(options.duration));
+    stop.async_wait([&io_context](const boost::system::error_code &) { io_context.stop(); });
+
+    double cpu = process_cpu_seconds();
+    start = bench_clock::now();
+    io_context.run();
+    result.elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.cpu_seconds = process_cpu_seconds() - cpu;
+
+    start = bench_clock::now();
+    tickers.clear();
+    result.teardown_ns = static_cast<double>(nanoseconds_since(start)) / options.tickers;
+}
+
+void run_per_object(const bench_options &options, bench_result &result) {
+    boost::asio::io_context io_context;
+    run_mode<object_ticker>(options, result, io_context, io_context);
+}
+
+void run_coalesced(const bench_options &options, bench_result &result) {
+    boost::asio::io_context io_context;
+    auto &timers = boost::asio::use_service<periodic_timer_service>(io_context);
+    run_mode<coalesced_ticker>(options, result, timers, io_context);
+}
+
+void print_result(const char *name, const bench_result &result) {
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-11s %9.1f %11.1f %8.2f %10llu %7.1f%% %9.1f %9.1f %9.1f %10.1f\n",
+                  name, result.setup_ns, result.teardown_ns, result.cpu_seconds,
+                  static_cast<unsigned long long>(result.ticks),
+                  result.expected > 0 ? 100.0 * result.ticks / result.expected : 0.0,
+                  result.ticks > 0 ? result.cpu_seconds * 1e9 / result.ticks : 0.0,
+                  result.lateness.percentile(50.0) / 1000.0,
+                  result.lateness.percentile(99.0) / 1000.0,
+                  result.lateness.max() / 1000.0);
+    std::cout << line << std::flush;
+}
+
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--tickers"))) {
+            options.tickers = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--periods"))) {
+            options.periods.clear();
+            std::stringstream ss(value);
+            std::string period;
+            while (std::getline(ss, period, ',')) {
+                options.periods.push_back(std::atoi(period.c_str()));
+            }
+        } else if ((value = parse_option(arg, "--duration"))) {
+            options.duration = std::atoi(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+
+    for (int period: options.periods) {
+        if (period <= 0) {
+            return false;
+        }
+    }
+    return options.tickers > 0 && !options.periods.empty() && options.duration > 0;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: periodic_timer_benchmark [--tickers=<n>] [--periods=100,250,500,1000]"
+                     " [--duration=<seconds>]\n";
+        return 1;
+    }
+
+    std::cout << "tickers=" << options.tickers << " periods(ms)=";
+    for (std::size_t i = 0; i < options.periods.size(); ++i) {
+        std::cout << (i > 0 ? "," : "") << options.periods[i];
+    }
+    std::cout << " duration=" << options.duration << "s\n"
+              << "mode        setup_ns  teardown_ns  cpu_s      ticks   fired  cpu_ns/tick"
+                 "  late_p50  late_p99  late_max (us)\n";
+
+    bench_result per_object;
+    per_object.expected = expected_ticks(options);
+    run_per_object(options, per_object);
+    print_result("per-object", per_object);
+
+    bench_result coalesced;
+    coalesced.expected = expected_ticks(options);
+    run_coalesced(options, coalesced);
+    print_result("coalesced", coalesced);
+    return 0;
+}
@@ -1,223 +1,355 @@
-// https://github.com/chriskohlhoff/asio/blob/master/asio/src/tests/unit/system_timer.cpp
-
+// 定时器精度和开销测试，比较system_timer、steady_timer、high_resolution_timer和deadline_timer，
+// 用来为连接超时选择定时器类型。单线程io_context，三组测试：
+// jitter:     同一个定时器反复等待interval，记录每次回调相对到期时间的延迟分布，以及早于到期时间触发的次数。
+// churn:      反复expires_after(1s)+async_wait+cancel（连接每收到一次数据就重置超时的模式），
+//             每batch次后poll一次处理被取消的handler，记录每次重置的平均耗时分布。
+// throughput: 分别武装1k/100k/1M个到期时间均匀分布在spread内的定时器，取消其中一半后运行到全部完成，
+//             记录武装和取消的单个耗时，以及剩余定时器的触发延迟分布。
+// 延迟按各定时器自己的时钟计算：high_resolution_timer在libstdc++上就是system_clock，
+// deadline_timer使用posix_time，精度为微秒。
+
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct bench_options {
+    bool jitter = true;
+    bool churn = true;
+    bool throughput = true;
+    std::size_t samples = 500;                                  // jitter的等待次数
+    int interval_us = 1000;                                     // jitter的等待间隔
+    std::size_t resets = 1000000;                               // churn的重置次数
+    std::vector<std::size_t> sizes{1000, 100000, 1000000};      // throughput的定时器数量
+    int spread_ms = 1000;                                       // throughput的到期时间分布范围
+};
+
+// 不同定时器设置到期时间和计算延迟的方式不同
+template<typename Timer>
+struct timer_traits {
+    using time_point = typename Timer::time_point;
+
+    static time_point now() {
+        return Timer::clock_type::now();
+    }
 
-// Disable autolinking for unit tests.
-#if !defined(BOOST_ALL_NO_LIB)
-#define BOOST_ALL_NO_LIB 1
-#endif // !defined(BOOST_ALL_NO_LIB)
+    static void expires_after(Timer &timer, std::chrono::nanoseconds d) {
+        timer.expires_after(std::chrono::duration_cast<typename Timer::duration>(d));
+    }
 
-// Prevent link dependency on the Boost.System library.
-#if !defined(BOOST_SYSTEM_NO_DEPRECATED)
-#define BOOST_SYSTEM_NO_DEPRECATED
-#endif // !defined(BOOST_SYSTEM_NO_DEPRECATED)
+    static void expires_at(Timer &timer, time_point base, std::chrono::nanoseconds d) {
+        timer.expires_at(base + std::chrono::duration_cast<typename Timer::duration>(d));
+    }
 
-// Test that header file is self-contained.
-#include "asio/system_timer.hpp"
+    static time_point expiry(const Timer &timer) {
+        return timer.expiry();
+    }
 
-//#include "asio/bind_cancellation_slot.hpp"
-//#include "asio/cancellation_signal.hpp"
-#include "asio/executor_work_guard.hpp"
-#include "asio/io_context.hpp"
-#include "asio/thread.hpp"
+    // 当前时间减去到期时间，早于到期时间触发时为负
+    static std::int64_t lateness_ns(const Timer &timer) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Timer::clock_type::now() - timer.expiry()).count();
+    }
+};
 
-#if defined(ASIO_HAS_BOOST_BIND)
+template<>
+struct timer_traits<boost::asio::deadline_timer> {
+    using time_point = boost::posix_time::ptime;
 
-# include <boost/bind/bind.hpp>
+    static time_point now() {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
 
-#else // defined(ASIO_HAS_BOOST_BIND)
-# include <functional>
-#endif // defined(ASIO_HAS_BOOST_BIND)
+    static void expires_after(boost::asio::deadline_timer &timer, std::chrono::nanoseconds d) {
+        timer.expires_from_now(boost::posix_time::microseconds(d.count() / 1000));
+    }
 
-#if defined(ASIO_HAS_BOOST_BIND)
-namespace bindns = boost;
-#else // defined(ASIO_HAS_BOOST_BIND)
-namespace bindns = std;
-#endif // defined(ASIO_HAS_BOOST_BIND)
+    static void expires_at(boost::asio::deadline_timer &timer, time_point base, std::chrono::nanoseconds d) {
+        timer.expires_at(base + boost::posix_time::microseconds(d.count() / 1000));
+    }
 
-void increment(int *count) {
-    ++(*count);
-}
+    static time_point expiry(const boost::asio::deadline_timer &timer) {
+        return timer.expires_at();
+    }
 
-void increment_if_not_cancelled(int *count,
-                                const asio::error_code &ec) {
-    if (!ec) {
-        ++(*count);
+    static std::int64_t lateness_ns(const boost::asio::deadline_timer &timer) {
+        return (boost::posix_time::microsec_clock::universal_time() - timer.expires_at()).total_microseconds() * 1000;
     }
-}
+};
+
+struct lateness_stats {
+    latency_histogram histogram;
+    std::uint64_t early = 0;
+
+    void record(std::int64_t lateness) {
+        if (lateness < 0) {
+            ++early;
+            lateness = 0;
+        }
+        histogram.record(static_cast<std::uint64_t>(lateness));
+    }
+};
 
-void cancel_timer(asio::system_timer *t) {
-    std::size_t num_cancelled = t->cancel();
+std::uint64_t nanoseconds_since(bench_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t).count();
 }
 
-void cancel_one_timer(asio::system_timer *t) {
-    std::size_t num_cancelled = t->cancel_one();
+//----------------------------------------------------------------------
+
+template<typename Timer>
+void run_jitter(const char *name, const bench_options &options) {
+    using traits = timer_traits<Timer>;
+    boost::asio::io_context io_context;
+    Timer timer(io_context);
+    lateness_stats stats;
+    std::size_t remaining = options.samples;
+
+    std::function<void(const boost::system::error_code &)> on_wait;
+    on_wait = [&](const boost::system::error_code &ec) {
+        if (ec) {
+            return;
+        }
+        stats.record(traits::lateness_ns(timer));
+        if (--remaining > 0) {
+            traits::expires_after(timer, std::chrono::microseconds(options.interval_us));
+            timer.async_wait(on_wait);
+        }
+    };
+    traits::expires_after(timer, std::chrono::microseconds(options.interval_us));
+    timer.async_wait(on_wait);
+    io_context.run();
+
+    const latency_histogram &h = stats.histogram;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-22s %9.1f %9.1f %9.1f %9.1f %9.1f %7llu\n",
+                  name, h.percentile(50.0) / 1000.0, h.percentile(90.0) / 1000.0, h.percentile(99.0) / 1000.0,
+                  h.percentile(99.9) / 1000.0, h.max() / 1000.0, static_cast<unsigned long long>(stats.early));
+    std::cout << line << std::flush;
 }
 
-void io_context_run(asio::io_context *ioc) {
-    ioc->run();
+template<typename Timer>
+void run_churn(const char *name, const bench_options &options) {
+    using traits = timer_traits<Timer>;
+    const std::size_t batch = 1024;
+    boost::asio::io_context io_context;
+    Timer timer(io_context);
+    latency_histogram per_reset;
+    std::uint64_t aborted = 0;
+    auto on_wait = [&aborted](const boost::system::error_code &ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            ++aborted;
+        }
+    };
+
+    auto start = bench_clock::now();
+    for (std::size_t done = 0; done < options.resets; done += batch) {
+        auto batch_start = bench_clock::now();
+        for (std::size_t i = 0; i < batch; ++i) {
+            traits::expires_after(timer, std::chrono::seconds(1));
+            timer.async_wait(on_wait);
+            timer.cancel();
+        }
+        // 没有未完成的操作时poll会让io_context进入停止状态
+        io_context.poll();
+        io_context.restart();
+        per_reset.record(nanoseconds_since(batch_start) / batch);
+    }
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::size_t total = (options.resets + batch - 1) / batch * batch;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-22s %9.1f %9.1f %9.1f %9.1f %12.0f %s\n",
+                  name, static_cast<double>(per_reset.percentile(50.0)), static_cast<double>(per_reset.percentile(99.0)),
+                  static_cast<double>(per_reset.max()), elapsed * 1e9 / total, total / elapsed,
+                  aborted == total ? "" : "ABORT COUNT MISMATCH");
+    std::cout << line << std::flush;
 }
 
-asio::system_timer::time_point now() {
-    return asio::system_timer::clock_type::now();
+// 在另一个io_context上武装一小批定时器，估算每个定时器的武装耗时
+template<typename Timer>
+double estimate_arm_ns() {
+    using traits = timer_traits<Timer>;
+    const std::size_t count = 10000;
+    boost::asio::io_context io_context;
+    std::deque<Timer> timers;
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        Timer &timer = timers.emplace_back(io_context);
+        traits::expires_after(timer, std::chrono::hours(1));
+        timer.async_wait([](const boost::system::error_code &) {
+        });
+    }
+    return static_cast<double>(nanoseconds_since(start)) / count;
 }
 
-void system_timer_test() {
-    using asio::chrono::seconds;
-    using asio::chrono::microseconds;
-    using bindns::placeholders::_1;
-    using bindns::placeholders::_2;
-
-    asio::io_context ioc;
-    const asio::io_context::executor_type ioc_ex = ioc.get_executor();
-    int count = 0;
-
-    asio::system_timer::time_point start = now();
-
-    asio::system_timer t1(ioc, seconds(1));
-    t1.wait();
-
-    // The timer must block until after its expiry time.
-    asio::system_timer::time_point end = now();
-    asio::system_timer::time_point expected_end = start + seconds(1);
-
-    start = now();
-
-    asio::system_timer t2(ioc_ex, seconds(1) + microseconds(500000));
-    t2.wait();
-
-    // The timer must block until after its expiry time.
-    end = now();
-    expected_end = start + seconds(1) + microseconds(500000);
-
-    t2.expires_at(t2.expiry() + seconds(1));
-    t2.wait();
-
-    // The timer must block until after its expiry time.
-    end = now();
-    expected_end += seconds(1);
-
-    start = now();
-
-    t2.expires_after(seconds(1) + microseconds(200000));
-    t2.wait();
-
-    // The timer must block until after its expiry time.
-    end = now();
-    expected_end = start + seconds(1) + microseconds(200000);
-
-    start = now();
-
-    asio::system_timer t3(ioc, seconds(5));
-    t3.async_wait([&](const asio::error_code &) {
-        increment(&count);
-    });
-
-    ioc.run();
-
-    // The run() call will not return until all operations have finished, and
-    // this should not be until after the timer's expiry time.
-    ASIO_CHECK(count == 1);
-    end = now();
-    expected_end = start + seconds(1);
-    ASIO_CHECK(expected_end < end || expected_end == end);
-
-    count = 3;
-    start = now();
-
-    asio::system_timer t4(ioc, seconds(1));
-    t4.async_wait(bindns::bind(decrement_to_zero, &t4, &count));
-
-    // No completions can be delivered until run() is called.
-    ASIO_CHECK(count == 3);
-
-    ioc.restart();
-    ioc.run();
-
-    // The run() call will not return until all operations have finished, and
-    // this should not be until after the timer's final expiry time.
-    ASIO_CHECK(count == 0);
-    end = now();
-    expected_end = start + seconds(3);
-    ASIO_CHECK(expected_end < end || expected_end == end);
-
-    count = 0;
-    start = now();
-
-    asio::system_timer t5(ioc, seconds(10));
-    t5.async_wait(bindns::bind(increment_if_not_cancelled, &count, _1));
-    asio::system_timer t6(ioc, seconds(1));
-    t6.async_wait(bindns::bind(cancel_timer, &t5));
-
-    ioc.restart();
-    ioc.run();
-
-    // The timer should have been cancelled, so count should not have changed.
-    // The total run time should not have been much more than 1 second (and
-    // certainly far less than 10 seconds).
-    end = now();
-    expected_end = start + seconds(2);
-
-    // Wait on the timer again without cancelling it. This time the asynchronous
-    // wait should run to completion and increment the counter.
-    t5.async_wait(bindns::bind(increment_if_not_cancelled, &count, _1));
-
-    ioc.restart();
-    ioc.run();
-
-    // The timer should not have been cancelled, so count should have changed.
-    // The total time since the timer was created should be more than 10 seconds.
-    end = now();
-    expected_end = start + seconds(10);
-
-    count = 0;
-    start = now();
-
-    // Start two waits on a timer, one of which will be cancelled. The one
-    // which is not cancelled should still run to completion and increment the
-    // counter.
-    asio::system_timer t7(ioc, seconds(3));
-    t7.async_wait([&](const asio::error_code &ec) { increment_if_not_cancelled(&count, ec); });
-    t7.async_wait([&](const asio::error_code &ec) { increment_if_not_cancelled(&count, ec); });
-    asio::system_timer t8(ioc, seconds(1));
-    t8.async_wait(bindns::bind(cancel_one_timer, &t7));
-
-    ioc.restart();
-    ioc.run();
+template<typename Timer>
+void run_throughput(const char *name, std::size_t count, const bench_options &options) {
+    using traits = timer_traits<Timer>;
+    boost::asio::io_context io_context;
+    std::deque<Timer> timers;
+    lateness_stats stats;
+    std::uint64_t fired = 0;
+    std::uint64_t aborted = 0;
+    std::uint64_t overran = 0;      // 到期时武装和取消还没做完的定时器，不计入延迟
+
+    // 所有到期时间从同一个基准算起，第一个到期时间留出武装和取消全部定时器的时间，
+    // 避免武装过程本身计入延迟。按估算的武装耗时乘以数量再加倍，另加50ms余量
+    auto offset = std::chrono::nanoseconds(static_cast<std::int64_t>(estimate_arm_ns<Timer>() * count * 2))
+                  + std::chrono::milliseconds(50);
+    auto spread = std::chrono::milliseconds(options.spread_ms);
+    typename traits::time_point armed = traits::now();
+    auto base = traits::now();
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        Timer &timer = timers.emplace_back(io_context);
+        traits::expires_at(timer, base, offset + spread * i / count);
+        timer.async_wait([&stats, &fired, &aborted, &overran, &armed, &timer](const boost::system::error_code &ec) {
+            if (ec) {
+                ++aborted;
+                return;
+            }
+            ++fired;
+            if (traits::expiry(timer) < armed) {
+                ++overran;
+                return;
+            }
+            stats.record(traits::lateness_ns(timer));
+        });
+    }
+    double arm_ns = static_cast<double>(nanoseconds_since(start)) / count;
 
-    // One of the waits should not have been cancelled, so count should have
-    // changed. The total time since the timer was created should be more than 3
-    // seconds.
-    end = now();
-    expected_end = start + seconds(3);
+    // 连接超时大多在到期前被取消
+    start = bench_clock::now();
+    for (std::size_t i = 0; i < count; i += 2) {
+        timers[i].cancel();
+    }
+    double cancel_ns = static_cast<double>(nanoseconds_since(start)) / ((count + 1) / 2);
+    armed = traits::now();
+
+    start = bench_clock::now();
+    io_context.run();
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    const latency_histogram &h = stats.histogram;
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-22s %8zu %8.1f %9.1f %9.1f %9.1f %9.1f %7llu %7.2f %s\n",
+                  name, count, arm_ns, cancel_ns, h.percentile(50.0) / 1000.0, h.percentile(99.0) / 1000.0,
+                  h.max() / 1000.0, static_cast<unsigned long long>(stats.early), elapsed,
+                  fired + aborted != count ? "COUNT MISMATCH" : overran > 0 ? "ARMING OVERRAN" : "");
+    std::cout << line << std::flush;
 }
 
-void system_timer_thread_test() {
-    asio::io_context ioc;
-    asio::executor_work_guard<asio::io_context::executor_type> work
-            = asio::make_work_guard(ioc);
-    asio::system_timer t1(ioc);
-    asio::system_timer t2(ioc);
-    int count = 0;
-
-    asio::thread th([capture0 = &ioc] { return io_context_run(capture0); });
+template<typename Suite>
+void for_each_timer(Suite &&suite) {
+    suite(static_cast<boost::asio::system_timer *>(nullptr), "system_timer");
+    suite(static_cast<boost::asio::steady_timer *>(nullptr), "steady_timer");
+    suite(static_cast<boost::asio::high_resolution_timer *>(nullptr), "high_resolution_timer");
+    suite(static_cast<boost::asio::deadline_timer *>(nullptr), "deadline_timer");
+}
 
-    t2.expires_after(asio::chrono::seconds(2));
-    t2.wait();
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--suite"))) {
+            options.jitter = options.churn = options.throughput = false;
+            std::stringstream ss(value);
+            std::string suite;
+            while (std::getline(ss, suite, ',')) {
+                if (suite == "jitter") {
+                    options.jitter = true;
+                } else if (suite == "churn") {
+                    options.churn = true;
+                } else if (suite == "throughput") {
+                    options.throughput = true;
+                } else {
+                    std::cerr << "Unknown suite: " << suite << "\n";
+                    return false;
+                }
+            }
+        } else if ((value = parse_option(arg, "--samples"))) {
+            options.samples = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--interval-us"))) {
+            options.interval_us = std::atoi(value);
+        } else if ((value = parse_option(arg, "--churn"))) {
+            options.resets = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--sizes"))) {
+            options.sizes.clear();
+            std::stringstream ss(value);
+            std::string size;
+            while (std::getline(ss, size, ',')) {
+                options.sizes.push_back(std::strtoul(size.c_str(), nullptr, 10));
+            }
+        } else if ((value = parse_option(arg, "--spread-ms"))) {
+            options.spread_ms = std::atoi(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
 
-    t1.expires_after(asio::chrono::seconds(2));
-    t1.async_wait([&](const asio::error_code &) {
-        increment(&count);
-    });
+    for (std::size_t size: options.sizes) {
+        if (size == 0) {
+            return false;
+        }
+    }
+    return options.samples > 0 && options.interval_us > 0 && options.resets > 0 && options.spread_ms > 0;
+}
 
-    t2.expires_after(asio::chrono::seconds(4));
-    t2.wait();
+int main(int argc, char *argv[]) {
+    bench_options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: asio_timer [--suite=jitter,churn,throughput] [--samples=<n>] [--interval-us=<us>]"
+                     " [--churn=<n>] [--sizes=1000,100000,1000000] [--spread-ms=<ms>]\n";
+        return 1;
+    }
 
-    ioc.stop();
-    th.join();
-}
+    if (options.jitter) {
+        std::cout << "jitter: samples=" << options.samples << " interval=" << options.interval_us << "us\n"
+                  << "timer                   p50_us    p90_us    p99_us  p99.9_us    max_us   early\n";
+        for_each_timer([&](auto *tag, const char *name) {
+            run_jitter<std::remove_pointer_t<decltype(tag)>>(name, options);
+        });
+        std::cout << "\n";
+    }
 
+    if (options.churn) {
+        std::cout << "churn: expires_after+async_wait+cancel x " << options.resets << "\n"
+                  << "timer                   p50_ns    p99_ns    max_ns   mean_ns      resets/s\n";
+        for_each_timer([&](auto *tag, const char *name) {
+            run_churn<std::remove_pointer_t<decltype(tag)>>(name, options);
+        });
+        std::cout << "\n";
+    }
 
-int main() {
-    system_timer_thread_test();
+    if (options.throughput) {
+        std::cout << "throughput: spread=" << options.spread_ms << "ms, half of the timers cancelled before expiry\n"
+                  << "timer                     armed   arm_ns cancel_ns  late_p50  late_p99  late_max"
+                     "   early   run_s (late in us)\n";
+        for (std::size_t count: options.sizes) {
+            for_each_timer([&](auto *tag, const char *name) {
+                run_throughput<std::remove_pointer_t<decltype(tag)>>(name, count, options);
+            });
+        }
+    }
+    return 0;
 }
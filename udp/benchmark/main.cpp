@@ -0,0 +1,223 @@
+// UDP回显服务器包速率压测（仅Linux）：
+// 每个线程一个connect到服务器的UDP socket，用sendmmsg一次发出一个窗口的数据报，再用recvmmsg收回，
+// 窗口全部收回或等待超时后开始下一个窗口，超时未收回的计为丢包。
+// 默认依次测试64字节和1200字节负载，统计每秒往返的数据报数、丢包率和每个窗口的往返时间。
+// 每个数据报的前4个字节写入窗口序号，上一个窗口超时后才到达的回显不计入当前窗口。
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <boost/asio.hpp>
+
+#include "public/command_line.h"
+#include "public/latency_histogram.h"
+#include "udp/public/udp_batch.h"
+
+using boost::asio::ip::udp;
+using bench_clock = std::chrono::steady_clock;
+
+struct bench_options {
+    std::string host = "127.0.0.1";
+    std::string port = "15001";
+    std::vector<std::size_t> sizes{64, 1200};
+    std::size_t threads = 1;
+    std::size_t window = 64;        // 每次sendmmsg发出的数据报数量
+    int timeout_ms = 50;            // 等待一个窗口回显的超时
+    int duration = 5;               // 每种负载的测试秒数
+};
+
+struct bench_worker {
+    std::uint64_t sent = 0;
+    std::uint64_t received = 0;
+    std::uint64_t late = 0;
+    latency_histogram window_latency;
+};
+
+void run_worker(bench_worker &worker, const udp::endpoint &server, const bench_options &options,
+                std::size_t size, const std::atomic<bool> &stop) {
+    boost::asio::io_context io_context;
+    udp::socket socket(io_context, udp::v4());
+    socket.set_option(udp::socket::receive_buffer_size(4 * 1024 * 1024));
+    socket.set_option(udp::socket::send_buffer_size(4 * 1024 * 1024));
+    socket.connect(server);
+    int fd = socket.native_handle();
+
+    timeval tv{};
+    tv.tv_sec = options.timeout_ms / 1000;
+    tv.tv_usec = (options.timeout_ms % 1000) * 1000;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    udp_batch out(options.window, size);
+    udp_batch in(options.window, udp_max_datagram / 16);
+    for (std::size_t i = 0; i < options.window; ++i) {
+        std::memset(out.data(i), static_cast<int>(i), size);
+    }
+
+    for (std::uint32_t sequence = 0; !stop.load(std::memory_order_relaxed); ++sequence) {
+        for (std::size_t i = 0; i < options.window; ++i) {
+            std::memcpy(out.data(i), &sequence, sizeof(sequence));
+        }
+
+        auto start = bench_clock::now();
+        out.prepare_send(options.window, size);
+        std::size_t sent = 0;
+        while (sent < options.window) {
+            int n = out.send(fd, sent, options.window - sent);
+            if (n < 0) {
+                break;
+            }
+            sent += n;
+        }
+        worker.sent += sent;
+
+        // 阻塞读取，直到收齐当前窗口或SO_RCVTIMEO超时
+        std::size_t received = 0;
+        while (received < sent) {
+            int n = in.receive(fd);
+            if (n == 0) {
+                // 非阻塞地没收到，阻塞等待下一个数据报到达或超时
+                char probe;
+                if (::recv(fd, &probe, 1, MSG_PEEK) < 0) {
+                    break;
+                }
+                continue;
+            }
+            if (n < 0) {
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                std::uint32_t echoed = 0;
+                std::memcpy(&echoed, in.data(i), sizeof(echoed));
+                if (echoed == sequence && in.length(i) == size) {
+                    ++received;
+                } else {
+                    ++worker.late;
+                }
+            }
+        }
+        worker.received += received;
+        if (received == sent) {
+            worker.window_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    bench_clock::now() - start).count());
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+
+bool parse_options(int argc, char *argv[], bench_options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if ((value = parse_option(arg, "--host"))) {
+            options.host = value;
+        } else if ((value = parse_option(arg, "--port"))) {
+            options.port = value;
+        } else if ((value = parse_option(arg, "--sizes"))) {
+            options.sizes.clear();
+            std::stringstream ss(value);
+            std::string size;
+            while (std::getline(ss, size, ',')) {
+                options.sizes.push_back(std::strtoul(size.c_str(), nullptr, 10));
+            }
+        } else if ((value = parse_option(arg, "--threads"))) {
+            options.threads = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--window"))) {
+            options.window = std::strtoul(value, nullptr, 10);
+        } else if ((value = parse_option(arg, "--timeout"))) {
+            options.timeout_ms = std::atoi(value);
+        } else if ((value = parse_option(arg, "--duration"))) {
+            options.duration = std::atoi(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+
+    for (std::size_t size: options.sizes) {
+        if (size < sizeof(std::uint32_t) || size > udp_max_datagram / 16) {
+            std::cerr << "Payload size must be between 4 and " << udp_max_datagram / 16 << "\n";
+            return false;
+        }
+    }
+    if (options.threads == 0) {
+        options.threads = 1;
+    }
+    return !options.sizes.empty() && options.window > 0 && options.timeout_ms > 0;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        bench_options options;
+        if (!parse_options(argc, argv, options)) {
+            std::cerr << "Usage: udp_benchmark [--host=<host>] [--port=<port>] [--sizes=64,1200]"
+                         " [--threads=<n>] [--window=<datagrams>] [--timeout=<ms>] [--duration=<seconds>]\n";
+            return 1;
+        }
+
+        boost::asio::io_context io_context;
+        udp::resolver resolver(io_context);
+        udp::endpoint server = *resolver.resolve(udp::v4(), options.host, options.port).begin();
+
+        std::cout << "threads=" << options.threads << " window=" << options.window << "\n"
+                  << "payload         pps      MiB/s    loss%   late  window_p50_us  window_p99_us\n";
+        for (std::size_t size: options.sizes) {
+            std::atomic<bool> stop{false};
+            std::vector<std::unique_ptr<bench_worker>> workers;
+            std::vector<std::thread> threads;
+            auto start = bench_clock::now();
+            for (std::size_t i = 0; i < options.threads; ++i) {
+                workers.push_back(std::make_unique<bench_worker>());
+                threads.emplace_back([&, worker = workers.back().get()]() {
+                    run_worker(*worker, server, options, size, stop);
+                });
+            }
+
+            std::this_thread::sleep_for(std::chrono::seconds(options.duration));
+            stop = true;
+            double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+            for (auto &t: threads) {
+                t.join();
+            }
+
+            bench_worker total;
+            for (auto &worker: workers) {
+                total.sent += worker->sent;
+                total.received += worker->received;
+                total.late += worker->late;
+                total.window_latency.merge(worker->window_latency);
+            }
+
+            double pps = static_cast<double>(total.received) / elapsed;
+            double loss = total.sent > 0
+                          ? 100.0 * static_cast<double>(total.sent - total.received) / total.sent : 0.0;
+            char line[160];
+            std::snprintf(line, sizeof(line), "%7zu %11.0f %10.1f %8.3f %6llu %14.1f %14.1f\n",
+                          size, pps, pps * size / (1024.0 * 1024.0), loss,
+                          static_cast<unsigned long long>(total.late),
+                          total.window_latency.percentile(50.0) / 1000.0,
+                          total.window_latency.percentile(99.0) / 1000.0);
+            std::cout << line << std::flush;
+        }
+    }
+    catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
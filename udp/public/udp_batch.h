@@ -0,0 +1,201 @@
+//
+// Linux上用recvmmsg/sendmmsg批量收发UDP数据报，服务器和压测程序共用。
+// 一批数据报的缓冲区、地址和控制消息都在构造时一次性分配，收发过程中不再分配内存。
+// 开启GRO时内核会把同一来源的连续数据报合并成一个大缓冲区，并在控制消息中给出分段大小；
+// 回显时带上UDP_SEGMENT（GSO）原样发回，由内核重新切分。
+//
+
+#ifndef TEST_ASIO_UDP_BATCH_H
+#define TEST_ASIO_UDP_BATCH_H
+
+#include <cstddef>
+
+constexpr std::size_t udp_max_datagram = 65536;
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#if defined(UDP_GRO) && defined(UDP_SEGMENT)
+#define TEST_ASIO_UDP_HAS_GSO 1
+#endif
+
+class udp_batch
+{
+public:
+	udp_batch(std::size_t capacity, std::size_t datagram_size)
+		: capacity_(capacity), datagram_size_(datagram_size),
+		slab_(capacity * datagram_size), msgs_(capacity), iov_(capacity), addrs_(capacity),
+		controls_(capacity * control_size, 0), segments_(capacity, 0)
+	{
+		for (std::size_t i = 0; i < capacity_; ++i)
+		{
+			iov_[i].iov_base = slab_.data() + i * datagram_size_;
+		}
+		reset(capacity_);
+	}
+
+	std::size_t capacity() const
+	{
+		return capacity_;
+	}
+
+	char* data(std::size_t i)
+	{
+		return slab_.data() + i * datagram_size_;
+	}
+
+	std::size_t length(std::size_t i) const
+	{
+		return msgs_[i].msg_len;
+	}
+
+	// 数据报i包含的原始数据报个数，GRO合并时大于1
+	std::size_t segments(std::size_t i) const
+	{
+		if (segments_[i] == 0 || msgs_[i].msg_len <= segments_[i])
+		{
+			return 1;
+		}
+		return (msgs_[i].msg_len + segments_[i] - 1) / segments_[i];
+	}
+
+	// 非阻塞地收取一批。返回收到的数量，没有数据时返回0，出错返回-1并保留errno
+	int receive(int fd)
+	{
+		reset(capacity_);
+		int n = recvmmsg(fd, msgs_.data(), static_cast<unsigned int>(capacity_), MSG_DONTWAIT, nullptr);
+		if (n < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		for (int i = 0; i < n; ++i)
+		{
+			segments_[i] = gro_segment_size(msgs_[i].msg_hdr);
+		}
+		return n;
+	}
+
+	// 把收到的前count个数据报改成发回各自来源的消息
+	void prepare_echo(std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			iov_[i].iov_len = msgs_[i].msg_len;
+			set_gso_segment(msgs_[i].msg_hdr, i, segments_[i] != 0 && msgs_[i].msg_len > segments_[i]
+				? segments_[i] : 0);
+		}
+	}
+
+	// 准备发往同一目的地的count个length字节的数据报（压测客户端用，目的地由connect决定）
+	void prepare_send(std::size_t count, std::size_t length)
+	{
+		reset(count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			iov_[i].iov_len = length;
+			msgs_[i].msg_hdr.msg_name = nullptr;
+			msgs_[i].msg_hdr.msg_namelen = 0;
+			msgs_[i].msg_hdr.msg_control = nullptr;
+			msgs_[i].msg_hdr.msg_controllen = 0;
+		}
+	}
+
+	// 从first开始发送count个。返回发出的数量；发送缓冲区满时返回0，出错返回-1并保留errno
+	int send(int fd, std::size_t first, std::size_t count)
+	{
+		int n = sendmmsg(fd, msgs_.data() + first, static_cast<unsigned int>(count), MSG_DONTWAIT);
+		if (n < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		return n;
+	}
+
+private:
+#if defined(TEST_ASIO_UDP_HAS_GSO)
+	static constexpr std::size_t control_size = CMSG_SPACE(sizeof(int));
+#else
+	static constexpr std::size_t control_size = 0;
+#endif
+
+	void reset(std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			iov_[i].iov_len = datagram_size_;
+			msghdr& hdr = msgs_[i].msg_hdr;
+			hdr.msg_name = &addrs_[i];
+			hdr.msg_namelen = sizeof(sockaddr_storage);
+			hdr.msg_iov = &iov_[i];
+			hdr.msg_iovlen = 1;
+			hdr.msg_control = control_size > 0 ? controls_.data() + i * control_size : nullptr;
+			hdr.msg_controllen = control_size;
+			hdr.msg_flags = 0;
+			msgs_[i].msg_len = 0;
+			segments_[i] = 0;
+		}
+	}
+
+	static std::size_t gro_segment_size(msghdr& hdr)
+	{
+#if defined(TEST_ASIO_UDP_HAS_GSO)
+		for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+		{
+			if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+			{
+				int size = 0;
+				std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+				return size > 0 ? static_cast<std::size_t>(size) : 0;
+			}
+		}
+#else
+		(void)hdr;
+#endif
+		return 0;
+	}
+
+	void set_gso_segment(msghdr& hdr, std::size_t i, std::size_t segment)
+	{
+#if defined(TEST_ASIO_UDP_HAS_GSO)
+		if (segment > 0)
+		{
+			hdr.msg_control = controls_.data() + i * control_size;
+			hdr.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+			cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+			std::uint16_t value = static_cast<std::uint16_t>(segment);
+			std::memcpy(CMSG_DATA(cmsg), &value, sizeof(value));
+			return;
+		}
+#else
+		(void)i;
+		(void)segment;
+#endif
+		hdr.msg_control = nullptr;
+		hdr.msg_controllen = 0;
+	}
+
+	std::size_t capacity_;
+	std::size_t datagram_size_;
+	std::vector<char> slab_;
+	std::vector<mmsghdr> msgs_;
+	std::vector<iovec> iov_;
+	std::vector<sockaddr_storage> addrs_;
+	std::vector<char> controls_;
+	std::vector<std::size_t> segments_;
+};
+
+#endif
+
+#endif //TEST_ASIO_UDP_BATCH_H
@@ -0,0 +1,368 @@
+// UDP回显服务器：
+// 每个线程一个io_context和一个socket，多线程时用SO_REUSEPORT绑定同一端口，由内核按来源分发数据报。
+// Linux上socket可读后用recvmmsg一次取一批，再用sendmmsg原样发回，直到内核队列取空才重新等待可读；
+// 发送缓冲区满时等待可写后继续发送剩下的部分。其他平台退化为逐个async_receive_from/async_send_to。
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "public/command_line.h"
+#include "udp/public/udp_batch.h"
+
+using boost::asio::ip::udp;
+
+const unsigned short PORT = 15001;
+
+struct server_options
+{
+	unsigned short port = PORT;
+	unsigned int threads = 1;       // 大于1时每个线程一个socket，用SO_REUSEPORT绑定同一端口
+	unsigned int batch = 64;        // 每次recvmmsg/sendmmsg的数据报数量
+	unsigned int rounds = 16;       // 一次可读事件中最多处理的批数，避免单个socket长时间占用线程
+	unsigned int datagram_size = 2048;  // 每个接收缓冲区的大小，超过的数据报会被截断
+	bool gro = false;               // 开启UDP_GRO，回显时用UDP_SEGMENT发回；GRO合并后的缓冲区按64KiB分配
+	int stats_interval = 0;         // 秒，大于0时定期打印收发速率
+};
+
+// 只在所属线程中修改，统计定时器在主线程读取
+struct server_stats
+{
+	std::atomic<std::uint64_t> received{0};
+	std::atomic<std::uint64_t> sent{0};
+	std::atomic<std::uint64_t> batches{0};
+	std::atomic<std::uint64_t> dropped{0};
+};
+
+class udp_echo_server
+{
+public:
+	udp_echo_server(boost::asio::io_context& io_context, const server_options& options)
+		: socket_(io_context), options_(options)
+#if defined(__linux__)
+		, batch_(options.batch, options.gro ? udp_max_datagram : options.datagram_size)
+#endif
+	{
+		udp::endpoint endpoint(udp::v4(), options.port);
+		socket_.open(endpoint.protocol());
+		socket_.set_option(udp::socket::reuse_address(true));
+#if defined(SO_REUSEPORT)
+		if (options.threads > 1)
+		{
+			socket_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+		}
+#endif
+		socket_.set_option(udp::socket::receive_buffer_size(4 * 1024 * 1024));
+		socket_.set_option(udp::socket::send_buffer_size(4 * 1024 * 1024));
+		socket_.bind(endpoint);
+
+#if defined(__linux__)
+#if defined(TEST_ASIO_UDP_HAS_GSO)
+		if (options.gro)
+		{
+			socket_.set_option(boost::asio::detail::socket_option::integer<SOL_UDP, UDP_GRO>(1));
+		}
+#endif
+		socket_.native_non_blocking(true);
+		wait_read();
+#else
+		buffer_.resize(udp_max_datagram);
+		do_receive();
+#endif
+	}
+
+	const server_stats& stats() const
+	{
+		return stats_;
+	}
+
+private:
+#if defined(__linux__)
+	void wait_read()
+	{
+		socket_.async_wait(udp::socket::wait_read,
+			[this](boost::system::error_code ec)
+			{
+				if (!ec)
+				{
+					handle_read();
+				}
+			});
+	}
+
+	void handle_read()
+	{
+		for (unsigned int round = 0; round < options_.rounds; ++round)
+		{
+			int n = batch_.receive(socket_.native_handle());
+			if (n <= 0)
+			{
+				break;
+			}
+
+			std::uint64_t datagrams = 0;
+			for (int i = 0; i < n; ++i)
+			{
+				datagrams += batch_.segments(i);
+			}
+			stats_.received.fetch_add(datagrams, std::memory_order_relaxed);
+			stats_.batches.fetch_add(1, std::memory_order_relaxed);
+
+			batch_.prepare_echo(n);
+			pending_ = static_cast<std::size_t>(n);
+			sent_ = 0;
+			if (!flush())
+			{
+				return;
+			}
+		}
+
+		wait_read();
+	}
+
+	// 发送当前批中剩下的数据报。发送缓冲区满时等待可写并返回false，由可写回调继续
+	bool flush()
+	{
+		while (sent_ < pending_)
+		{
+			int n = batch_.send(socket_.native_handle(), sent_, pending_ - sent_);
+			if (n == 0)
+			{
+				socket_.async_wait(udp::socket::wait_write,
+					[this](boost::system::error_code ec)
+					{
+						if (!ec && flush())
+						{
+							handle_read();
+						}
+					});
+				return false;
+			}
+
+			if (n < 0)
+			{
+				// 对端不可达等错误只影响当前数据报，跳过它继续发送
+				stats_.dropped.fetch_add(1, std::memory_order_relaxed);
+				n = 1;
+			}
+			else
+			{
+				std::uint64_t datagrams = 0;
+				for (std::size_t i = sent_; i < sent_ + n; ++i)
+				{
+					datagrams += batch_.segments(i);
+				}
+				stats_.sent.fetch_add(datagrams, std::memory_order_relaxed);
+			}
+			sent_ += n;
+		}
+		return true;
+	}
+#else
+	void do_receive()
+	{
+		socket_.async_receive_from(boost::asio::buffer(buffer_), sender_,
+			[this](boost::system::error_code ec, std::size_t length)
+			{
+				if (ec)
+				{
+					do_receive();
+					return;
+				}
+
+				stats_.received.fetch_add(1, std::memory_order_relaxed);
+				socket_.async_send_to(boost::asio::buffer(buffer_.data(), length), sender_,
+					[this](boost::system::error_code ec, std::size_t)
+					{
+						if (ec)
+						{
+							stats_.dropped.fetch_add(1, std::memory_order_relaxed);
+						}
+						else
+						{
+							stats_.sent.fetch_add(1, std::memory_order_relaxed);
+						}
+						do_receive();
+					});
+			});
+	}
+#endif
+
+	udp::socket socket_;
+	const server_options& options_;
+	server_stats stats_;
+#if defined(__linux__)
+	udp_batch batch_;
+	std::size_t pending_ = 0;
+	std::size_t sent_ = 0;
+#else
+	std::vector<char> buffer_;
+	udp::endpoint sender_;
+#endif
+};
+
+// 定期汇总所有线程的计数，打印每秒收发的数据报数和平均批大小
+class stats_reporter
+{
+public:
+	stats_reporter(boost::asio::io_context& io_context, const std::list<udp_echo_server>& servers, int interval)
+		: timer_(io_context), servers_(servers), interval_(interval)
+	{
+		schedule();
+	}
+
+private:
+	void schedule()
+	{
+		timer_.expires_after(std::chrono::seconds(interval_));
+		timer_.async_wait(
+			[this](boost::system::error_code ec)
+			{
+				if (!ec)
+				{
+					report();
+					schedule();
+				}
+			});
+	}
+
+	void report()
+	{
+		std::uint64_t received = 0, sent = 0, batches = 0, dropped = 0;
+		for (const auto& server : servers_)
+		{
+			received += server.stats().received.load(std::memory_order_relaxed);
+			sent += server.stats().sent.load(std::memory_order_relaxed);
+			batches += server.stats().batches.load(std::memory_order_relaxed);
+			dropped += server.stats().dropped.load(std::memory_order_relaxed);
+		}
+
+		std::cout << "rx_pps=" << (received - last_received_) / interval_
+			<< " tx_pps=" << (sent - last_sent_) / interval_
+			<< " avg_batch=" << (batches > last_batches_
+				? static_cast<double>(received - last_received_) / (batches - last_batches_) : 0.0)
+			<< " dropped=" << dropped << std::endl;
+
+		last_received_ = received;
+		last_sent_ = sent;
+		last_batches_ = batches;
+	}
+
+	boost::asio::steady_timer timer_;
+	const std::list<udp_echo_server>& servers_;
+	int interval_;
+	std::uint64_t last_received_ = 0;
+	std::uint64_t last_sent_ = 0;
+	std::uint64_t last_batches_ = 0;
+};
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		server_options options;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+			const char* value = nullptr;
+			if ((value = parse_option(arg, "--port")))
+			{
+				options.port = static_cast<unsigned short>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--threads")))
+			{
+				options.threads = static_cast<unsigned int>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--batch")))
+			{
+				options.batch = static_cast<unsigned int>(std::atoi(value));
+			}
+			else if ((value = parse_option(arg, "--max-datagram")))
+			{
+				options.datagram_size = static_cast<unsigned int>(std::atoi(value));
+			}
+			else if (std::strcmp(arg, "--gro") == 0)
+			{
+				options.gro = true;
+			}
+			else if ((value = parse_option(arg, "--stats-interval")))
+			{
+				options.stats_interval = std::atoi(value);
+			}
+			else
+			{
+				std::cerr << "Usage: udp_server [--port=<port>] [--threads=<n>] [--batch=<datagrams>]"
+					" [--max-datagram=<bytes>] [--gro] [--stats-interval=<seconds>]" << std::endl;
+				return 1;
+			}
+		}
+
+		if (options.threads == 0)
+		{
+			options.threads = 1;
+		}
+		if (options.batch == 0)
+		{
+			options.batch = 1;
+		}
+		if (options.datagram_size == 0 || options.datagram_size > udp_max_datagram)
+		{
+			options.datagram_size = udp_max_datagram;
+		}
+#if !defined(SO_REUSEPORT)
+		if (options.threads > 1)
+		{
+			std::cerr << "SO_REUSEPORT is not supported on this platform" << std::endl;
+			return 1;
+		}
+#endif
+#if !defined(TEST_ASIO_UDP_HAS_GSO)
+		if (options.gro)
+		{
+			std::cerr << "UDP GRO/GSO is not supported on this platform" << std::endl;
+			return 1;
+		}
+#endif
+
+		std::list<boost::asio::io_context> io_contexts;
+		std::list<udp_echo_server> servers;
+		for (unsigned int i = 0; i < options.threads; ++i)
+		{
+			io_contexts.emplace_back(1);
+			servers.emplace_back(io_contexts.back(), options);
+		}
+
+		std::unique_ptr<stats_reporter> reporter;
+		if (options.stats_interval > 0)
+		{
+			reporter.reset(new stats_reporter(io_contexts.front(), servers, options.stats_interval));
+		}
+
+		std::vector<std::thread> threads;
+		for (auto it = std::next(io_contexts.begin()); it != io_contexts.end(); ++it)
+		{
+			threads.emplace_back([it]() { it->run(); });
+		}
+		io_contexts.front().run();
+
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+
+	return 0;
+}